@@ -1,672 +1,1059 @@
-﻿///////////////////////////////////////////////////////////////////////////////
-// shadermanager.cpp
-// ============
-// manage the loading and rendering of 3D scenes
-//
-//  AUTHOR: Brian Battersby - SNHU Instructor / Computer Science
-//	Created for CS-330-Computational Graphics and Visualization, Nov. 1st, 2023
-///////////////////////////////////////////////////////////////////////////////
-
-#include "SceneManager.h"
-
-#ifndef STB_IMAGE_IMPLEMENTATION
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-#endif
-
-#include <glm/gtx/transform.hpp>
-
-// declaration of global variables
-namespace
-{
-	const char* g_ModelName = "model";
-	const char* g_ColorValueName = "objectColor";
-	const char* g_TextureValueName = "objectTexture";
-	const char* g_UseTextureName = "bUseTexture";
-	const char* g_UseLightingName = "bUseLighting";
-}
-
-/***********************************************************
- *  SceneManager()
- *
- *  The constructor for the class
- ***********************************************************/
-SceneManager::SceneManager(ShaderManager* pShaderManager)
-{
-	m_pShaderManager = pShaderManager;
-	m_basicMeshes = new ShapeMeshes();
-
-	// initialize the texture collection
-	for (int i = 0; i < 16; i++)
-	{
-		m_textureIDs[i].tag = "/0";
-		m_textureIDs[i].ID = -1;
-	}
-	m_loadedTextures = 0;
-}
-
-/***********************************************************
- *  ~SceneManager()
- *
- *  The destructor for the class
- ***********************************************************/
-SceneManager::~SceneManager()
-{
-	// clear the allocated memory
-	m_pShaderManager = NULL;
-	delete m_basicMeshes;
-	m_basicMeshes = NULL;
-	// destroy the created OpenGL textures
-	DestroyGLTextures();
-}
-
-/***********************************************************
- *  CreateGLTexture()
- *
- *  This method is used for loading textures from image files,
- *  configuring the texture mapping parameters in OpenGL,
- *  generating the mipmaps, and loading the read texture into
- *  the next available texture slot in memory.
- ***********************************************************/
-bool SceneManager::CreateGLTexture(const char* filename, std::string tag)
-{
-	int width = 0;
-	int height = 0;
-	int colorChannels = 0;
-	GLuint textureID = 0;
-
-	// indicate to always flip images vertically when loaded
-	stbi_set_flip_vertically_on_load(true);
-
-	// try to parse the image data from the specified image file
-	unsigned char* image = stbi_load(
-		filename,
-		&width,
-		&height,
-		&colorChannels,
-		0);
-
-	// if the image was successfully read from the image file
-	if (image)
-	{
-		std::cout << "Successfully loaded image:" << filename << ", width:" << width << ", height:" << height << ", channels:" << colorChannels << std::endl;
-
-		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-
-		// set the texture wrapping parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		// set texture filtering parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		// if the loaded image is in RGB format
-		if (colorChannels == 3)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-		// if the loaded image is in RGBA format - it supports transparency
-		else if (colorChannels == 4)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-		else
-		{
-			std::cout << "Not implemented to handle image with " << colorChannels << " channels" << std::endl;
-			return false;
-		}
-
-		// generate the texture mipmaps for mapping textures to lower resolutions
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		// free the image data from local memory
-		stbi_image_free(image);
-		glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
-
-		// register the loaded texture and associate it with the special tag string
-		m_textureIDs[m_loadedTextures].ID = textureID;
-		m_textureIDs[m_loadedTextures].tag = tag;
-		m_loadedTextures++;
-
-		return true;
-	}
-
-	std::cout << "Could not load image:" << filename << std::endl;
-
-	// Error loading the image
-	return false;
-}
-
-/***********************************************************
- *  BindGLTextures()
- *
- *  This method is used for binding the loaded textures to
- *  OpenGL texture memory slots.  There are up to 16 slots.
- ***********************************************************/
-void SceneManager::BindGLTextures()
-{
-	for (int i = 0; i < m_loadedTextures; i++)
-	{
-		// bind textures on corresponding texture units
-		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(GL_TEXTURE_2D, m_textureIDs[i].ID);
-	}
-}
-
-/***********************************************************
- *  DestroyGLTextures()
- *
- *  This method is used for freeing the memory in all the
- *  used texture memory slots.
- ***********************************************************/
-void SceneManager::DestroyGLTextures()
-{
-	for (int i = 0; i < m_loadedTextures; i++)
-	{
-		glGenTextures(1, &m_textureIDs[i].ID);
-	}
-}
-
-/***********************************************************
- *  FindTextureID()
- *
- *  This method is used for getting an ID for the previously
- *  loaded texture bitmap associated with the passed in tag.
- ***********************************************************/
-int SceneManager::FindTextureID(std::string tag)
-{
-	int textureID = -1;
-	int index = 0;
-	bool bFound = false;
-
-	while ((index < m_loadedTextures) && (bFound == false))
-	{
-		if (m_textureIDs[index].tag.compare(tag) == 0)
-		{
-			textureID = m_textureIDs[index].ID;
-			bFound = true;
-		}
-		else
-			index++;
-	}
-
-	return(textureID);
-}
-
-/***********************************************************
- *  FindTextureSlot()
- *
- *  This method is used for getting a slot index for the previously
- *  loaded texture bitmap associated with the passed in tag.
- ***********************************************************/
-int SceneManager::FindTextureSlot(std::string tag)
-{
-	int textureSlot = -1;
-	int index = 0;
-	bool bFound = false;
-
-	while ((index < m_loadedTextures) && (bFound == false))
-	{
-		if (m_textureIDs[index].tag.compare(tag) == 0)
-		{
-			textureSlot = index;
-			bFound = true;
-		}
-		else
-			index++;
-	}
-
-	return(textureSlot);
-}
-
-/***********************************************************
- *  FindMaterial()
- *
- *  This method is used for getting a material from the previously
- *  defined materials list that is associated with the passed in tag.
- ***********************************************************/
-bool SceneManager::FindMaterial(std::string tag, OBJECT_MATERIAL& material)
-{
-	if (m_objectMaterials.size() == 0)
-	{
-		return(false);
-	}
-
-	int index = 0;
-	bool bFound = false;
-	while ((index < m_objectMaterials.size()) && (bFound == false))
-	{
-		if (m_objectMaterials[index].tag.compare(tag) == 0)
-		{
-			bFound = true;
-			material.ambientColor = m_objectMaterials[index].ambientColor;
-			material.ambientStrength = m_objectMaterials[index].ambientStrength;
-			material.diffuseColor = m_objectMaterials[index].diffuseColor;
-			material.specularColor = m_objectMaterials[index].specularColor;
-			material.shininess = m_objectMaterials[index].shininess;
-		}
-		else
-		{
-			index++;
-		}
-	}
-
-	return(true);
-}
-
-/***********************************************************
- *  SetTransformations()
- *
- *  This method is used for setting the transform buffer
- *  using the passed in transformation values.
- ***********************************************************/
-void SceneManager::SetTransformations(
-	glm::vec3 scaleXYZ,
-	float XrotationDegrees,
-	float YrotationDegrees,
-	float ZrotationDegrees,
-	glm::vec3 positionXYZ)
-{
-	// variables for this method
-	glm::mat4 modelView;
-	glm::mat4 scale;
-	glm::mat4 rotationX;
-	glm::mat4 rotationY;
-	glm::mat4 rotationZ;
-	glm::mat4 translation;
-
-	// set the scale value in the transform buffer
-	scale = glm::scale(scaleXYZ);
-	// set the rotation values in the transform buffer
-	rotationX = glm::rotate(glm::radians(XrotationDegrees), glm::vec3(1.0f, 0.0f, 0.0f));
-	rotationY = glm::rotate(glm::radians(YrotationDegrees), glm::vec3(0.0f, 1.0f, 0.0f));
-	rotationZ = glm::rotate(glm::radians(ZrotationDegrees), glm::vec3(0.0f, 0.0f, 1.0f));
-	// set the translation value in the transform buffer
-	translation = glm::translate(positionXYZ);
-
-	modelView = translation * rotationX * rotationY * rotationZ * scale;
-
-	if (NULL != m_pShaderManager)
-	{
-		m_pShaderManager->setMat4Value(g_ModelName, modelView);
-	}
-}
-
-/***********************************************************
- *  SetShaderColor()
- *
- *  This method is used for setting the passed in color
- *  into the shader for the next draw command
- ***********************************************************/
-void SceneManager::SetShaderColor(
-	float redColorValue,
-	float greenColorValue,
-	float blueColorValue,
-	float alphaValue)
-{
-	// variables for this method
-	glm::vec4 currentColor;
-
-	currentColor.r = redColorValue;
-	currentColor.g = greenColorValue;
-	currentColor.b = blueColorValue;
-	currentColor.a = alphaValue;
-
-	if (NULL != m_pShaderManager)
-	{
-		m_pShaderManager->setIntValue(g_UseTextureName, false);
-		m_pShaderManager->setVec4Value(g_ColorValueName, currentColor);
-	}
-}
-
-/***********************************************************
- *  SetShaderTexture()
- *
- *  This method is used for setting the texture data
- *  associated with the passed in ID into the shader.
- ***********************************************************/
-void SceneManager::SetShaderTexture(
-	std::string textureTag)
-{
-	if (NULL != m_pShaderManager)
-	{
-		m_pShaderManager->setIntValue(g_UseTextureName, true);
-
-		int textureID = -1;
-		textureID = FindTextureSlot(textureTag);
-		m_pShaderManager->setSampler2DValue(g_TextureValueName, textureID);
-	}
-}
-
-/***********************************************************
- *  SetTextureUVScale()
- *
- *  This method is used for setting the texture UV scale
- *  values into the shader.
- ***********************************************************/
-void SceneManager::SetTextureUVScale(float u, float v)
-{
-	if (NULL != m_pShaderManager)
-	{
-		m_pShaderManager->setVec2Value("UVscale", glm::vec2(u, v));
-	}
-}
-
-/***********************************************************
- *  SetShaderMaterial()
- *
- *  This method is used for passing the material values
- *  into the shader.
- ***********************************************************/
-void SceneManager::SetShaderMaterial(
-	std::string materialTag)
-{
-	if (m_objectMaterials.size() > 0)
-	{
-		OBJECT_MATERIAL material;
-		bool bReturn = false;
-
-		bReturn = FindMaterial(materialTag, material);
-		if (bReturn == true)
-		{
-			m_pShaderManager->setVec3Value("material.ambientColor", material.ambientColor);
-			m_pShaderManager->setFloatValue("material.ambientStrength", material.ambientStrength);
-			m_pShaderManager->setVec3Value("material.diffuseColor", material.diffuseColor);
-			m_pShaderManager->setVec3Value("material.specularColor", material.specularColor);
-			m_pShaderManager->setFloatValue("material.shininess", material.shininess);
-		}
-	}
-}
-
-/**************************************************************/
-/*** STUDENTS CAN MODIFY the code in the methods BELOW for  ***/
-/*** preparing and rendering their own 3D replicated scenes.***/
-/*** Please refer to the code in the OpenGL sample project  ***/
-/*** for assistance.                                        ***/
-/**************************************************************/
-
-/********************************************************
- *  PrepareScene()
- *
- *  This method is used for preparing the 3D scene by loading
- *  the shapes, textures in memory to support the 3D scene 
- *  rendering
- ***********************************************************/
-
-void SceneManager::LoadTextures()
-{
-	bool bReturn = false;
-
-	// Plank texture (brown wood)
-	bReturn = CreateGLTexture("../../Utilities/textures/rusticwood.jpg", "tabletop");
-
-	// Cylinder texture (gold)
-	bReturn = CreateGLTexture("../../Utilities/textures/gold-seamless-texture.jpg", "legs");
-
-	bReturn = CreateGLTexture("../../Utilities/textures/stainedglass.jpg","torus");
-
-	bReturn = CreateGLTexture("../../Utilities/textures/abstract.jpg","centerpiece");
-
-	// Bind all loaded textures to texture slots
-	BindGLTextures();
-}
-
-
-void SceneManager::DefineObjectMaterials()
-{
-	OBJECT_MATERIAL woodMaterial;
-	woodMaterial.ambientColor = glm::vec3(0.4f, 0.3f, 0.1f);
-	woodMaterial.ambientStrength = 0.2f;
-	woodMaterial.diffuseColor = glm::vec3(0.3f, 0.2f, 0.1f);
-	woodMaterial.specularColor = glm::vec3(0.1f, 0.1f, 0.1f);
-	woodMaterial.shininess = 0.3;
-	woodMaterial.tag = "wood";
-
-	m_objectMaterials.push_back(woodMaterial);
-
-	OBJECT_MATERIAL rugMaterial;
-	rugMaterial.ambientColor = glm::vec3(0.6f, 0.2f, 0.2f);       
-	rugMaterial.ambientStrength = 0.3f;                           
-	rugMaterial.diffuseColor = glm::vec3(0.7f, 0.3f, 0.3f);       
-	rugMaterial.specularColor = glm::vec3(0.05f, 0.05f, 0.05f);   
-	rugMaterial.shininess = 0.1f;                                 
-	rugMaterial.tag = "rug";
-
-	m_objectMaterials.push_back(rugMaterial);
-
-	// Floor material
-	OBJECT_MATERIAL floorMaterial;
-	floorMaterial.ambientColor = glm::vec3(0.2f, 0.2f, 0.2f);
-	floorMaterial.ambientStrength = 0.3f;
-	floorMaterial.diffuseColor = glm::vec3(0.4f, 0.4f, 0.4f);
-	floorMaterial.specularColor = glm::vec3(0.1f, 0.1f, 0.1f);
-	floorMaterial.shininess = 0.2f;
-	floorMaterial.tag = "floor";
-
-	m_objectMaterials.push_back(floorMaterial);
-
-	OBJECT_MATERIAL metalMaterial;
-	metalMaterial.ambientColor = glm::vec3(0.3f, 0.1f, 0.1f);
-	metalMaterial.ambientStrength = 0.4f;
-	metalMaterial.diffuseColor = glm::vec3(0.8f, 0.3f, 0.1f);
-	metalMaterial.specularColor = glm::vec3(0.9f, 0.9f, 0.9f);
-	metalMaterial.shininess = 1.0f;
-	metalMaterial.tag = "metal";
-	m_objectMaterials.push_back(metalMaterial);
-
-	OBJECT_MATERIAL glassMaterial;
-	glassMaterial.ambientColor = glm::vec3(0.3f, 0.4f, 0.6f);
-	glassMaterial.ambientStrength = 0.1f;
-	glassMaterial.diffuseColor = glm::vec3(0.5f, 0.8f, 1.0f);
-	glassMaterial.specularColor = glm::vec3(1.0f, 1.0f, 1.0f);
-	glassMaterial.shininess = 1.5f;
-	glassMaterial.tag = "glass";
-
-	m_objectMaterials.push_back(glassMaterial);
-
-
-	OBJECT_MATERIAL plateMaterial;
-	plateMaterial.ambientColor = glm::vec3(0.8f, 0.8f, 0.8f); 
-	plateMaterial.ambientStrength = 0.2f;
-	plateMaterial.diffuseColor = glm::vec3(0.9f, 0.9f, 0.9f); 
-	plateMaterial.specularColor = glm::vec3(0.9f, 0.9f, 0.9f);
-	plateMaterial.shininess = 0.8f; 
-	plateMaterial.tag = "plate";
-
-	m_objectMaterials.push_back(plateMaterial);
-
-
-}
-
-/***********************************************************
- *  SetupSceneLights()
- *
- *  This method is called to add and configure the light
- *  sources for the 3D scene.  There are up to 4 light sources.
- ***********************************************************/
-void SceneManager::SetupSceneLights()
-{
-	// Light 0 - Overhead Right (White)
-	m_pShaderManager->setVec3Value("lightSources[0].position", 3.0f, 14.0f, 0.0f);
-	m_pShaderManager->setVec3Value("lightSources[0].ambientColor", 0.01f, 0.01f, 0.01f);
-	m_pShaderManager->setVec3Value("lightSources[0].diffuseColor", 0.4f, 0.4f, 0.4f);  // White Light
-	m_pShaderManager->setVec3Value("lightSources[0].specularColor", 0.0f, 0.0f, 0.0f);
-	m_pShaderManager->setFloatValue("lightSources[0].focalStrength", 32.0f);
-	m_pShaderManager->setFloatValue("lightSources[0].specularIntensity", 0.05f);
-
-	// Light 1 - Overhead Left (White)
-	m_pShaderManager->setVec3Value("lightSources[1].position", -3.0f, 14.0f, 0.0f);
-	m_pShaderManager->setVec3Value("lightSources[1].ambientColor", 0.01f, 0.01f, 0.01f);
-	m_pShaderManager->setVec3Value("lightSources[1].diffuseColor", 0.4f, 0.4f, 0.4f);  // White Light
-	m_pShaderManager->setVec3Value("lightSources[1].specularColor", 0.0f, 0.0f, 0.0f);
-	m_pShaderManager->setFloatValue("lightSources[1].focalStrength", 32.0f);
-	m_pShaderManager->setFloatValue("lightSources[1].specularIntensity", 0.05f);
-
-	// Light 2 - Front Fill (Blue)
-	m_pShaderManager->setVec3Value("lightSources[2].position", 0.6f, 5.0f, 6.0f);
-	m_pShaderManager->setVec3Value("lightSources[2].ambientColor", 0.01f, 0.01f, 0.01f);
-	m_pShaderManager->setVec3Value("lightSources[2].diffuseColor", 0.3f, 0.3f, 1.0f);  // Blue Light
-	m_pShaderManager->setVec3Value("lightSources[2].specularColor", 0.3f, 0.3f, 1.0f);
-	m_pShaderManager->setFloatValue("lightSources[2].focalStrength", 12.0f);
-	m_pShaderManager->setFloatValue("lightSources[2].specularIntensity", 0.5f);
-
-	// Light 3 - Front Fill (Red)
-	m_pShaderManager->setVec3Value("lightSources[3].position", 0.6f, 5.0f, -6.0f);
-	m_pShaderManager->setVec3Value("lightSources[3].ambientColor", 0.01f, 0.01f, 0.01f);
-	m_pShaderManager->setVec3Value("lightSources[3].diffuseColor", 1.0f, 0.3f, 0.3f);  // Red Light
-	m_pShaderManager->setVec3Value("lightSources[3].specularColor", 1.0f, 0.3f, 0.3f);
-	m_pShaderManager->setFloatValue("lightSources[3].focalStrength", 12.0f);
-	m_pShaderManager->setFloatValue("lightSources[3].specularIntensity", 0.5f);
-
-	// Tell the shader we want to use lighting
-	m_pShaderManager->setBoolValue("bUseLighting", true);
-}
-
-void SceneManager::PrepareScene()
-{
-	// Load all meshes and textures into memory
-	m_basicMeshes->LoadBoxMesh();
-	m_basicMeshes->LoadTaperedCylinderMesh();
-	m_basicMeshes->LoadPlaneMesh();
-
-	// Load all textures
-	LoadTextures();
-	DefineObjectMaterials();
-	SetupSceneLights();
-}
-
-/***********************************************************
- *  RenderScene()
- *
- *  This method is used for rendering the 3D scene by 
- *  transforming and drawing the basic 3D shapes
- ***********************************************************/
-void SceneManager::RenderScene()
-{
-	// declare the variables for the transformations
-	glm::vec3 scaleXYZ;
-	float XrotationDegrees = 0.0f;
-	float YrotationDegrees = 0.0f;
-	float ZrotationDegrees = 0.0f;
-	glm::vec3 positionXYZ;
-
-	/*** Set needed transformations before drawing the basic mesh.  ***/
-	/*** This same ordering of code should be used for transforming ***/
-	/*** and drawing all the basic 3D shapes.						***/
-	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(20.0f, 1.0f, 10.0f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(0.0f, 1.0f, 0.0f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderColor(1, 1, 1, 1);
-	SetShaderMaterial("floor");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawPlaneMesh();
-
-	/******************************************************************/
-	// Sphere object (e.g., glass ball)
-	scaleXYZ = glm::vec3(1.0f);
-	positionXYZ = glm::vec3(2.5f, 5.2f, -1.5f);
-	SetTransformations(scaleXYZ, 0.0f, 0.0f, 0.0f, positionXYZ);
-	SetShaderMaterial("glass");
-	SetShaderColor(0.5f, 0.8f, 1.0f, 0.7f); // transparent blue
-	m_basicMeshes->DrawSphereMesh();
-
-	/****************************************************************/
-
-	// Draw the tabletop (box mesh with texture)
-	scaleXYZ = glm::vec3(10.0f, 0.5f, 6.0f);
-	positionXYZ = glm::vec3(0.0f, 4.5f, 0.0f);
-	SetTransformations(scaleXYZ, 0.0f, 0.0f, 0.0f, positionXYZ);
-	SetShaderMaterial("wood");
-	SetShaderTexture("tabletop"); // Use the 'tabletop' texture
-	SetTextureUVScale(1.0f, 1.0f); // Texture scaling
-	m_basicMeshes->DrawBoxMesh();
-
-	// Draw placemats on the table (4)
-	scaleXYZ = glm::vec3(1.0f, 0.05f, 1.0f); 
-	for (float x = -3.0f; x <= 3.0f; x += 6.0f) { 
-		for (float z = -2.0f; z <= 2.0f; z += 4.0f) { 
-			positionXYZ = glm::vec3(x, 4.8f, z); 
-			SetTransformations(scaleXYZ, 0.0f, 0.0f, 0.0f, positionXYZ); 
-			SetShaderMaterial("plate"); 
-			SetShaderTexture("rug");
-			SetTextureUVScale(1.0f, 1.0f); 
-			m_basicMeshes->DrawPlaneMesh(); 
-		}
-	}
-
-	// Draw glass cups on the table (4)
-	scaleXYZ = glm::vec3(0.3f, 0.5f, 0.3f);  
-	for (float x = -3.0f; x <= 3.0f; x += 6.0f) {  
-		for (float z = -2.0f; z <= 2.0f; z += 4.0f) {  
-			positionXYZ = glm::vec3(x, 5.3f, z); 
-
-			// Apply transformations
-			SetTransformations(scaleXYZ, 90.0f, 90.0f, 90.0f, positionXYZ); 
-
-			// Set shader material for glass (make sure "glass" material is defined)
-			SetShaderMaterial("glass");
-
-			// Draw the cup using a tapered cylinder mesh
-			m_basicMeshes->DrawTaperedCylinderMesh();
-		}
-	}
-
-	// Draw torus object on the table
-	scaleXYZ = glm::vec3(1.0f, 0.2f, 1.0f);  
-	positionXYZ = glm::vec3(0.0f, 15.0f, 0.0f); 
-	SetTransformations(scaleXYZ, 0.0f, 0.0f, 0.0f, positionXYZ);
-	SetShaderTexture("torus");  
-	SetShaderMaterial("rug");
-	SetTextureUVScale(1.0f, 1.0f);  
-	m_basicMeshes->DrawTorusMesh();
-
-
-	/****************************************************************/
-	// Draw the rug just above the floor
-	scaleXYZ = glm::vec3(12.0f, 1.0f, 6.0f);
-	positionXYZ = glm::vec3(0.0f, 1.01f, 0.0f);
-	SetTransformations(scaleXYZ, 0.0f, 0.0f, 0.0f, positionXYZ);
-	SetShaderTexture("rug");
-	SetShaderMaterial("rug");
-	SetTextureUVScale(1.0f, 1.0f);
-	m_basicMeshes->DrawPlaneMesh();
-
-	// --- Centerpiece on the Table ---
-	scaleXYZ = glm::vec3(0.25f, 0.25f, 0.25f);  
-	positionXYZ = glm::vec3(0.0f, 6.0f, 0.0f);  
-	SetTransformations(scaleXYZ, 0.0f, 0.0f, 0.0f, positionXYZ);
-	SetShaderTexture("centerpiece");
-	SetShaderMaterial("glass");
-	SetTextureUVScale(1.0f, 1.0f);
-	m_basicMeshes->DrawSphereMesh();
-
-
-	// Draw table legs (4)
-	scaleXYZ = glm::vec3(0.5f, 3.0f, 0.5f);
-	for (float x = -4.5f; x <= 4.5f; x += 9.0f) {
-		for (float z = -2.5f; z <= 2.5f; z += 5.0f) {
-			positionXYZ = glm::vec3(x, 1.5f, z);
-			SetTransformations(scaleXYZ, 0.0f, 0.0f, 0.0f, positionXYZ);
-			SetShaderTexture("legs"); 
-			SetShaderMaterial("wood");
-			SetTextureUVScale(1.0f, 1.0f); 
-			m_basicMeshes->DrawTaperedCylinderMesh();
-		}
-	}
-
-}
+﻿///////////////////////////////////////////////////////////////////////////////
+// shadermanager.cpp
+// ============
+// manage the loading and rendering of 3D scenes
+//
+//  AUTHOR: Brian Battersby - SNHU Instructor / Computer Science
+//	Created for CS-330-Computational Graphics and Visualization, Nov. 1st, 2023
+///////////////////////////////////////////////////////////////////////////////
+
+#include "SceneManager.h"
+
+#ifndef STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#endif
+
+#include <glm/gtx/transform.hpp>
+#include <vector>
+#include <cstdint>
+
+// declaration of global variables
+namespace
+{
+	const char* g_ModelName = "model";
+	const char* g_ColorValueName = "objectColor";
+	const char* g_TextureValueName = "objectTexture";
+	const char* g_UseTextureName = "bUseTexture";
+	const char* g_UseLightingName = "bUseLighting";
+
+	// the basic meshes the render queue knows how to draw
+	enum SceneMesh
+	{
+		MESH_BOX,
+		MESH_PLANE,
+		MESH_SPHERE,
+		MESH_TAPERED_CYLINDER,
+		MESH_TORUS
+	};
+
+	// one recorded draw, with every piece of shader state it needs
+	struct DrawCommand
+	{
+		glm::mat4 model;
+		glm::vec4 color;
+		glm::vec2 uvScale;
+		bool useTexture;
+		int textureSlot;	// -1 when the tag was not loaded
+		int material;		// index into m_objectMaterials, -1 for none
+		int mesh;
+	};
+
+	struct SortEntry
+	{
+		uint64_t key;
+		uint32_t index;
+	};
+
+	struct RenderQueueStats
+	{
+		int draws = 0;
+		int textureChanges = 0;		// bUseTexture or sampler uploads
+		int colorChanges = 0;
+		int materialChanges = 0;
+		int uvScaleChanges = 0;
+		int meshChanges = 0;
+
+		int StateChanges() const
+		{
+			return textureChanges + colorChanges + materialChanges + uvScaleChanges + meshChanges;
+		}
+		bool operator==(const RenderQueueStats& other) const
+		{
+			return draws == other.draws && textureChanges == other.textureChanges &&
+				colorChanges == other.colorChanges && materialChanges == other.materialChanges &&
+				uvScaleChanges == other.uvScaleChanges && meshChanges == other.meshChanges;
+		}
+	};
+
+	// While recording, the Set...() methods update 'pending' instead of the
+	// shader, and each mesh draw stores a copy of it. The buffers are kept
+	// from frame to frame so recording does not allocate once warmed up.
+	struct RenderQueue
+	{
+		bool bEnabled = true;
+		bool bRecording = false;
+		DrawCommand pending = {};
+		std::vector<DrawCommand> commands;
+		std::vector<SortEntry> order;
+		std::vector<SortEntry> scratch;
+		RenderQueueStats lastSorted;
+		RenderQueueStats lastSource;
+	};
+
+	RenderQueue g_renderQueue;
+
+	/***********************************************************
+	 *  MakeDrawKey()
+	 *
+	 *  Packs the state a draw needs into a 64-bit sort key,
+	 *  most expensive change first:
+	 *  shader (8) | texture (8) | material (8) | mesh (8) | order (32)
+	 *  Translucent (flat color, alpha < 1) draws go after every
+	 *  opaque one and keep their recorded order so blending does
+	 *  not change.
+	 ***********************************************************/
+	uint64_t MakeDrawKey(const DrawCommand& command, uint32_t sequence)
+	{
+		if (!command.useTexture && command.color.a < 1.0f)
+		{
+			return (1ull << 63) | sequence;
+		}
+
+		// the scene is drawn with a single shader program
+		uint64_t shader = 0;
+		uint64_t texture = command.useTexture ? (uint64_t)(command.textureSlot + 2) : 0;
+		uint64_t material = (uint64_t)(command.material + 1);
+		uint64_t mesh = (uint64_t)command.mesh;
+
+		// the low 32 bits stay zero: the radix sort is stable, so
+		// equal keys already keep their recorded order
+		return (shader << 56) | (texture << 48) | (material << 40) | (mesh << 32);
+	}
+
+	/***********************************************************
+	 *  RadixSortDrawKeys()
+	 *
+	 *  Least-significant-byte radix sort over the 64-bit keys,
+	 *  eight passes of 256 buckets. A pass is skipped when every
+	 *  key has the same byte there, which leaves the two to four
+	 *  passes that actually separate the scene's states.
+	 ***********************************************************/
+	void RadixSortDrawKeys(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch)
+	{
+		if (entries.size() < 2)
+		{
+			return;
+		}
+
+		scratch.resize(entries.size());
+		for (int shift = 0; shift < 64; shift += 8)
+		{
+			size_t counts[256] = {};
+			for (const SortEntry& entry : entries)
+			{
+				counts[(entry.key >> shift) & 0xFF]++;
+			}
+			if (counts[(entries[0].key >> shift) & 0xFF] == entries.size())
+			{
+				continue;
+			}
+
+			// turn the counts into each bucket's starting position
+			size_t offset = 0;
+			for (size_t& count : counts)
+			{
+				size_t bucketSize = count;
+				count = offset;
+				offset += bucketSize;
+			}
+			for (const SortEntry& entry : entries)
+			{
+				scratch[counts[(entry.key >> shift) & 0xFF]++] = entry;
+			}
+			entries.swap(scratch);
+		}
+	}
+}
+
+/***********************************************************
+ *  SceneManager()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+SceneManager::SceneManager(ShaderManager* pShaderManager)
+{
+	m_pShaderManager = pShaderManager;
+	m_basicMeshes = new ShapeMeshes();
+
+	// initialize the texture collection
+	for (int i = 0; i < 16; i++)
+	{
+		m_textureIDs[i].tag = "/0";
+		m_textureIDs[i].ID = -1;
+	}
+	m_loadedTextures = 0;
+}
+
+/***********************************************************
+ *  ~SceneManager()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+SceneManager::~SceneManager()
+{
+	// clear the allocated memory
+	m_pShaderManager = NULL;
+	delete m_basicMeshes;
+	m_basicMeshes = NULL;
+	// destroy the created OpenGL textures
+	DestroyGLTextures();
+}
+
+/***********************************************************
+ *  CreateGLTexture()
+ *
+ *  This method is used for loading textures from image files,
+ *  configuring the texture mapping parameters in OpenGL,
+ *  generating the mipmaps, and loading the read texture into
+ *  the next available texture slot in memory.
+ ***********************************************************/
+bool SceneManager::CreateGLTexture(const char* filename, std::string tag)
+{
+	int width = 0;
+	int height = 0;
+	int colorChannels = 0;
+	GLuint textureID = 0;
+
+	// indicate to always flip images vertically when loaded
+	stbi_set_flip_vertically_on_load(true);
+
+	// try to parse the image data from the specified image file
+	unsigned char* image = stbi_load(
+		filename,
+		&width,
+		&height,
+		&colorChannels,
+		0);
+
+	// if the image was successfully read from the image file
+	if (image)
+	{
+		std::cout << "Successfully loaded image:" << filename << ", width:" << width << ", height:" << height << ", channels:" << colorChannels << std::endl;
+
+		glGenTextures(1, &textureID);
+		glBindTexture(GL_TEXTURE_2D, textureID);
+
+		// set the texture wrapping parameters
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		// set texture filtering parameters
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		// if the loaded image is in RGB format
+		if (colorChannels == 3)
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
+		// if the loaded image is in RGBA format - it supports transparency
+		else if (colorChannels == 4)
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
+		else
+		{
+			std::cout << "Not implemented to handle image with " << colorChannels << " channels" << std::endl;
+			return false;
+		}
+
+		// generate the texture mipmaps for mapping textures to lower resolutions
+		glGenerateMipmap(GL_TEXTURE_2D);
+
+		// free the image data from local memory
+		stbi_image_free(image);
+		glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+
+		// register the loaded texture and associate it with the special tag string
+		m_textureIDs[m_loadedTextures].ID = textureID;
+		m_textureIDs[m_loadedTextures].tag = tag;
+		m_loadedTextures++;
+
+		return true;
+	}
+
+	std::cout << "Could not load image:" << filename << std::endl;
+
+	// Error loading the image
+	return false;
+}
+
+/***********************************************************
+ *  BindGLTextures()
+ *
+ *  This method is used for binding the loaded textures to
+ *  OpenGL texture memory slots.  There are up to 16 slots.
+ ***********************************************************/
+void SceneManager::BindGLTextures()
+{
+	for (int i = 0; i < m_loadedTextures; i++)
+	{
+		// bind textures on corresponding texture units
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D, m_textureIDs[i].ID);
+	}
+}
+
+/***********************************************************
+ *  DestroyGLTextures()
+ *
+ *  This method is used for freeing the memory in all the
+ *  used texture memory slots.
+ ***********************************************************/
+void SceneManager::DestroyGLTextures()
+{
+	for (int i = 0; i < m_loadedTextures; i++)
+	{
+		glGenTextures(1, &m_textureIDs[i].ID);
+	}
+}
+
+/***********************************************************
+ *  FindTextureID()
+ *
+ *  This method is used for getting an ID for the previously
+ *  loaded texture bitmap associated with the passed in tag.
+ ***********************************************************/
+int SceneManager::FindTextureID(std::string tag)
+{
+	int textureID = -1;
+	int index = 0;
+	bool bFound = false;
+
+	while ((index < m_loadedTextures) && (bFound == false))
+	{
+		if (m_textureIDs[index].tag.compare(tag) == 0)
+		{
+			textureID = m_textureIDs[index].ID;
+			bFound = true;
+		}
+		else
+			index++;
+	}
+
+	return(textureID);
+}
+
+/***********************************************************
+ *  FindTextureSlot()
+ *
+ *  This method is used for getting a slot index for the previously
+ *  loaded texture bitmap associated with the passed in tag.
+ ***********************************************************/
+int SceneManager::FindTextureSlot(std::string tag)
+{
+	int textureSlot = -1;
+	int index = 0;
+	bool bFound = false;
+
+	while ((index < m_loadedTextures) && (bFound == false))
+	{
+		if (m_textureIDs[index].tag.compare(tag) == 0)
+		{
+			textureSlot = index;
+			bFound = true;
+		}
+		else
+			index++;
+	}
+
+	return(textureSlot);
+}
+
+/***********************************************************
+ *  FindMaterial()
+ *
+ *  This method is used for getting a material from the previously
+ *  defined materials list that is associated with the passed in tag.
+ ***********************************************************/
+bool SceneManager::FindMaterial(std::string tag, OBJECT_MATERIAL& material)
+{
+	if (m_objectMaterials.size() == 0)
+	{
+		return(false);
+	}
+
+	int index = 0;
+	bool bFound = false;
+	while ((index < m_objectMaterials.size()) && (bFound == false))
+	{
+		if (m_objectMaterials[index].tag.compare(tag) == 0)
+		{
+			bFound = true;
+			material.ambientColor = m_objectMaterials[index].ambientColor;
+			material.ambientStrength = m_objectMaterials[index].ambientStrength;
+			material.diffuseColor = m_objectMaterials[index].diffuseColor;
+			material.specularColor = m_objectMaterials[index].specularColor;
+			material.shininess = m_objectMaterials[index].shininess;
+		}
+		else
+		{
+			index++;
+		}
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  SetTransformations()
+ *
+ *  This method is used for setting the transform buffer
+ *  using the passed in transformation values.
+ ***********************************************************/
+void SceneManager::SetTransformations(
+	glm::vec3 scaleXYZ,
+	float XrotationDegrees,
+	float YrotationDegrees,
+	float ZrotationDegrees,
+	glm::vec3 positionXYZ)
+{
+	// variables for this method
+	glm::mat4 modelView;
+	glm::mat4 scale;
+	glm::mat4 rotationX;
+	glm::mat4 rotationY;
+	glm::mat4 rotationZ;
+	glm::mat4 translation;
+
+	// set the scale value in the transform buffer
+	scale = glm::scale(scaleXYZ);
+	// set the rotation values in the transform buffer
+	rotationX = glm::rotate(glm::radians(XrotationDegrees), glm::vec3(1.0f, 0.0f, 0.0f));
+	rotationY = glm::rotate(glm::radians(YrotationDegrees), glm::vec3(0.0f, 1.0f, 0.0f));
+	rotationZ = glm::rotate(glm::radians(ZrotationDegrees), glm::vec3(0.0f, 0.0f, 1.0f));
+	// set the translation value in the transform buffer
+	translation = glm::translate(positionXYZ);
+
+	modelView = translation * rotationX * rotationY * rotationZ * scale;
+
+	if (g_renderQueue.bRecording)
+	{
+		g_renderQueue.pending.model = modelView;
+	}
+	else if (NULL != m_pShaderManager)
+	{
+		m_pShaderManager->setMat4Value(g_ModelName, modelView);
+	}
+}
+
+/***********************************************************
+ *  SetShaderColor()
+ *
+ *  This method is used for setting the passed in color
+ *  into the shader for the next draw command
+ ***********************************************************/
+void SceneManager::SetShaderColor(
+	float redColorValue,
+	float greenColorValue,
+	float blueColorValue,
+	float alphaValue)
+{
+	// variables for this method
+	glm::vec4 currentColor;
+
+	currentColor.r = redColorValue;
+	currentColor.g = greenColorValue;
+	currentColor.b = blueColorValue;
+	currentColor.a = alphaValue;
+
+	if (g_renderQueue.bRecording)
+	{
+		g_renderQueue.pending.useTexture = false;
+		g_renderQueue.pending.color = currentColor;
+	}
+	else if (NULL != m_pShaderManager)
+	{
+		m_pShaderManager->setIntValue(g_UseTextureName, false);
+		m_pShaderManager->setVec4Value(g_ColorValueName, currentColor);
+	}
+}
+
+/***********************************************************
+ *  SetShaderTexture()
+ *
+ *  This method is used for setting the texture data
+ *  associated with the passed in ID into the shader.
+ ***********************************************************/
+void SceneManager::SetShaderTexture(
+	std::string textureTag)
+{
+	if (g_renderQueue.bRecording)
+	{
+		g_renderQueue.pending.useTexture = true;
+		g_renderQueue.pending.textureSlot = FindTextureSlot(textureTag);
+	}
+	else if (NULL != m_pShaderManager)
+	{
+		m_pShaderManager->setIntValue(g_UseTextureName, true);
+
+		int textureID = -1;
+		textureID = FindTextureSlot(textureTag);
+		m_pShaderManager->setSampler2DValue(g_TextureValueName, textureID);
+	}
+}
+
+/***********************************************************
+ *  SetTextureUVScale()
+ *
+ *  This method is used for setting the texture UV scale
+ *  values into the shader.
+ ***********************************************************/
+void SceneManager::SetTextureUVScale(float u, float v)
+{
+	if (g_renderQueue.bRecording)
+	{
+		g_renderQueue.pending.uvScale = glm::vec2(u, v);
+	}
+	else if (NULL != m_pShaderManager)
+	{
+		m_pShaderManager->setVec2Value("UVscale", glm::vec2(u, v));
+	}
+}
+
+/***********************************************************
+ *  SetShaderMaterial()
+ *
+ *  This method is used for passing the material values
+ *  into the shader.
+ ***********************************************************/
+void SceneManager::SetShaderMaterial(
+	std::string materialTag)
+{
+	if (g_renderQueue.bRecording)
+	{
+		// an unknown tag leaves the previous material in place, as below
+		for (int index = 0; index < (int)m_objectMaterials.size(); index++)
+		{
+			if (m_objectMaterials[index].tag.compare(materialTag) == 0)
+			{
+				g_renderQueue.pending.material = index;
+				break;
+			}
+		}
+	}
+	else if (m_objectMaterials.size() > 0)
+	{
+		OBJECT_MATERIAL material;
+		bool bReturn = false;
+
+		bReturn = FindMaterial(materialTag, material);
+		if (bReturn == true)
+		{
+			m_pShaderManager->setVec3Value("material.ambientColor", material.ambientColor);
+			m_pShaderManager->setFloatValue("material.ambientStrength", material.ambientStrength);
+			m_pShaderManager->setVec3Value("material.diffuseColor", material.diffuseColor);
+			m_pShaderManager->setVec3Value("material.specularColor", material.specularColor);
+			m_pShaderManager->setFloatValue("material.shininess", material.shininess);
+		}
+	}
+}
+
+// render queue helpers used by the methods below
+namespace
+{
+	/***********************************************************
+	 *  DrawBasicMesh()
+	 *
+	 *  Issues the ShapeMeshes draw call for one SceneMesh value.
+	 ***********************************************************/
+	void DrawBasicMesh(ShapeMeshes* pMeshes, int mesh)
+	{
+		switch (mesh)
+		{
+		case MESH_BOX:
+			pMeshes->DrawBoxMesh();
+			break;
+		case MESH_PLANE:
+			pMeshes->DrawPlaneMesh();
+			break;
+		case MESH_SPHERE:
+			pMeshes->DrawSphereMesh();
+			break;
+		case MESH_TAPERED_CYLINDER:
+			pMeshes->DrawTaperedCylinderMesh();
+			break;
+		case MESH_TORUS:
+			pMeshes->DrawTorusMesh();
+			break;
+		}
+	}
+
+	/***********************************************************
+	 *  SubmitDrawCommands()
+	 *
+	 *  Walks the recorded commands in the passed in order,
+	 *  uploading only the state that differs from the previous
+	 *  draw. With a NULL shader manager it only counts the state
+	 *  changes that order would need.
+	 ***********************************************************/
+	RenderQueueStats SubmitDrawCommands(
+		const std::vector<SortEntry>& order,
+		ShaderManager* pShaderManager,
+		ShapeMeshes* pMeshes,
+		const std::vector<OBJECT_MATERIAL>& materials)
+	{
+		bool bSubmit = (NULL != pShaderManager);
+		RenderQueueStats stats;
+		const DrawCommand* last = NULL;
+
+		for (const SortEntry& entry : order)
+		{
+			const DrawCommand& command = g_renderQueue.commands[entry.index];
+			bool bFirst = (last == NULL);
+
+			if (bFirst || command.useTexture != last->useTexture ||
+				(command.useTexture && command.textureSlot != last->textureSlot))
+			{
+				stats.textureChanges++;
+				if (bSubmit)
+				{
+					pShaderManager->setIntValue(g_UseTextureName, command.useTexture);
+					if (command.useTexture)
+					{
+						pShaderManager->setSampler2DValue(g_TextureValueName, command.textureSlot);
+					}
+				}
+			}
+			if (!command.useTexture && (bFirst || last->useTexture || command.color != last->color))
+			{
+				stats.colorChanges++;
+				if (bSubmit)
+				{
+					pShaderManager->setVec4Value(g_ColorValueName, command.color);
+				}
+			}
+			if (command.material >= 0 && (bFirst || command.material != last->material))
+			{
+				stats.materialChanges++;
+				if (bSubmit)
+				{
+					const OBJECT_MATERIAL& material = materials[command.material];
+					pShaderManager->setVec3Value("material.ambientColor", material.ambientColor);
+					pShaderManager->setFloatValue("material.ambientStrength", material.ambientStrength);
+					pShaderManager->setVec3Value("material.diffuseColor", material.diffuseColor);
+					pShaderManager->setVec3Value("material.specularColor", material.specularColor);
+					pShaderManager->setFloatValue("material.shininess", material.shininess);
+				}
+			}
+			if (bFirst || command.uvScale != last->uvScale)
+			{
+				stats.uvScaleChanges++;
+				if (bSubmit)
+				{
+					pShaderManager->setVec2Value("UVscale", command.uvScale);
+				}
+			}
+			if (bFirst || command.mesh != last->mesh)
+			{
+				stats.meshChanges++;
+			}
+
+			// the model matrix is per draw, so it is always uploaded
+			stats.draws++;
+			if (bSubmit)
+			{
+				pShaderManager->setMat4Value(g_ModelName, command.model);
+				DrawBasicMesh(pMeshes, command.mesh);
+			}
+			last = &command;
+		}
+
+		return(stats);
+	}
+}
+
+/***********************************************************
+ *  SetRenderQueueMode()
+ *
+ *  This method is used for switching RenderScene() between
+ *  drawing in source order and recording into the render
+ *  queue, which sorts the draws by state before submitting.
+ ***********************************************************/
+void SceneManager::SetRenderQueueMode(bool bEnabled)
+{
+	g_renderQueue.bEnabled = bEnabled;
+}
+
+/***********************************************************
+ *  BeginRenderQueue()
+ *
+ *  This method is used for starting a frame of recorded
+ *  draw commands when the render queue mode is on.
+ ***********************************************************/
+void SceneManager::BeginRenderQueue()
+{
+	if (!g_renderQueue.bEnabled)
+	{
+		return;
+	}
+
+	g_renderQueue.commands.clear();
+	g_renderQueue.pending = DrawCommand();
+	g_renderQueue.pending.model = glm::mat4(1.0f);
+	g_renderQueue.pending.color = glm::vec4(1.0f);
+	g_renderQueue.pending.uvScale = glm::vec2(1.0f, 1.0f);
+	g_renderQueue.pending.textureSlot = -1;
+	g_renderQueue.pending.material = -1;
+	g_renderQueue.bRecording = true;
+}
+
+/***********************************************************
+ *  DrawSceneMesh()
+ *
+ *  This method is used for drawing one of the basic meshes,
+ *  or for recording the draw with the current shader state
+ *  when the render queue is recording.
+ ***********************************************************/
+void SceneManager::DrawSceneMesh(int mesh)
+{
+	if (g_renderQueue.bRecording)
+	{
+		g_renderQueue.pending.mesh = mesh;
+		g_renderQueue.commands.push_back(g_renderQueue.pending);
+		return;
+	}
+
+	DrawBasicMesh(m_basicMeshes, mesh);
+}
+
+/***********************************************************
+ *  SubmitRenderQueue()
+ *
+ *  This method is used for ending the recorded frame: the
+ *  commands are sorted by state with a radix sort, drawn,
+ *  and the frame's draw and state change counts are printed
+ *  whenever they differ from the previous frame.
+ ***********************************************************/
+void SceneManager::SubmitRenderQueue()
+{
+	if (!g_renderQueue.bRecording)
+	{
+		return;
+	}
+	g_renderQueue.bRecording = false;
+	if (NULL == m_pShaderManager)
+	{
+		return;
+	}
+
+	// recorded order first, to count what drawing unsorted would cost
+	std::vector<SortEntry>& order = g_renderQueue.order;
+	order.clear();
+	for (uint32_t i = 0; i < (uint32_t)g_renderQueue.commands.size(); i++)
+	{
+		order.push_back({ MakeDrawKey(g_renderQueue.commands[i], i), i });
+	}
+	RenderQueueStats source = SubmitDrawCommands(order, NULL, m_basicMeshes, m_objectMaterials);
+
+	RadixSortDrawKeys(order, g_renderQueue.scratch);
+	RenderQueueStats sorted = SubmitDrawCommands(order, m_pShaderManager, m_basicMeshes, m_objectMaterials);
+
+	if (!(sorted == g_renderQueue.lastSorted) || !(source == g_renderQueue.lastSource))
+	{
+		std::cout << "Render queue: " << sorted.draws << " draws, " << sorted.StateChanges()
+			<< " state changes (" << sorted.textureChanges << " texture, " << sorted.colorChanges
+			<< " color, " << sorted.materialChanges << " material, " << sorted.uvScaleChanges
+			<< " UV scale, " << sorted.meshChanges << " mesh); source order needs "
+			<< source.StateChanges() << std::endl;
+		g_renderQueue.lastSorted = sorted;
+		g_renderQueue.lastSource = source;
+	}
+}
+
+/**************************************************************/
+/*** STUDENTS CAN MODIFY the code in the methods BELOW for  ***/
+/*** preparing and rendering their own 3D replicated scenes.***/
+/*** Please refer to the code in the OpenGL sample project  ***/
+/*** for assistance.                                        ***/
+/**************************************************************/
+
+/********************************************************
+ *  PrepareScene()
+ *
+ *  This method is used for preparing the 3D scene by loading
+ *  the shapes, textures in memory to support the 3D scene 
+ *  rendering
+ ***********************************************************/
+
+void SceneManager::LoadTextures()
+{
+	bool bReturn = false;
+
+	// Plank texture (brown wood)
+	bReturn = CreateGLTexture("../../Utilities/textures/rusticwood.jpg", "tabletop");
+
+	// Cylinder texture (gold)
+	bReturn = CreateGLTexture("../../Utilities/textures/gold-seamless-texture.jpg", "legs");
+
+	bReturn = CreateGLTexture("../../Utilities/textures/stainedglass.jpg","torus");
+
+	bReturn = CreateGLTexture("../../Utilities/textures/abstract.jpg","centerpiece");
+
+	// Bind all loaded textures to texture slots
+	BindGLTextures();
+}
+
+
+void SceneManager::DefineObjectMaterials()
+{
+	OBJECT_MATERIAL woodMaterial;
+	woodMaterial.ambientColor = glm::vec3(0.4f, 0.3f, 0.1f);
+	woodMaterial.ambientStrength = 0.2f;
+	woodMaterial.diffuseColor = glm::vec3(0.3f, 0.2f, 0.1f);
+	woodMaterial.specularColor = glm::vec3(0.1f, 0.1f, 0.1f);
+	woodMaterial.shininess = 0.3;
+	woodMaterial.tag = "wood";
+
+	m_objectMaterials.push_back(woodMaterial);
+
+	OBJECT_MATERIAL rugMaterial;
+	rugMaterial.ambientColor = glm::vec3(0.6f, 0.2f, 0.2f);       
+	rugMaterial.ambientStrength = 0.3f;                           
+	rugMaterial.diffuseColor = glm::vec3(0.7f, 0.3f, 0.3f);       
+	rugMaterial.specularColor = glm::vec3(0.05f, 0.05f, 0.05f);   
+	rugMaterial.shininess = 0.1f;                                 
+	rugMaterial.tag = "rug";
+
+	m_objectMaterials.push_back(rugMaterial);
+
+	// Floor material
+	OBJECT_MATERIAL floorMaterial;
+	floorMaterial.ambientColor = glm::vec3(0.2f, 0.2f, 0.2f);
+	floorMaterial.ambientStrength = 0.3f;
+	floorMaterial.diffuseColor = glm::vec3(0.4f, 0.4f, 0.4f);
+	floorMaterial.specularColor = glm::vec3(0.1f, 0.1f, 0.1f);
+	floorMaterial.shininess = 0.2f;
+	floorMaterial.tag = "floor";
+
+	m_objectMaterials.push_back(floorMaterial);
+
+	OBJECT_MATERIAL metalMaterial;
+	metalMaterial.ambientColor = glm::vec3(0.3f, 0.1f, 0.1f);
+	metalMaterial.ambientStrength = 0.4f;
+	metalMaterial.diffuseColor = glm::vec3(0.8f, 0.3f, 0.1f);
+	metalMaterial.specularColor = glm::vec3(0.9f, 0.9f, 0.9f);
+	metalMaterial.shininess = 1.0f;
+	metalMaterial.tag = "metal";
+	m_objectMaterials.push_back(metalMaterial);
+
+	OBJECT_MATERIAL glassMaterial;
+	glassMaterial.ambientColor = glm::vec3(0.3f, 0.4f, 0.6f);
+	glassMaterial.ambientStrength = 0.1f;
+	glassMaterial.diffuseColor = glm::vec3(0.5f, 0.8f, 1.0f);
+	glassMaterial.specularColor = glm::vec3(1.0f, 1.0f, 1.0f);
+	glassMaterial.shininess = 1.5f;
+	glassMaterial.tag = "glass";
+
+	m_objectMaterials.push_back(glassMaterial);
+
+
+	OBJECT_MATERIAL plateMaterial;
+	plateMaterial.ambientColor = glm::vec3(0.8f, 0.8f, 0.8f); 
+	plateMaterial.ambientStrength = 0.2f;
+	plateMaterial.diffuseColor = glm::vec3(0.9f, 0.9f, 0.9f); 
+	plateMaterial.specularColor = glm::vec3(0.9f, 0.9f, 0.9f);
+	plateMaterial.shininess = 0.8f; 
+	plateMaterial.tag = "plate";
+
+	m_objectMaterials.push_back(plateMaterial);
+
+
+}
+
+/***********************************************************
+ *  SetupSceneLights()
+ *
+ *  This method is called to add and configure the light
+ *  sources for the 3D scene.  There are up to 4 light sources.
+ ***********************************************************/
+void SceneManager::SetupSceneLights()
+{
+	// Light 0 - Overhead Right (White)
+	m_pShaderManager->setVec3Value("lightSources[0].position", 3.0f, 14.0f, 0.0f);
+	m_pShaderManager->setVec3Value("lightSources[0].ambientColor", 0.01f, 0.01f, 0.01f);
+	m_pShaderManager->setVec3Value("lightSources[0].diffuseColor", 0.4f, 0.4f, 0.4f);  // White Light
+	m_pShaderManager->setVec3Value("lightSources[0].specularColor", 0.0f, 0.0f, 0.0f);
+	m_pShaderManager->setFloatValue("lightSources[0].focalStrength", 32.0f);
+	m_pShaderManager->setFloatValue("lightSources[0].specularIntensity", 0.05f);
+
+	// Light 1 - Overhead Left (White)
+	m_pShaderManager->setVec3Value("lightSources[1].position", -3.0f, 14.0f, 0.0f);
+	m_pShaderManager->setVec3Value("lightSources[1].ambientColor", 0.01f, 0.01f, 0.01f);
+	m_pShaderManager->setVec3Value("lightSources[1].diffuseColor", 0.4f, 0.4f, 0.4f);  // White Light
+	m_pShaderManager->setVec3Value("lightSources[1].specularColor", 0.0f, 0.0f, 0.0f);
+	m_pShaderManager->setFloatValue("lightSources[1].focalStrength", 32.0f);
+	m_pShaderManager->setFloatValue("lightSources[1].specularIntensity", 0.05f);
+
+	// Light 2 - Front Fill (Blue)
+	m_pShaderManager->setVec3Value("lightSources[2].position", 0.6f, 5.0f, 6.0f);
+	m_pShaderManager->setVec3Value("lightSources[2].ambientColor", 0.01f, 0.01f, 0.01f);
+	m_pShaderManager->setVec3Value("lightSources[2].diffuseColor", 0.3f, 0.3f, 1.0f);  // Blue Light
+	m_pShaderManager->setVec3Value("lightSources[2].specularColor", 0.3f, 0.3f, 1.0f);
+	m_pShaderManager->setFloatValue("lightSources[2].focalStrength", 12.0f);
+	m_pShaderManager->setFloatValue("lightSources[2].specularIntensity", 0.5f);
+
+	// Light 3 - Front Fill (Red)
+	m_pShaderManager->setVec3Value("lightSources[3].position", 0.6f, 5.0f, -6.0f);
+	m_pShaderManager->setVec3Value("lightSources[3].ambientColor", 0.01f, 0.01f, 0.01f);
+	m_pShaderManager->setVec3Value("lightSources[3].diffuseColor", 1.0f, 0.3f, 0.3f);  // Red Light
+	m_pShaderManager->setVec3Value("lightSources[3].specularColor", 1.0f, 0.3f, 0.3f);
+	m_pShaderManager->setFloatValue("lightSources[3].focalStrength", 12.0f);
+	m_pShaderManager->setFloatValue("lightSources[3].specularIntensity", 0.5f);
+
+	// Tell the shader we want to use lighting
+	m_pShaderManager->setBoolValue("bUseLighting", true);
+}
+
+void SceneManager::PrepareScene()
+{
+	// Load all meshes and textures into memory
+	m_basicMeshes->LoadBoxMesh();
+	m_basicMeshes->LoadTaperedCylinderMesh();
+	m_basicMeshes->LoadPlaneMesh();
+
+	// Load all textures
+	LoadTextures();
+	DefineObjectMaterials();
+	SetupSceneLights();
+}
+
+/***********************************************************
+ *  RenderScene()
+ *
+ *  This method is used for rendering the 3D scene by 
+ *  transforming and drawing the basic 3D shapes
+ ***********************************************************/
+void SceneManager::RenderScene()
+{
+	// declare the variables for the transformations
+	glm::vec3 scaleXYZ;
+	float XrotationDegrees = 0.0f;
+	float YrotationDegrees = 0.0f;
+	float ZrotationDegrees = 0.0f;
+	glm::vec3 positionXYZ;
+
+	// record the draws below and submit them sorted by state
+	BeginRenderQueue();
+
+	/*** Set needed transformations before drawing the basic mesh.  ***/
+	/*** This same ordering of code should be used for transforming ***/
+	/*** and drawing all the basic 3D shapes.						***/
+	/******************************************************************/
+	// set the XYZ scale for the mesh
+	scaleXYZ = glm::vec3(20.0f, 1.0f, 10.0f);
+
+	// set the XYZ rotation for the mesh
+	XrotationDegrees = 0.0f;
+	YrotationDegrees = 0.0f;
+	ZrotationDegrees = 0.0f;
+
+	// set the XYZ position for the mesh
+	positionXYZ = glm::vec3(0.0f, 1.0f, 0.0f);
+
+	// set the transformations into memory to be used on the drawn meshes
+	SetTransformations(
+		scaleXYZ,
+		XrotationDegrees,
+		YrotationDegrees,
+		ZrotationDegrees,
+		positionXYZ);
+
+	SetShaderColor(1, 1, 1, 1);
+	SetShaderMaterial("floor");
+
+	// draw the mesh with transformation values
+	DrawSceneMesh(MESH_PLANE);
+
+	/******************************************************************/
+	// Sphere object (e.g., glass ball)
+	scaleXYZ = glm::vec3(1.0f);
+	positionXYZ = glm::vec3(2.5f, 5.2f, -1.5f);
+	SetTransformations(scaleXYZ, 0.0f, 0.0f, 0.0f, positionXYZ);
+	SetShaderMaterial("glass");
+	SetShaderColor(0.5f, 0.8f, 1.0f, 0.7f); // transparent blue
+	DrawSceneMesh(MESH_SPHERE);
+
+	/****************************************************************/
+
+	// Draw the tabletop (box mesh with texture)
+	scaleXYZ = glm::vec3(10.0f, 0.5f, 6.0f);
+	positionXYZ = glm::vec3(0.0f, 4.5f, 0.0f);
+	SetTransformations(scaleXYZ, 0.0f, 0.0f, 0.0f, positionXYZ);
+	SetShaderMaterial("wood");
+	SetShaderTexture("tabletop"); // Use the 'tabletop' texture
+	SetTextureUVScale(1.0f, 1.0f); // Texture scaling
+	DrawSceneMesh(MESH_BOX);
+
+	// Draw placemats on the table (4)
+	scaleXYZ = glm::vec3(1.0f, 0.05f, 1.0f); 
+	for (float x = -3.0f; x <= 3.0f; x += 6.0f) { 
+		for (float z = -2.0f; z <= 2.0f; z += 4.0f) { 
+			positionXYZ = glm::vec3(x, 4.8f, z); 
+			SetTransformations(scaleXYZ, 0.0f, 0.0f, 0.0f, positionXYZ); 
+			SetShaderMaterial("plate"); 
+			SetShaderTexture("rug");
+			SetTextureUVScale(1.0f, 1.0f); 
+			DrawSceneMesh(MESH_PLANE); 
+		}
+	}
+
+	// Draw glass cups on the table (4)
+	scaleXYZ = glm::vec3(0.3f, 0.5f, 0.3f);  
+	for (float x = -3.0f; x <= 3.0f; x += 6.0f) {  
+		for (float z = -2.0f; z <= 2.0f; z += 4.0f) {  
+			positionXYZ = glm::vec3(x, 5.3f, z); 
+
+			// Apply transformations
+			SetTransformations(scaleXYZ, 90.0f, 90.0f, 90.0f, positionXYZ); 
+
+			// Set shader material for glass (make sure "glass" material is defined)
+			SetShaderMaterial("glass");
+
+			// Draw the cup using a tapered cylinder mesh
+			DrawSceneMesh(MESH_TAPERED_CYLINDER);
+		}
+	}
+
+	// Draw torus object on the table
+	scaleXYZ = glm::vec3(1.0f, 0.2f, 1.0f);  
+	positionXYZ = glm::vec3(0.0f, 15.0f, 0.0f); 
+	SetTransformations(scaleXYZ, 0.0f, 0.0f, 0.0f, positionXYZ);
+	SetShaderTexture("torus");  
+	SetShaderMaterial("rug");
+	SetTextureUVScale(1.0f, 1.0f);  
+	DrawSceneMesh(MESH_TORUS);
+
+
+	/****************************************************************/
+	// Draw the rug just above the floor
+	scaleXYZ = glm::vec3(12.0f, 1.0f, 6.0f);
+	positionXYZ = glm::vec3(0.0f, 1.01f, 0.0f);
+	SetTransformations(scaleXYZ, 0.0f, 0.0f, 0.0f, positionXYZ);
+	SetShaderTexture("rug");
+	SetShaderMaterial("rug");
+	SetTextureUVScale(1.0f, 1.0f);
+	DrawSceneMesh(MESH_PLANE);
+
+	// --- Centerpiece on the Table ---
+	scaleXYZ = glm::vec3(0.25f, 0.25f, 0.25f);  
+	positionXYZ = glm::vec3(0.0f, 6.0f, 0.0f);  
+	SetTransformations(scaleXYZ, 0.0f, 0.0f, 0.0f, positionXYZ);
+	SetShaderTexture("centerpiece");
+	SetShaderMaterial("glass");
+	SetTextureUVScale(1.0f, 1.0f);
+	DrawSceneMesh(MESH_SPHERE);
+
+
+	// Draw table legs (4)
+	scaleXYZ = glm::vec3(0.5f, 3.0f, 0.5f);
+	for (float x = -4.5f; x <= 4.5f; x += 9.0f) {
+		for (float z = -2.5f; z <= 2.5f; z += 5.0f) {
+			positionXYZ = glm::vec3(x, 1.5f, z);
+			SetTransformations(scaleXYZ, 0.0f, 0.0f, 0.0f, positionXYZ);
+			SetShaderTexture("legs"); 
+			SetShaderMaterial("wood");
+			SetTextureUVScale(1.0f, 1.0f); 
+			DrawSceneMesh(MESH_TAPERED_CYLINDER);
+		}
+	}
+
+	// sort and draw everything recorded this frame
+	SubmitRenderQueue();
+}
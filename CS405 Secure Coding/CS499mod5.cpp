@@ -1,105 +1,4805 @@
-#include "SecureDatabase.h"
-#include <openssl/sha.h> // For simple SHA-256 encryption simulation
-
-// --------------------- DBConnection ---------------------
-DBConnection::DBConnection() {
-    std::cout << "Database connection established.\n";
-}
-
-DBConnection::~DBConnection() noexcept {
-    std::cout << "Database connection closed.\n";
-}
-
-bool DBConnection::execute(const std::string& query, const std::vector<std::string>& params) {
-    // Simulated parameterized query execution
-    std::cout << "Executing query: " << query << "\n";
-    for (const auto& p : params)
-        std::cout << " - param: " << p << "\n";
-    return true;
-}
-
-// --------------------- SecureDatabase ---------------------
-SecureDatabase::SecureDatabase() {
-    db = std::make_unique<DBConnection>();
-}
-
-SecureDatabase::~SecureDatabase() noexcept {
-    // RAII automatically cleans up db
-}
-
-// Simple authorization based on role
-bool SecureDatabase::Authorized(const std::string& role, const std::string& operation) {
-    if (role == "admin") return true;
-    if (role == "user" && (operation == "SELECT")) return true;
-    return false;
-}
-
-// SHA-256 encryption simulation
-std::string SecureDatabase::Encrypt(const std::string& plainText) {
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256(reinterpret_cast<const unsigned char*>(plainText.c_str()), plainText.size(), hash);
-    std::string encrypted;
-    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
-        char buf[3];
-        sprintf(buf, "%02x", hash[i]);
-        encrypted += buf;
-    }
-    return encrypted;
-}
-
-// Simple logging (masking sensitive data)
-void SecureDatabase::Log(const std::string& message) {
-    std::cout << "[LOG] " << message << std::endl;
-}
-
-// --------------------- CRUD ---------------------
-bool SecureDatabase::AddUser(const User& user, const std::string& currentRole) {
-    assert(!user.username.empty() && !user.password.empty());
-    if (!Authorized(currentRole, "INSERT")) {
-        Log("Unauthorized attempt to add user by role: " + currentRole);
-        return false;
-    }
-    std::string query = "INSERT INTO Users (username, password, role) VALUES (?, ?, ?)";
-    std::vector<std::string> params = { user.username, Encrypt(user.password), user.role };
-    return db->execute(query, params);
-}
-
-std::unique_ptr<User> SecureDatabase::GetUser(const std::string& username, const std::string& currentRole) {
-    assert(!username.empty());
-    if (!Authorized(currentRole, "SELECT")) {
-        Log("Unauthorized attempt to get user by role: " + currentRole);
-        return nullptr;
-    }
-    std::string query = "SELECT username, password, role FROM Users WHERE username = ?";
-    std::vector<std::string> params = { username };
-    db->execute(query, params);
-
-    // Simulated return
-    auto u = std::make_unique<User>();
-    u->username = username;
-    u->password = "[ENCRYPTED]";
-    u->role = "user";
-    return u;
-}
-
-bool SecureDatabase::UpdatePassword(const std::string& username, const std::string& newPassword, const std::string& currentRole) {
-    assert(!username.empty() && !newPassword.empty());
-    if (!Authorized(currentRole, "UPDATE")) {
-        Log("Unauthorized attempt to update password by role: " + currentRole);
-        return false;
-    }
-    std::string query = "UPDATE Users SET password = ? WHERE username = ?";
-    std::vector<std::string> params = { Encrypt(newPassword), username };
-    return db->execute(query, params);
-}
-
-bool SecureDatabase::DeleteUser(const std::string& username, const std::string& currentRole) {
-    assert(!username.empty());
-    if (!Authorized(currentRole, "DELETE")) {
-        Log("Unauthorized attempt to delete user by role: " + currentRole);
-        return false;
-    }
-    std::string query = "DELETE FROM Users WHERE username = ?";
-    std::vector<std::string> params = { username };
-    return db->execute(query, params);
-}
+#include "SecureDatabase.h"
+#include <openssl/sha.h> // For simple SHA-256 encryption simulation
+#include <openssl/crypto.h> // CRYPTO_memcmp
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <utility>
+#include <iterator>
+#include <stdexcept>
+#include <deque>
+#include <map>
+#include <unordered_set>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// --------------------- UserTable ---------------------
+UserTable::UserTable(size_t expectedRows) {
+    Reserve(expectedRows < 8 ? 8 : expectedRows);
+}
+
+// FNV-1a with a murmur3 finalizer so the low bits used for the slot index are well mixed
+uint32_t UserTable::Hash(std::string_view key) {
+    uint32_t h = 2166136261u;
+    for (unsigned char c : key) {
+        h ^= c;
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+size_t UserTable::FindSlot(std::string_view key, uint32_t hash) const {
+    size_t i = hash & mask;
+    for (;;) {
+        const Slot& s = slots[i];
+        if (s.row == kEmpty)
+            return SIZE_MAX;
+        if (s.row != kDeleted && s.hash == hash && rows[s.row].username == key)
+            return i;
+        i = (i + 1) & mask;
+    }
+}
+
+const User* UserTable::Find(std::string_view username) const {
+    size_t i = FindSlot(username, Hash(username));
+    return i == SIZE_MAX ? nullptr : &rows[slots[i].row];
+}
+
+User* UserTable::Find(std::string_view username) {
+    size_t i = FindSlot(username, Hash(username));
+    return i == SIZE_MAX ? nullptr : &rows[slots[i].row];
+}
+
+bool UserTable::Insert(const User& user) {
+    uint32_t hash = Hash(user.username);
+    if (FindSlot(user.username, hash) != SIZE_MAX)
+        return false;
+
+    // keep the load factor (live + deleted slots) under 3/4 so probe chains stay short
+    if ((count + deleted + 1) * 4 > slots.size() * 3)
+        Rehash(count + 1 > slots.size() / 2 ? slots.size() * 2 : slots.size());
+
+    uint32_t row;
+    if (!freeRows.empty()) {
+        row = freeRows.back();
+        freeRows.pop_back();
+        rows[row] = user;
+    }
+    else {
+        row = static_cast<uint32_t>(rows.size());
+        rows.push_back(user);
+    }
+
+    size_t i = hash & mask;
+    while (slots[i].row != kEmpty && slots[i].row != kDeleted)
+        i = (i + 1) & mask;
+    if (slots[i].row == kDeleted)
+        --deleted;
+    slots[i] = { hash, row };
+    ++count;
+    return true;
+}
+
+bool UserTable::Erase(std::string_view username) {
+    size_t i = FindSlot(username, Hash(username));
+    if (i == SIZE_MAX)
+        return false;
+    uint32_t row = slots[i].row;
+    rows[row] = User{};
+    freeRows.push_back(row);
+    slots[i].row = kDeleted;
+    --count;
+    ++deleted;
+    return true;
+}
+
+void UserTable::Reserve(size_t expectedRows) {
+    rows.reserve(expectedRows);
+    size_t capacity = 16;
+    while (capacity * 3 < expectedRows * 4)
+        capacity *= 2;
+    if (capacity > slots.size())
+        Rehash(capacity);
+}
+
+void UserTable::Rehash(size_t newCapacity) {
+    std::vector<Slot> old(newCapacity, Slot{ 0, kEmpty });
+    old.swap(slots);
+    mask = newCapacity - 1;
+    deleted = 0;
+    for (const Slot& s : old) {
+        if (s.row == kEmpty || s.row == kDeleted)
+            continue;
+        size_t i = s.hash & mask;
+        while (slots[i].row != kEmpty)
+            i = (i + 1) & mask;
+        slots[i] = s;
+    }
+}
+
+// --------------------- Snapshot ---------------------
+namespace {
+    // CRC-32 (IEEE, reflected) with a table built at compile time
+    constexpr auto kCrcTable = [] {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        return table;
+    }();
+
+    uint32_t Crc32(const void* data, size_t size, uint32_t crc = 0) {
+        const unsigned char* p = static_cast<const unsigned char*>(data);
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++)
+            crc = kCrcTable[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    template <class T>
+    void AppendRaw(std::string& out, T value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <class T>
+    T ReadRaw(const char* p) {
+        T value;
+        std::memcpy(&value, p, sizeof(T));
+        return value;
+    }
+
+    bool WriteAll(int fd, const char* data, size_t size) {
+        while (size) {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool WriteAllAt(int fd, const void* data, size_t size, off_t at) {
+        const char* p = static_cast<const char*>(data);
+        while (size) {
+            ssize_t n = ::pwrite(fd, p, size, at);
+            if (n < 0) {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            p += n;
+            at += n;
+            size -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    // Replaces 'path' with 'contents' so that a crash leaves either the old or
+    // the new file: write a temporary, sync it, rename it over, sync the directory
+    bool ReplaceFile(const std::string& path, std::string_view contents) {
+        std::string temp = path + ".tmp";
+        int out = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (out < 0)
+            return false;
+        bool ok = WriteAll(out, contents.data(), contents.size()) && ::fdatasync(out) == 0;
+        ok = ::close(out) == 0 && ok;
+        if (!ok || ::rename(temp.c_str(), path.c_str()) != 0) {
+            ::unlink(temp.c_str());
+            return false;
+        }
+        size_t slash = path.find_last_of('/');
+        std::string dir = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+        int dirFd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dirFd >= 0) {
+            ::fsync(dirFd);
+            ::close(dirFd);
+        }
+        return true;
+    }
+}
+
+namespace {
+    constexpr char kSnapshotMagic[8] = { 'U', 'D', 'B', 'S', 'N', 'A', 'P', '1' };
+
+    struct SnapshotHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t headerCrc;     // over the header with this field zeroed
+        uint64_t rows;
+        uint64_t slotCount;
+        uint64_t slotsOffset;
+        uint64_t dataOffset;
+        uint64_t orderOffset;   // version 1: data size
+        uint32_t bodyCrc;       // over everything after the header
+        uint32_t walMark;       // was reserved (always 0) before marks existed
+    };
+    static_assert(sizeof(SnapshotHeader) == 64);
+
+    uint32_t HeaderCrc(SnapshotHeader header) {
+        header.headerCrc = 0;
+        return Crc32(&header, sizeof(header));
+    }
+}
+
+Snapshot::~Snapshot() noexcept {
+    if (base)
+        ::munmap(const_cast<char*>(base), size);
+}
+
+std::shared_ptr<const Snapshot> Snapshot::Open(const std::string& path) {
+    int in = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0)
+        return nullptr;
+    struct stat st;
+    if (::fstat(in, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+        ::close(in);
+        return nullptr;
+    }
+    size_t length = static_cast<size_t>(st.st_size);
+    void* mapped = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, in, 0);
+    ::close(in);    // the mapping keeps the file alive
+    if (mapped == MAP_FAILED)
+        return nullptr;
+
+    std::shared_ptr<Snapshot> snap(new Snapshot());
+    snap->base = static_cast<const char*>(mapped);
+    snap->size = length;
+
+    // validate the header and that every region lies inside the file; the
+    // body is only checksummed by Verify(), which has to read all of it
+    SnapshotHeader h;
+    std::memcpy(&h, snap->base, sizeof(h));
+    bool legacy = h.version == 1;
+    uint64_t slotsEnd = h.slotsOffset + h.slotCount * sizeof(Slot);
+    bool valid = std::memcmp(h.magic, kSnapshotMagic, sizeof(h.magic)) == 0 && (h.version == kVersion || legacy)
+        && h.headerCrc == HeaderCrc(h) && h.slotCount && (h.slotCount & (h.slotCount - 1)) == 0
+        && h.slotsOffset == sizeof(SnapshotHeader) && h.slotCount <= (length - h.slotsOffset) / sizeof(Slot)
+        && h.dataOffset <= length
+        && (legacy ? h.dataOffset == slotsEnd && h.orderOffset == length - h.dataOffset
+                   : h.orderOffset == slotsEnd && h.rows <= (length - slotsEnd) / sizeof(uint64_t)
+                         && h.dataOffset == slotsEnd + h.rows * sizeof(uint64_t));
+    if (!valid)
+        return nullptr;
+
+    snap->rows = h.rows;
+    snap->slots = reinterpret_cast<const Slot*>(snap->base + h.slotsOffset);
+    snap->mask = h.slotCount - 1;
+    snap->dataOffset = h.dataOffset;
+    snap->bodyCrc = h.bodyCrc;
+    snap->walMark = h.walMark;
+    if (legacy) {
+        // no order array on disk: sort the record offsets once, until the next compaction rewrites the file
+        std::vector<std::pair<std::string_view, uint64_t>> keyed;
+        keyed.reserve(std::min<uint64_t>(h.rows, (length - h.dataOffset) / (3 * sizeof(uint16_t))));
+        UserRef r;
+        for (uint64_t at = snap->dataOffset; at < length && keyed.size() < h.rows;) {
+            uint64_t record = at;
+            if (!snap->Decode(record, r, at))
+                return nullptr;
+            keyed.emplace_back(r.username, record);
+        }
+        if (keyed.size() != h.rows)
+            return nullptr;
+        std::sort(keyed.begin(), keyed.end());
+        snap->legacyOrder.reserve(keyed.size());
+        for (const auto& k : keyed)
+            snap->legacyOrder.push_back(k.second);
+        snap->order = snap->legacyOrder.data();
+    }
+    else {
+        snap->order = reinterpret_cast<const uint64_t*>(snap->base + h.orderOffset);
+    }
+    // point lookups touch scattered pages; readahead would only waste I/O
+    ::madvise(const_cast<char*>(snap->base), length, MADV_RANDOM);
+    return snap;
+}
+
+bool Snapshot::Write(const std::string& path, std::span<const UserRef> unsorted, uint32_t walMark) {
+    std::vector<UserRef> rows(unsorted.begin(), unsorted.end());
+    std::sort(rows.begin(), rows.end(), [](const UserRef& a, const UserRef& b) { return a.username < b.username; });
+    size_t slotCount = 16;
+    while (slotCount * 3 < rows.size() * 4)
+        slotCount *= 2;
+
+    SnapshotHeader h{};
+    std::memcpy(h.magic, kSnapshotMagic, sizeof(h.magic));
+    h.version = kVersion;
+    h.rows = rows.size();
+    h.slotCount = slotCount;
+    h.slotsOffset = sizeof(SnapshotHeader);
+    h.orderOffset = h.slotsOffset + slotCount * sizeof(Slot);
+    h.dataOffset = h.orderOffset + rows.size() * sizeof(uint64_t);
+    h.walMark = walMark;
+
+    size_t dataBytes = 0;
+    for (const UserRef& r : rows)
+        dataBytes += 3 * sizeof(uint16_t) + r.username.size() + r.password.size() + r.role.size();
+    // sized exactly up front, so 'slots' and 'order' stay valid while records are appended
+    std::string file(h.dataOffset, '\0');
+    file.reserve(h.dataOffset + dataBytes);
+
+    Slot* slots = reinterpret_cast<Slot*>(file.data() + h.slotsOffset);
+    uint64_t* order = reinterpret_cast<uint64_t*>(file.data() + h.orderOffset);
+    size_t mask = slotCount - 1;
+    for (const UserRef& r : rows) {
+        uint32_t hash = UserTable::Hash(r.username);
+        size_t i = hash & mask;
+        while (slots[i].offset)
+            i = (i + 1) & mask;
+        slots[i] = { hash, 0, file.size() };
+        *order++ = file.size();
+        assert(r.username.size() <= kMaxFieldBytes && r.password.size() <= kMaxFieldBytes && r.role.size() <= kMaxFieldBytes);
+        AppendRaw(file, static_cast<uint16_t>(r.username.size()));
+        AppendRaw(file, static_cast<uint16_t>(r.password.size()));
+        AppendRaw(file, static_cast<uint16_t>(r.role.size()));
+        file += r.username;
+        file += r.password;
+        file += r.role;
+    }
+
+    h.bodyCrc = Crc32(file.data() + sizeof(SnapshotHeader), file.size() - sizeof(SnapshotHeader));
+    h.headerCrc = HeaderCrc(h);
+    std::memcpy(file.data(), &h, sizeof(h));
+    return ReplaceFile(path, file);
+}
+
+bool Snapshot::Find(std::string_view username, UserRef& out) const {
+    uint32_t hash = UserTable::Hash(username);
+    size_t i = hash & mask;
+    for (size_t probes = 0; probes <= mask; probes++, i = (i + 1) & mask) {
+        const Slot& s = slots[i];
+        if (!s.offset)
+            return false;
+        if (s.hash != hash)
+            continue;
+        UserRef r;
+        uint64_t next;
+        if (Decode(s.offset, r, next) && r.username == username) {
+            out = r;
+            return true;
+        }
+    }
+    return false;   // a full table only comes from a corrupt file
+}
+
+size_t Snapshot::Seek(std::string_view key, bool after) const {
+    size_t lo = 0;
+    size_t hi = rows;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        std::string_view name = At(mid).username;
+        if (after ? name <= key : name < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+bool Snapshot::Verify() const {
+    return Crc32(base + sizeof(SnapshotHeader), size - sizeof(SnapshotHeader)) == bodyCrc;
+}
+
+// --------------------- Epoch ---------------------
+namespace {
+    struct alignas(64) EpochSlot {
+        std::atomic<uint64_t> pinned{ 0 };  // 0 = not in a read
+        std::atomic<bool> claimed{ false };
+    };
+
+    struct RetiredItem {
+        void* p;
+        void (*free)(void*);
+        uint64_t epoch;
+    };
+
+    // at exit no reader is left, so whatever is still queued can go
+    struct RetiredList : std::vector<RetiredItem> {
+        ~RetiredList() {
+            for (const RetiredItem& r : *this)
+                r.free(r.p);
+        }
+    };
+
+    EpochSlot g_epochSlots[Epoch::kMaxThreads];
+    std::atomic<uint64_t> g_epoch{ 1 };
+    std::mutex g_retiredMutex;
+    RetiredList g_retired;
+    constexpr size_t kReclaimBatch = 128;
+
+    struct ThreadEpoch {
+        EpochSlot* slot = nullptr;
+        unsigned depth = 0;
+
+        ~ThreadEpoch() {
+            if (slot)
+                slot->claimed.store(false, std::memory_order_release);
+        }
+
+        EpochSlot& Slot() {
+            if (!slot) {
+                for (EpochSlot& s : g_epochSlots) {
+                    bool expected = false;
+                    if (s.claimed.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                        slot = &s;
+                        break;
+                    }
+                }
+                if (!slot)
+                    throw std::runtime_error("more than Epoch::kMaxThreads threads reading concurrently");
+            }
+            return *slot;
+        }
+    };
+
+    thread_local ThreadEpoch t_epoch;
+
+    // Advances the epoch if every pinned thread has caught up with it, and
+    // frees what was retired two epochs ago: no pinned thread can reach it
+    void Reclaim() {
+        uint64_t epoch = g_epoch.load(std::memory_order_seq_cst);
+        bool caughtUp = true;
+        for (const EpochSlot& s : g_epochSlots) {
+            uint64_t pinned = s.pinned.load(std::memory_order_seq_cst);
+            if (pinned && pinned != epoch) {
+                caughtUp = false;
+                break;
+            }
+        }
+        if (caughtUp)
+            g_epoch.compare_exchange_strong(epoch, epoch + 1, std::memory_order_seq_cst);
+
+        uint64_t safe = g_epoch.load(std::memory_order_seq_cst);
+        std::vector<RetiredItem> freeable;
+        {
+            std::lock_guard<std::mutex> guard(g_retiredMutex);
+            auto keep = std::partition(g_retired.begin(), g_retired.end(),
+                                       [safe](const RetiredItem& r) { return r.epoch + 2 > safe; });
+            freeable.assign(keep, g_retired.end());
+            g_retired.erase(keep, g_retired.end());
+        }
+        for (const RetiredItem& r : freeable)
+            r.free(r.p);
+    }
+}
+
+Epoch::Guard::Guard() {
+    if (t_epoch.depth++ == 0)
+        t_epoch.Slot().pinned.store(g_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+}
+
+Epoch::Guard::~Guard() noexcept {
+    if (--t_epoch.depth == 0)
+        t_epoch.slot->pinned.store(0, std::memory_order_release);
+}
+
+void Epoch::Retire(void* p, void (*free)(void*)) {
+    size_t pending;
+    {
+        std::lock_guard<std::mutex> guard(g_retiredMutex);
+        g_retired.push_back({ p, free, g_epoch.load(std::memory_order_seq_cst) });
+        pending = g_retired.size();
+    }
+    if (pending % kReclaimBatch == 0)
+        Reclaim();
+}
+
+size_t Epoch::Pending() {
+    std::lock_guard<std::mutex> guard(g_retiredMutex);
+    return g_retired.size();
+}
+
+// --------------------- OrderedKeys ---------------------
+struct OrderedKeys::Node {
+    std::string_view key;           // both in the list's blocks
+    std::atomic<Node*>* next;
+};
+
+OrderedKeys::OrderedKeys() : head(NewNode({}, kMaxHeight)) {}
+
+// nodes and keys are trivially destructible: the blocks go as they are
+OrderedKeys::~OrderedKeys() noexcept = default;
+
+void* OrderedKeys::Allocate(size_t bytes, size_t align) {
+    size_t pad = (align - reinterpret_cast<uintptr_t>(tail) % align) % align;
+    if (pad + bytes > tailBytes) {
+        // a key too long for a block gets one of its own
+        size_t size = std::max(kBlockBytes, bytes + align);
+        blocks.emplace_back(new char[size]);
+        tail = blocks.back().get();
+        tailBytes = size;
+        pad = (align - reinterpret_cast<uintptr_t>(tail) % align) % align;
+    }
+    void* p = tail + pad;
+    tail += pad + bytes;
+    tailBytes -= pad + bytes;
+    return p;
+}
+
+OrderedKeys::Node* OrderedKeys::NewNode(std::string_view key, int height) {
+    auto* links = static_cast<std::atomic<Node*>*>(Allocate(sizeof(std::atomic<Node*>) * height, alignof(std::atomic<Node*>)));
+    for (int i = 0; i < height; i++)
+        new (&links[i]) std::atomic<Node*>(nullptr);
+    char* chars = static_cast<char*>(Allocate(key.size(), 1));
+    std::copy(key.begin(), key.end(), chars);
+    return new (Allocate(sizeof(Node), alignof(Node))) Node{ std::string_view(chars, key.size()), links };
+}
+
+// Height h with probability 4^-(h-1): about 1.33 links per key
+int OrderedKeys::RandomHeight() {
+    random ^= random << 13;
+    random ^= random >> 7;
+    random ^= random << 17;
+    int h = 1;
+    for (uint64_t bits = random; h < kMaxHeight && (bits & 3) == 0; bits >>= 2)
+        h++;
+    return h;
+}
+
+void OrderedKeys::Insert(std::string_view key) {
+    Node* prev[kMaxHeight];
+    Node* n = head;
+    // Every finger sorts before 'key', and each one is at or past the one
+    // above it on its level. A level starts from its finger unless the level
+    // above already moved past its own, which puts it after 'last'.
+    bool onFingers = last && last->key < key;
+    for (int level = kMaxHeight - 1; level >= 0; level--) {
+        if (onFingers)
+            n = finger[level];
+        for (Node* next; (next = n->next[level].load(std::memory_order_relaxed)) && next->key < key;) {
+            n = next;
+            onFingers = false;
+        }
+        prev[level] = n;
+    }
+    int h = RandomHeight();
+    Node* node = NewNode(key, h);
+    for (int level = 0; level < h; level++)
+        node->next[level].store(prev[level]->next[level].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    // bottom up: once linked at level 0 the key is in the list; upper links only speed up searches
+    for (int level = 0; level < h; level++)
+        prev[level]->next[level].store(node, std::memory_order_release);
+    for (int level = 0; level < kMaxHeight; level++)
+        finger[level] = level < h ? node : prev[level];
+    last = node;
+}
+
+const OrderedKeys::Node* OrderedKeys::Seek(std::string_view key, bool after) const {
+    const Node* n = head;
+    for (int level = kMaxHeight - 1; level >= 0; level--) {
+        for (const Node* next; (next = n->next[level].load(std::memory_order_acquire))
+                               && (after ? next->key <= key : next->key < key);)
+            n = next;
+    }
+    return n->next[0].load(std::memory_order_acquire);
+}
+
+const OrderedKeys::Node* OrderedKeys::Next(const Node* node) {
+    return node->next[0].load(std::memory_order_acquire);
+}
+
+std::string_view OrderedKeys::Key(const Node* node) {
+    return node->key;
+}
+
+// --------------------- VersionedIndex ---------------------
+VersionedIndex::VersionedIndex(size_t expectedRows) {
+    size_t capacity = 16;
+    while (capacity * 3 < expectedRows * 4)
+        capacity *= 2;
+    table.store(new Table(capacity), std::memory_order_relaxed);
+}
+
+VersionedIndex::~VersionedIndex() noexcept {
+    Table* t = table.load(std::memory_order_relaxed);
+    if (ownsVersions) {
+        for (size_t i = 0; i <= t->mask; i++)
+            delete t->slots[i].head.load(std::memory_order_relaxed);
+    }
+    for (const UserVersion* v : orphans)
+        delete v;
+    delete t;
+}
+
+const UserVersion* VersionedIndex::Find(std::string_view username) const {
+    uint32_t hash = UserTable::Hash(username);
+    const Table* t = table.load(std::memory_order_acquire);
+    for (size_t i = hash & t->mask;; i = (i + 1) & t->mask) {
+        const UserVersion* head = t->slots[i].head.load(std::memory_order_acquire);
+        if (!head)
+            return nullptr;
+        if (t->slots[i].hash.load(std::memory_order_relaxed) == hash && head->row.username == username)
+            return head;
+    }
+}
+
+const UserVersion* VersionedIndex::Publish(UserVersion* version) {
+    uint32_t hash = UserTable::Hash(version->row.username);
+    Table* t = table.load(std::memory_order_relaxed);
+    size_t i = hash & t->mask;
+    for (;; i = (i + 1) & t->mask) {
+        Slot& slot = t->slots[i];
+        const UserVersion* head = slot.head.load(std::memory_order_relaxed);
+        if (!head)
+            break;
+        if (slot.hash.load(std::memory_order_relaxed) == hash && head->row.username == version->row.username) {
+            version->older = head;
+            slot.head.store(version, std::memory_order_release);
+            --(head->deleted ? tombstones : rows);
+            ++(version->deleted ? tombstones : rows);
+            return head;
+        }
+    }
+
+    // new username: claim an empty slot, growing first to keep the load under 3/4
+    if ((used + 1) * 4 > (t->mask + 1) * 3) {
+        Grow();
+        t = table.load(std::memory_order_relaxed);
+        for (i = hash & t->mask; t->slots[i].head.load(std::memory_order_relaxed); i = (i + 1) & t->mask) {}
+    }
+    t->slots[i].hash.store(hash, std::memory_order_relaxed);
+    t->slots[i].head.store(version, std::memory_order_release);     // publishes the hash too
+    keys.Insert(version->row.username);
+    ++used;
+    ++(version->deleted ? tombstones : rows);
+    return nullptr;
+}
+
+void VersionedIndex::Adopt(const UserVersion* version) {
+    if ((used + 1) * 4 > (table.load(std::memory_order_relaxed)->mask + 1) * 3)
+        Grow();
+    uint32_t hash = UserTable::Hash(version->row.username);
+    Table* t = table.load(std::memory_order_relaxed);
+    size_t i = hash & t->mask;
+    while (t->slots[i].head.load(std::memory_order_relaxed))
+        i = (i + 1) & t->mask;
+    t->slots[i].hash.store(hash, std::memory_order_relaxed);
+    t->slots[i].head.store(version, std::memory_order_release);
+    keys.Insert(version->row.username);
+    ++used;
+    ++(version->deleted ? tombstones : rows);
+}
+
+void VersionedIndex::Grow() {
+    Table* old = table.load(std::memory_order_relaxed);
+    Table* grown = new Table((old->mask + 1) * 2);
+    for (size_t i = 0; i <= old->mask; i++) {
+        const UserVersion* head = old->slots[i].head.load(std::memory_order_relaxed);
+        if (!head)
+            continue;
+        uint32_t hash = old->slots[i].hash.load(std::memory_order_relaxed);
+        size_t j = hash & grown->mask;
+        while (grown->slots[j].head.load(std::memory_order_relaxed))
+            j = (j + 1) & grown->mask;
+        grown->slots[j].hash.store(hash, std::memory_order_relaxed);
+        grown->slots[j].head.store(head, std::memory_order_relaxed);
+    }
+    table.store(grown, std::memory_order_release);
+    Epoch::Retire(old);     // readers may still be probing it
+}
+
+// --------------------- RoaringBitmap ---------------------
+void RoaringBitmap::ToBitmap(Container& c) {
+    c.bits.assign(kWords, 0);
+    for (uint16_t low : c.array)
+        c.bits[low >> 6] |= uint64_t(1) << (low & 63);
+    std::vector<uint16_t>().swap(c.array);
+}
+
+void RoaringBitmap::ToArray(Container& c) {
+    c.array.clear();
+    c.array.reserve(c.count);
+    for (size_t w = 0; w < kWords; w++)
+        for (uint64_t word = c.bits[w]; word; word &= word - 1)
+            c.array.push_back(static_cast<uint16_t>(w * 64 + std::countr_zero(word)));
+    std::vector<uint64_t>().swap(c.bits);
+}
+
+bool RoaringBitmap::Add(uint32_t value) {
+    uint16_t key = static_cast<uint16_t>(value >> 16);
+    uint16_t low = static_cast<uint16_t>(value);
+    auto it = std::lower_bound(containers.begin(), containers.end(), key,
+                               [](const Container& c, uint16_t k) { return c.key < k; });
+    if (it == containers.end() || it->key != key) {
+        it = containers.insert(it, Container{});
+        it->key = key;
+    }
+    Container& c = *it;
+    if (c.bits.empty()) {
+        auto pos = std::lower_bound(c.array.begin(), c.array.end(), low);
+        if (pos != c.array.end() && *pos == low)
+            return false;
+        if (c.array.size() < kArrayMax)
+            c.array.insert(pos, low);
+        else {
+            ToBitmap(c);
+            c.bits[low >> 6] |= uint64_t(1) << (low & 63);
+        }
+    }
+    else {
+        uint64_t bit = uint64_t(1) << (low & 63);
+        if (c.bits[low >> 6] & bit)
+            return false;
+        c.bits[low >> 6] |= bit;
+    }
+    ++c.count;
+    ++cardinality;
+    return true;
+}
+
+bool RoaringBitmap::Remove(uint32_t value) {
+    uint16_t key = static_cast<uint16_t>(value >> 16);
+    uint16_t low = static_cast<uint16_t>(value);
+    auto it = std::lower_bound(containers.begin(), containers.end(), key,
+                               [](const Container& c, uint16_t k) { return c.key < k; });
+    if (it == containers.end() || it->key != key)
+        return false;
+    Container& c = *it;
+    if (c.bits.empty()) {
+        auto pos = std::lower_bound(c.array.begin(), c.array.end(), low);
+        if (pos == c.array.end() || *pos != low)
+            return false;
+        c.array.erase(pos);
+    }
+    else {
+        uint64_t bit = uint64_t(1) << (low & 63);
+        if (!(c.bits[low >> 6] & bit))
+            return false;
+        c.bits[low >> 6] &= ~bit;
+    }
+    --cardinality;
+    if (--c.count == 0)
+        containers.erase(it);
+    else if (!c.bits.empty() && c.count <= kArrayMax)
+        ToArray(c);
+    return true;
+}
+
+bool RoaringBitmap::Contains(uint32_t value) const {
+    uint16_t key = static_cast<uint16_t>(value >> 16);
+    uint16_t low = static_cast<uint16_t>(value);
+    auto it = std::lower_bound(containers.begin(), containers.end(), key,
+                               [](const Container& c, uint16_t k) { return c.key < k; });
+    if (it == containers.end() || it->key != key)
+        return false;
+    if (it->bits.empty())
+        return std::binary_search(it->array.begin(), it->array.end(), low);
+    return it->bits[low >> 6] >> (low & 63) & 1;
+}
+
+size_t RoaringBitmap::Bytes() const {
+    size_t bytes = containers.capacity() * sizeof(Container);
+    for (const Container& c : containers)
+        bytes += c.array.capacity() * sizeof(uint16_t) + c.bits.capacity() * sizeof(uint64_t);
+    return bytes;
+}
+
+void RoaringBitmap::Clear() {
+    containers.clear();
+    cardinality = 0;
+}
+
+void RoaringBitmap::UnionInto(Container& into, const Container& from) {
+    if (into.bits.empty() && from.bits.empty() && into.array.size() + from.array.size() <= kArrayMax) {
+        std::vector<uint16_t> merged;
+        merged.reserve(into.array.size() + from.array.size());
+        std::set_union(into.array.begin(), into.array.end(), from.array.begin(), from.array.end(),
+                       std::back_inserter(merged));
+        into.array.swap(merged);
+        into.count = static_cast<uint32_t>(into.array.size());
+        return;
+    }
+    if (into.bits.empty())
+        ToBitmap(into);
+    if (from.bits.empty()) {
+        for (uint16_t low : from.array)
+            into.bits[low >> 6] |= uint64_t(1) << (low & 63);
+    }
+    else {
+        for (size_t w = 0; w < kWords; w++)
+            into.bits[w] |= from.bits[w];
+    }
+    into.count = 0;
+    for (uint64_t word : into.bits)
+        into.count += static_cast<uint32_t>(std::popcount(word));
+    if (into.count <= kArrayMax)
+        ToArray(into);
+}
+
+RoaringBitmap& RoaringBitmap::operator|=(const RoaringBitmap& other) {
+    std::vector<Container> merged;
+    merged.reserve(containers.size() + other.containers.size());
+    auto a = containers.begin();
+    auto b = other.containers.begin();
+    while (a != containers.end() || b != other.containers.end()) {
+        if (b == other.containers.end() || (a != containers.end() && a->key < b->key))
+            merged.push_back(std::move(*a++));
+        else if (a == containers.end() || b->key < a->key)
+            merged.push_back(*b++);
+        else {
+            UnionInto(*a, *b++);
+            merged.push_back(std::move(*a++));
+        }
+    }
+    containers.swap(merged);
+    cardinality = 0;
+    for (const Container& c : containers)
+        cardinality += c.count;
+    return *this;
+}
+
+// --------------------- RoleIndex ---------------------
+uint32_t RoleIndex::UserId(std::string_view username) {
+    if ((nameEnds.size() + 1) * 4 > slots.size() * 3)
+        Grow();
+    uint32_t hash = UserTable::Hash(username);
+    size_t mask = slots.size() - 1;
+    size_t i = hash & mask;
+    for (; slots[i].id != kNoUser; i = (i + 1) & mask) {
+        if (slots[i].hash == hash && Username(slots[i].id) == username)
+            return slots[i].id;
+    }
+    uint32_t id = static_cast<uint32_t>(nameEnds.size());
+    names += username;
+    nameEnds.push_back(names.size());
+    slots[i] = { hash, id };
+    return id;
+}
+
+void RoleIndex::Grow() {
+    std::vector<Slot> grown(std::max<size_t>(16, slots.size() * 2), Slot{ 0, kNoUser });
+    size_t mask = grown.size() - 1;
+    for (const Slot& s : slots) {
+        if (s.id == kNoUser)
+            continue;
+        size_t i = s.hash & mask;
+        while (grown[i].id != kNoUser)
+            i = (i + 1) & mask;
+        grown[i] = s;
+    }
+    slots.swap(grown);
+}
+
+uint32_t RoleIndex::RoleId(std::string_view role) {
+    auto it = roleIds.find(role);
+    if (it == roleIds.end()) {
+        it = roleIds.emplace(std::string(role), static_cast<uint32_t>(members.size())).first;
+        members.emplace_back();
+    }
+    return it->second;
+}
+
+void RoleIndex::Add(uint32_t user, std::string_view role) {
+    members[RoleId(role)].Add(user);
+}
+
+void RoleIndex::Remove(uint32_t user, std::string_view role) {
+    auto it = roleIds.find(role);
+    if (it != roleIds.end())
+        members[it->second].Remove(user);
+}
+
+uint64_t RoleIndex::Reassign(std::string_view from, std::string_view to) {
+    auto it = roleIds.find(from);
+    if (from == to || it == roleIds.end() || members[it->second].Cardinality() == 0)
+        return 0;
+    uint32_t source = it->second;
+    uint32_t target = RoleId(to);
+    uint64_t moved = members[source].Cardinality();
+    members[target] |= members[source];
+    members[source].Clear();
+    return moved;
+}
+
+const RoaringBitmap* RoleIndex::Users(std::string_view role) const {
+    auto it = roleIds.find(role);
+    return it == roleIds.end() ? nullptr : &members[it->second];
+}
+
+size_t RoleIndex::Bytes() const {
+    size_t bytes = 0;
+    for (const RoaringBitmap& m : members)
+        bytes += m.Bytes();
+    return bytes + names.capacity() + nameEnds.capacity() * sizeof(uint64_t) + slots.capacity() * sizeof(Slot);
+}
+
+// --------------------- UserStore ---------------------
+UserStore::UserStore() : view(new View()) {}
+
+UserStore::~UserStore() noexcept {
+    // no reader can outlive the store, so the view goes directly
+    for (const UserVersion* old : superseded)
+        delete old;
+    delete view.load(std::memory_order_relaxed);
+}
+
+bool UserStore::Lookup(std::string_view username, UserRef& out) const {
+    // view before clock: a view swapped in later never holds versions older than its clock
+    const View& v = *view.load(std::memory_order_acquire);
+    uint64_t ts = clock.load(std::memory_order_acquire);
+    const RoleRemaps* remaps = v.remaps.load(std::memory_order_acquire);
+    if (const UserVersion* ver = UserVersion::VisibleAt(v.delta.Find(username), ts)) {
+        if (ver->deleted)
+            return false;
+        out = { ver->row.username, ver->row.password, RemapRole(remaps, ver->row.role, ver->commit, ts) };
+        return true;
+    }
+    if (!v.snapshot || !v.snapshot->Find(username, out))
+        return false;
+    out.role = RemapRole(remaps, out.role, 0, ts);
+    return true;
+}
+
+void UserStore::Scan(const std::function<void(const UserRef&)>& visit) const {
+    const View& v = *view.load(std::memory_order_acquire);
+    uint64_t ts = clock.load(std::memory_order_acquire);
+    const RoleRemaps* remaps = v.remaps.load(std::memory_order_acquire);
+    if (v.snapshot) {
+        v.snapshot->ForEach([&](const UserRef& r) {
+            if (!UserVersion::VisibleAt(v.delta.Find(r.username), ts))
+                visit(UserRef{ r.username, r.password, RemapRole(remaps, r.role, 0, ts) });
+        });
+    }
+    v.delta.ForEach([&](const UserVersion& head) {
+        const UserVersion* ver = UserVersion::VisibleAt(&head, ts);
+        if (ver && !ver->deleted)
+            visit(UserRef{ ver->row.username, ver->row.password, RemapRole(remaps, ver->row.role, ver->commit, ts) });
+    });
+}
+
+size_t UserStore::List(std::string_view prefix, std::string_view cursor, size_t limit,
+    const std::function<void(const UserRef&)>& visit) const {
+    const View& v = *view.load(std::memory_order_acquire);
+    uint64_t ts = clock.load(std::memory_order_acquire);
+    const RoleRemaps* remaps = v.remaps.load(std::memory_order_acquire);
+    bool after = !cursor.empty() && cursor >= prefix;
+    std::string_view from = after ? cursor : prefix;
+    size_t i = v.snapshot ? v.snapshot->Seek(from, after) : 0;
+    size_t end = v.snapshot ? v.snapshot->Size() : 0;
+    const OrderedKeys::Node* node = v.delta.Keys().Seek(from, after);
+
+    size_t visited = 0;
+    while (visited < limit) {
+        UserRef row;
+        bool inSnapshot = i < end;
+        if (inSnapshot)
+            row = v.snapshot->At(i);
+        // the smaller of the two heads; both advance when they hold the same username
+        std::string_view key;
+        if (inSnapshot && (!node || row.username <= OrderedKeys::Key(node)))
+            key = row.username;
+        else if (node)
+            key = OrderedKeys::Key(node);
+        else
+            break;
+        if (!key.starts_with(prefix))
+            break;
+        bool fromSnapshot = inSnapshot && row.username == key;
+        bool fromDelta = node && OrderedKeys::Key(node) == key;
+
+        // a key inserted after 'ts' has no visible version and falls through to the snapshot, if any
+        const UserVersion* ver = fromDelta ? UserVersion::VisibleAt(v.delta.Find(key), ts) : nullptr;
+        if (ver) {
+            if (!ver->deleted) {
+                visit(UserRef{ ver->row.username, ver->row.password, RemapRole(remaps, ver->row.role, ver->commit, ts) });
+                visited++;
+            }
+        }
+        else if (fromSnapshot) {
+            row.role = RemapRole(remaps, row.role, 0, ts);
+            visit(row);
+            visited++;
+        }
+        if (fromSnapshot)
+            i++;
+        if (fromDelta)
+            node = OrderedKeys::Next(node);
+    }
+    return visited;
+}
+
+bool UserStore::Current(std::string_view username, UserRef& out) const {
+    const View& v = *view.load(std::memory_order_relaxed);
+    const RoleRemaps* remaps = v.remaps.load(std::memory_order_relaxed);
+    if (const UserVersion* head = v.delta.Find(username)) {
+        if (head->deleted)
+            return false;
+        out = { head->row.username, head->row.password, RemapRole(remaps, head->row.role, head->commit, UINT64_MAX) };
+        return true;
+    }
+    if (!v.snapshot || !v.snapshot->Find(username, out))
+        return false;
+    out.role = RemapRole(remaps, out.role, 0, UINT64_MAX);
+    return true;
+}
+
+void UserStore::Write(UserVersion* version, const UserRef* before) {
+    uint32_t id = roles->UserId(version->row.username);
+    if (before)
+        roles->Remove(id, before->role);
+    if (!version->deleted)
+        roles->Add(id, version->row.role);
+    version->commit = clock.load(std::memory_order_relaxed) + 1;
+    if (const UserVersion* old = view.load(std::memory_order_relaxed)->delta.Publish(version))
+        superseded.push_back(old);
+}
+
+bool UserStore::Insert(User user) {
+    UserRef existing;
+    if (Current(user.username, existing))
+        return false;
+    Write(new UserVersion{ std::move(user) }, nullptr);
+    return true;
+}
+
+void UserStore::Put(User user) {
+    UserRef before;
+    bool replaces = Current(user.username, before);
+    Write(new UserVersion{ std::move(user) }, replaces ? &before : nullptr);
+}
+
+bool UserStore::SetPassword(std::string_view username, std::string_view password) {
+    UserRef row;
+    if (!Current(username, row))
+        return false;
+    Write(new UserVersion{ User{ std::string(row.username), std::string(password), std::string(row.role) } }, &row);
+    return true;
+}
+
+bool UserStore::Erase(std::string_view username) {
+    UserRef row;
+    if (!Current(username, row))
+        return false;
+    Write(new UserVersion{ User{ std::string(username), {}, {} }, true }, &row);
+    return true;
+}
+
+// The users move between bitmaps at once; their rows pick up the new role
+// through a remap published with the statement, not through new versions
+uint64_t UserStore::ChangeRole(std::string_view from, std::string_view to) {
+    uint64_t moved = roles->Reassign(from, to);
+    if (!moved)
+        return 0;
+    View& v = *view.load(std::memory_order_relaxed);
+    const RoleRemaps* old = v.remaps.load(std::memory_order_relaxed);
+    auto* next = old ? new RoleRemaps(*old) : new RoleRemaps();
+    next->push_back(RoleRemap{ std::string(from), std::string(to), clock.load(std::memory_order_relaxed) + 1 });
+    v.remaps.store(next, std::memory_order_release);
+    if (old)
+        Epoch::Retire(old);     // every remap it holds is in 'next' too
+    return moved;
+}
+
+void UserStore::IndexRoles() {
+    Scan([&](const UserRef& r) { roles->Add(roles->UserId(r.username), r.role); });
+}
+
+size_t UserStore::UsersWithRole(std::string_view role, const std::function<void(const UserRef&)>& visit) const {
+    const RoaringBitmap* users = roles->Users(role);
+    size_t visited = 0;
+    if (!users)
+        return visited;
+    users->ForEach([&](uint32_t id) {
+        UserRef row;
+        if (Current(roles->Username(id), row)) {
+            visit(row);
+            visited++;
+        }
+    });
+    return visited;
+}
+
+// Makes the statement's versions visible, then retires the ones they replaced:
+// a reader that pins after this reads the new clock and never walks past them
+void UserStore::Publish() {
+    clock.fetch_add(1, std::memory_order_release);
+    for (const UserVersion* old : superseded)
+        Epoch::Retire(old);
+    superseded.clear();
+
+    const View& v = *view.load(std::memory_order_relaxed);
+    const RoleRemaps* remaps = v.remaps.load(std::memory_order_relaxed);
+    if (compacting.load(std::memory_order_relaxed))
+        return;
+    if ((remaps && remaps->size() >= kRebaseRemaps)
+        || (!v.snapshot && v.delta.Tombstones() >= kRebaseTombstones && v.delta.Tombstones() > v.delta.Rows()))
+        Rebase();
+}
+
+// The new view has no remaps, so a row whose role a remap changes is
+// copied with the role applied and the current clock, for readers of the
+// new view to see at once. Every other newest version moves over as it
+// is: a reader loads the view before the clock, so it finds those visible
+// and never looks at older ones. A tombstone only matters while the
+// snapshot still holds the row it hides; the rest, and the versions
+// copied, go with the old view. The delta is walked in key order, so the
+// new key list is built by appending.
+void UserStore::Rebase() {
+    View* current = view.load(std::memory_order_relaxed);
+    const RoleRemaps* remaps = current->remaps.load(std::memory_order_relaxed);
+    uint64_t now = clock.load(std::memory_order_relaxed);
+    auto next = std::make_unique<View>();
+    next->snapshot = current->snapshot;
+    std::vector<const UserVersion*> dropped;
+    for (const OrderedKeys::Node* node = current->delta.Keys().Seek({}, false); node; node = OrderedKeys::Next(node)) {
+        const UserVersion* head = current->delta.Find(OrderedKeys::Key(node));
+        if (head->deleted) {
+            if (current->snapshot && current->snapshot->Contains(head->row.username))
+                next->delta.Adopt(head);
+            else
+                dropped.push_back(head);
+            continue;
+        }
+        std::string_view role = RemapRole(remaps, head->row.role, head->commit, UINT64_MAX);
+        if (role == head->row.role) {
+            next->delta.Adopt(head);
+            continue;
+        }
+        next->delta.Publish(new UserVersion{ User{ head->row.username, head->row.password, std::string(role) }, false, now });
+        dropped.push_back(head);
+    }
+    if (current->snapshot && remaps) {
+        current->snapshot->ForEach([&](const UserRef& r) {
+            std::string_view role = RemapRole(remaps, r.role, 0, UINT64_MAX);
+            if (role != r.role && !current->delta.Find(r.username))
+                next->delta.Publish(new UserVersion{ User{ std::string(r.username), std::string(r.password), std::string(role) },
+                                                     false, now });
+        });
+    }
+    current->delta.Disown(std::move(dropped));
+    view.store(next.release(), std::memory_order_release);
+    Epoch::Retire(current);
+}
+
+// --------------------- Statements ---------------------
+namespace {
+    constexpr std::string_view kInsertTuple = "(?, ?, ?)";
+    constexpr std::string_view kListSep = ", ";
+
+    // Counts the items in "<item>, <item>, ..., <item><tail>"; 0 if malformed
+    size_t CountListItems(std::string_view text, std::string_view item, std::string_view tail) {
+        size_t n = 0;
+        for (;;) {
+            if (text.substr(0, item.size()) != item)
+                return 0;
+            text.remove_prefix(item.size());
+            ++n;
+            if (text == tail)
+                return n;
+            if (text.substr(0, kListSep.size()) != kListSep)
+                return 0;
+            text.remove_prefix(kListSep.size());
+        }
+    }
+}
+
+std::string sql::InsertUsers(size_t rows) {
+    std::string q(kInsertUsersPrefix);
+    q.reserve(q.size() + rows * (kInsertTuple.size() + kListSep.size()));
+    for (size_t i = 0; i < rows; i++) {
+        if (i) q += kListSep;
+        q += kInsertTuple;
+    }
+    return q;
+}
+
+std::string sql::DeleteUsers(size_t rows) {
+    std::string q(kDeleteUsersPrefix);
+    q.reserve(q.size() + rows * 3 + 1);
+    for (size_t i = 0; i < rows; i++) {
+        if (i) q += kListSep;
+        q += '?';
+    }
+    q += ')';
+    return q;
+}
+
+// --------------------- WriteAheadLog ---------------------
+namespace {
+    constexpr size_t kWalHeader = 2 * sizeof(uint32_t);
+    constexpr size_t kWalFixedPayload = 1 + 3 * sizeof(uint16_t);
+}
+
+void WriteAheadLog::Encode(std::string& out, WalOp op, std::string_view username,
+                           std::string_view password, std::string_view role) {
+    size_t start = out.size();
+    uint32_t length = static_cast<uint32_t>(kWalFixedPayload + username.size() + password.size() + role.size());
+    AppendRaw(out, length);
+    AppendRaw(out, uint32_t(0));    // CRC, patched below
+    out += static_cast<char>(op);
+    assert(username.size() <= kMaxFieldBytes && password.size() <= kMaxFieldBytes && role.size() <= kMaxFieldBytes);
+    AppendRaw(out, static_cast<uint16_t>(username.size()));
+    AppendRaw(out, static_cast<uint16_t>(password.size()));
+    AppendRaw(out, static_cast<uint16_t>(role.size()));
+    out += username;
+    out += password;
+    out += role;
+    uint32_t crc = Crc32(out.data() + start + kWalHeader, length);
+    std::memcpy(out.data() + start + sizeof(uint32_t), &crc, sizeof(crc));
+}
+
+void WriteAheadLog::EncodeMark(std::string& out, uint32_t generation) {
+    Encode(out, WalOp::Mark, std::string_view(reinterpret_cast<const char*>(&generation), sizeof(generation)));
+}
+
+size_t WriteAheadLog::Recover(const std::string& path, UserStore& store, uint32_t snapshotMark, uint32_t& lastMark) {
+    int in = ::open(path.c_str(), O_RDONLY);
+    if (in < 0)
+        return 0;
+    std::string data;
+    char chunk[1 << 16];
+    ssize_t n;
+    while ((n = ::read(in, chunk, sizeof(chunk))) > 0)
+        data.append(chunk, static_cast<size_t>(n));
+    ::close(in);
+
+    size_t pos = 0;
+    size_t applied = 0;
+    uint32_t generation = 0;    // of the records being read: the last mark before them
+    lastMark = 0;
+    while (data.size() - pos >= kWalHeader) {
+        uint32_t length = ReadRaw<uint32_t>(data.data() + pos);
+        uint32_t crc = ReadRaw<uint32_t>(data.data() + pos + sizeof(uint32_t));
+        if (length < kWalFixedPayload || data.size() - pos - kWalHeader < length)
+            break;
+        const char* p = data.data() + pos + kWalHeader;
+        if (Crc32(p, length) != crc)
+            break;
+        WalOp op = static_cast<WalOp>(p[0]);
+        size_t ulen = ReadRaw<uint16_t>(p + 1);
+        size_t plen = ReadRaw<uint16_t>(p + 3);
+        size_t rlen = ReadRaw<uint16_t>(p + 5);
+        if (kWalFixedPayload + ulen + plen + rlen != length)
+            break;
+        std::string_view username(p + kWalFixedPayload, ulen);
+        std::string_view password(p + kWalFixedPayload + ulen, plen);
+        std::string_view role(p + kWalFixedPayload + ulen + plen, rlen);
+        if (op == WalOp::Mark) {
+            if (ulen != sizeof(generation))
+                break;
+            generation = ReadRaw<uint32_t>(username.data());
+            lastMark = std::max(lastMark, generation);
+            pos += kWalHeader + length;
+            continue;
+        }
+        pos += kWalHeader + length;
+        if (generation < snapshotMark)
+            continue;   // already in the snapshot
+
+        switch (op) {
+        case WalOp::Insert:
+            store.Insert(User{ std::string(username), std::string(password), std::string(role) });
+            break;
+        case WalOp::UpdatePassword:
+            store.SetPassword(username, password);
+            break;
+        case WalOp::Delete:
+            store.Erase(username);
+            break;
+        case WalOp::Put:
+            store.Put(User{ std::string(username), std::string(password), std::string(role) });
+            break;
+        case WalOp::ChangeRole:
+            // its own statement: the remap must only cover rows written before it
+            store.Publish();
+            store.ChangeRole(username, role);
+            store.Publish();
+            break;
+        case WalOp::Mark:
+            break;
+        }
+        ++applied;
+    }
+    store.Publish();
+
+    // anything past the last intact record is a torn write from a crash
+    if (pos < data.size() && ::truncate(path.c_str(), static_cast<off_t>(pos)) != 0)
+        std::cout << "Could not truncate torn write-ahead log tail in " << path << "\n";
+    return applied;
+}
+
+WriteAheadLog::WriteAheadLog(const std::string& path, std::chrono::microseconds window, size_t maxGroupBytes)
+    : path(path), window(window), maxGroupBytes(maxGroupBytes) {
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    groupFuture = group.get_future().share();
+    if (fd >= 0) {
+        struct stat st;
+        if (::fstat(fd, &st) == 0)
+            fileBytes.store(static_cast<uint64_t>(st.st_size), std::memory_order_relaxed);
+        committer = std::thread(&WriteAheadLog::CommitLoop, this);
+    }
+}
+
+WriteAheadLog::~WriteAheadLog() noexcept {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    if (committer.joinable())
+        committer.join();
+    if (fd >= 0)
+        ::close(fd);
+}
+
+std::shared_future<void> WriteAheadLog::Append(std::string_view records, size_t count) {
+    bool notify;
+    std::shared_future<void> commit;
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        bool wasIdle = pending.empty();
+        pending.append(records);
+        pendingRecords += count;
+        commit = groupFuture;
+        notify = wasIdle || pending.size() >= maxGroupBytes;
+    }
+    if (notify)
+        wake.notify_one();
+    return commit;
+}
+
+void WriteAheadLog::CommitLoop() {
+    std::string writing;
+    std::unique_lock<std::mutex> guard(mutex);
+    for (;;) {
+        wake.wait(guard, [this] { return stopping || !pending.empty(); });
+        if (pending.empty())
+            return;     // stopping with nothing left to commit
+
+        // let the group fill up for one window before closing it
+        if (window.count() > 0 && !stopping)
+            wake.wait_for(guard, window, [this] { return stopping || pending.size() >= maxGroupBytes; });
+        if (pending.empty())
+            continue;   // taken over by a Rewrite() during the window
+
+        writing.swap(pending);
+        size_t records = pendingRecords;
+        pendingRecords = 0;
+        std::promise<void> closing = std::move(group);
+        group = std::promise<void>();
+        groupFuture = group.get_future().share();
+        committing = true;
+        guard.unlock();
+
+        // After a failed write or sync the file's tail is unknown (a failed
+        // fdatasync may even have dropped earlier dirty pages), and a group
+        // appended behind torn bytes would be acknowledged and then cut off
+        // by Recover. So the first failure fails every later group too,
+        // until Rewrite replaces the file.
+        auto start = std::chrono::steady_clock::now();
+        bool ok = !failed && WriteAll(fd, writing.data(), writing.size()) && ::fdatasync(fd) == 0;
+        if (ok)
+            fileBytes.fetch_add(writing.size(), std::memory_order_relaxed);
+        else if (!failed) {
+            failed = true;
+            // best effort: keep acknowledged groups the last thing in the file
+            if (::ftruncate(fd, static_cast<off_t>(fileBytes.load(std::memory_order_relaxed))) == 0)
+                ::fdatasync(fd);
+        }
+        uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+        // stats first, so a caller released by this group sees it counted
+        guard.lock();
+        stats.records += records;
+        stats.groups += 1;
+        stats.bytes += writing.size();
+        stats.syncNanos += nanos;
+        committing = false;
+        guard.unlock();
+        idle.notify_all();
+        writing.clear();
+        if (ok)
+            closing.set_value();
+        else
+            closing.set_exception(std::make_exception_ptr(std::runtime_error("write-ahead log write failed")));
+        guard.lock();
+    }
+}
+
+bool WriteAheadLog::Rewrite(std::string_view records) {
+    std::unique_lock<std::mutex> guard(mutex);
+    idle.wait(guard, [this] { return !committing; });
+    if (!ReplaceFile(path, records))
+        return false;
+    int replaced = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (replaced < 0)
+        return false;
+    ::close(fd);
+    fd = replaced;
+    fileBytes.store(records.size(), std::memory_order_relaxed);
+    failed = false;     // the new file is synced and holds exactly 'records'
+
+    // the open group's records are part of 'records' and now on disk
+    pending.clear();
+    pendingRecords = 0;
+    group.set_value();
+    group = std::promise<void>();
+    groupFuture = group.get_future().share();
+    return true;
+}
+
+WalStats WriteAheadLog::Stats() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return stats;
+}
+
+// --------------------- DBConnection ---------------------
+DBConnection::DBConnection() : DBConnection(std::make_shared<UserStore>()) {}
+
+DBConnection::DBConnection(std::shared_ptr<UserStore> store) : store(std::move(store)) {
+    std::cout << "Database connection established.\n";
+}
+
+DBConnection::~DBConnection() noexcept {
+    std::cout << "Database connection closed.\n";
+}
+
+// Parses the statement text once into a kind and row count
+bool DBConnection::Compile(std::string_view query, PreparedStatement& stmt) {
+    using Kind = PreparedStatement::Kind;
+    const std::string_view insertPrefix = sql::kInsertUsersPrefix;
+    const std::string_view deletePrefix = sql::kDeleteUsersPrefix;
+
+    if (query.substr(0, insertPrefix.size()) == insertPrefix) {
+        size_t rows = CountListItems(query.substr(insertPrefix.size()), kInsertTuple, "");
+        stmt = { Kind::InsertUsers, rows, rows * 3 };
+        return rows != 0;
+    }
+    if (query == sql::kSelectUser) {
+        stmt = { Kind::SelectUser, 1, 1 };
+        return true;
+    }
+    if (query == sql::kUpdatePassword) {
+        stmt = { Kind::UpdatePassword, 1, 2 };
+        return true;
+    }
+    if (query == sql::kDeleteUser) {
+        stmt = { Kind::DeleteUser, 1, 1 };
+        return true;
+    }
+    if (query == sql::kChangeRole) {
+        stmt = { Kind::ChangeRole, 1, 2 };
+        return true;
+    }
+    if (query.substr(0, deletePrefix.size()) == deletePrefix) {
+        size_t rows = CountListItems(query.substr(deletePrefix.size()), "?", ")");
+        stmt = { Kind::DeleteUsers, rows, rows };
+        return rows != 0;
+    }
+    return false;
+}
+
+const PreparedStatement* DBConnection::prepare(const std::string& query) {
+    if (!cacheEnabled) {
+        cacheMisses.fetch_add(1, std::memory_order_relaxed);
+        PreparedStatement stmt{};
+        if (!Compile(query, stmt))
+            return nullptr;
+        auto& slot = uncached[uint64_t(stmt.kind) << 56 | stmt.rows];
+        if (!slot)
+            slot = std::make_unique<PreparedStatement>(stmt);
+        return slot.get();
+    }
+
+    auto it = statements.find(std::string_view(query));
+    if (it != statements.end()) {
+        cacheHits.fetch_add(1, std::memory_order_relaxed);
+        return it->second.get();
+    }
+
+    cacheMisses.fetch_add(1, std::memory_order_relaxed);
+    PreparedStatement stmt{};
+    if (!Compile(query, stmt))
+        return nullptr;
+    auto& slot = statements[query];
+    slot = std::make_unique<PreparedStatement>(stmt);
+    cacheEntries.store(statements.size(), std::memory_order_relaxed);
+    return slot.get();
+}
+
+StatementCacheStats DBConnection::statementCacheStats() const {
+    return { cacheHits.load(std::memory_order_relaxed), cacheMisses.load(std::memory_order_relaxed),
+             cacheEntries.load(std::memory_order_relaxed) };
+}
+
+bool DBConnection::execute(const std::string& query, const std::vector<std::string>& params) {
+    const PreparedStatement* stmt = prepare(query);
+    if (!stmt) {
+        lastChanges = 0;
+        std::cout << "Unsupported statement: " << query << "\n";
+        return false;
+    }
+    return execute(*stmt, params);
+}
+
+bool DBConnection::execute(const PreparedStatement& stmt, const std::vector<std::string>& params) {
+    return Execute(stmt, params);
+}
+
+bool DBConnection::execute(const PreparedStatement& stmt, const InlineParams& params) {
+    return Execute(stmt, params);
+}
+
+template <class Params>
+bool DBConnection::Execute(const PreparedStatement& stmt, const Params& params) {
+    // Parameters are bound as values, never spliced into the statement text
+    using Kind = PreparedStatement::Kind;
+    // reset first, so a rejected statement never leaves the last one's results behind
+    lastChanges = 0;
+    rowStatus.assign(stmt.rows, 0);
+    lastDurable = {};
+    if (params.size() != stmt.paramCount || stmt.kind == Kind::SelectUser)
+        return false;   // SELECTs go through query()
+    for (size_t i = 0; i < params.size(); i++)
+        if (std::string_view(params[i]).size() > kMaxFieldBytes)
+            return false;   // the WAL and snapshot formats could not encode it
+
+    UserStore& rows = *store;
+    std::unique_lock<std::shared_mutex> guard(store->lock);
+    switch (stmt.kind) {
+    case Kind::InsertUsers:
+        for (size_t i = 0; i < stmt.rows; i++)
+            rowStatus[i] = rows.Insert(User{ std::string(params[3 * i]), std::string(params[3 * i + 1]),
+                                             std::string(params[3 * i + 2]) });
+        break;
+    case Kind::UpdatePassword:
+        rowStatus[0] = rows.SetPassword(params[1], params[0]);
+        break;
+    case Kind::DeleteUser:
+    case Kind::DeleteUsers:
+        for (size_t i = 0; i < stmt.rows; i++)
+            rowStatus[i] = rows.Erase(params[i]);
+        break;
+    case Kind::ChangeRole:
+        // one statement however many users it moves
+        lastChanges = rows.ChangeRole(params[1], params[0]);
+        rowStatus[0] = lastChanges != 0;
+        break;
+    case Kind::SelectUser:
+        break;
+    }
+    if (stmt.kind != Kind::ChangeRole) {
+        for (uint8_t affected : rowStatus)
+            lastChanges += affected;
+    }
+    if (lastChanges)
+        rows.Publish();
+
+    // log the applied rows while still holding the store lock
+    if (store->wal && lastChanges) {
+        walRecords.clear();
+        size_t records = 0;
+        for (size_t i = 0; i < stmt.rows; i++) {
+            if (!rowStatus[i])
+                continue;
+            switch (stmt.kind) {
+            case Kind::InsertUsers:
+                WriteAheadLog::Encode(walRecords, WalOp::Insert, params[3 * i], params[3 * i + 1], params[3 * i + 2]);
+                break;
+            case Kind::UpdatePassword:
+                WriteAheadLog::Encode(walRecords, WalOp::UpdatePassword, params[1], params[0]);
+                break;
+            case Kind::ChangeRole:
+                WriteAheadLog::Encode(walRecords, WalOp::ChangeRole, params[1], {}, params[0]);
+                break;
+            default:
+                WriteAheadLog::Encode(walRecords, WalOp::Delete, params[i]);
+                break;
+            }
+            ++records;
+        }
+        lastDurable = store->wal->Append(walRecords, records);
+    }
+    return stmt.kind == Kind::ChangeRole || lastChanges == stmt.rows;
+}
+
+bool DBConnection::query(const std::string& query, const std::vector<std::string>& params, User& row) {
+    const PreparedStatement* stmt = prepare(query);
+    if (!stmt) {
+        std::cout << "Unsupported statement: " << query << "\n";
+        return false;
+    }
+    return this->query(*stmt, params, row);
+}
+
+bool DBConnection::query(const PreparedStatement& stmt, const std::vector<std::string>& params, User& row) {
+    return Query(stmt, params, row);
+}
+
+bool DBConnection::query(const PreparedStatement& stmt, const InlineParams& params, User& row) {
+    return Query(stmt, params, row);
+}
+
+template <class Params>
+bool DBConnection::Query(const PreparedStatement& stmt, const Params& params, User& row) {
+    if (stmt.kind != PreparedStatement::Kind::SelectUser || params.size() != stmt.paramCount)
+        return false;
+    std::shared_lock<std::shared_mutex> guard(store->lock, std::defer_lock);
+    if (!store->lockFreeReads)
+        guard.lock();
+    Epoch::Guard pin;
+    UserRef found;
+    if (!store->Lookup(params[0], found))
+        return false;
+    row.username = found.username;
+    row.password = found.password;
+    row.role = found.role;
+    return true;
+}
+
+// --------------------- ConnectionPool ---------------------
+ConnectionPool::Lease::Lease(Lease&& other) noexcept : pool(other.pool), conn(other.conn) {
+    other.pool = nullptr;
+    other.conn = nullptr;
+}
+
+ConnectionPool::Lease& ConnectionPool::Lease::operator=(Lease&& other) noexcept {
+    if (this != &other) {
+        if (conn)
+            pool->Release(conn);
+        pool = other.pool;
+        conn = other.conn;
+        other.pool = nullptr;
+        other.conn = nullptr;
+    }
+    return *this;
+}
+
+ConnectionPool::Lease::~Lease() noexcept {
+    if (conn)
+        pool->Release(conn);
+}
+
+ConnectionPool::ConnectionPool(std::shared_ptr<UserStore> store, size_t size, std::chrono::milliseconds timeout)
+    : timeout(timeout) {
+    if (size == 0)
+        size = 1;
+    connections.reserve(size);
+    idle.reserve(size);
+    for (size_t i = 0; i < size; i++) {
+        connections.push_back(std::make_unique<DBConnection>(store));
+        idle.push_back(connections.back().get());
+    }
+    stats.size = size;
+}
+
+ConnectionPool::~ConnectionPool() noexcept {
+    // every Lease must have been returned before the pool is destroyed
+    assert(idle.size() == connections.size());
+}
+
+ConnectionPool::Lease ConnectionPool::Acquire() {
+    return Acquire(timeout);
+}
+
+ConnectionPool::Lease ConnectionPool::Acquire(std::chrono::milliseconds wait) {
+    std::unique_lock<std::mutex> guard(mutex);
+    ++stats.acquires;
+    if (idle.empty()) {
+        ++stats.waits;
+        auto start = std::chrono::steady_clock::now();
+        bool ready = available.wait_for(guard, wait, [this] { return !idle.empty(); });
+        stats.totalWaitNanos += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        if (!ready) {
+            ++stats.timeouts;
+            return Lease();
+        }
+    }
+    DBConnection* conn = idle.back();
+    idle.pop_back();
+    stats.inUse = connections.size() - idle.size();
+    stats.peakInUse = std::max(stats.peakInUse, stats.inUse);
+    return Lease(this, conn);
+}
+
+void ConnectionPool::Release(DBConnection* conn) noexcept {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        idle.push_back(conn);
+        stats.inUse = connections.size() - idle.size();
+    }
+    available.notify_one();
+}
+
+PoolStats ConnectionPool::Stats() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return stats;
+}
+
+StatementCacheStats ConnectionPool::StatementStats() const {
+    StatementCacheStats total;
+    for (const auto& conn : connections) {
+        StatementCacheStats s = conn->statementCacheStats();
+        total.hits += s.hits;
+        total.misses += s.misses;
+        total.entries += s.entries;
+    }
+    return total;
+}
+
+// --------------------- Multi-buffer SHA-256 ---------------------
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SHA256MB_X86 1
+#include <immintrin.h>
+#endif
+
+namespace sha256mb {
+namespace {
+    constexpr uint32_t kRound[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+    constexpr uint32_t kInitial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    size_t BlockCount(size_t length) {
+        return (length + 9 + 63) / 64;   // message + 0x80 + 64-bit length, rounded up
+    }
+
+    // Writes block 'index' of the padded message into out[64]
+    void PadBlock(std::string_view msg, size_t index, unsigned char* out) {
+        size_t offset = index * 64;
+        size_t copy = offset < msg.size() ? std::min<size_t>(64, msg.size() - offset) : 0;
+        std::memcpy(out, msg.data() + offset, copy);
+        std::memset(out + copy, 0, 64 - copy);
+        if (offset + copy == msg.size() && copy < 64)
+            out[copy] = 0x80;
+        if (index + 1 == BlockCount(msg.size())) {
+            uint64_t bits = static_cast<uint64_t>(msg.size()) * 8;
+            for (int i = 0; i < 8; i++)
+                out[63 - i] = static_cast<unsigned char>(bits >> (8 * i));
+        }
+    }
+
+    uint32_t LoadBE32(const unsigned char* p) {
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+    }
+
+    void StoreBE32(unsigned char* p, uint32_t v) {
+        p[0] = static_cast<unsigned char>(v >> 24);
+        p[1] = static_cast<unsigned char>(v >> 16);
+        p[2] = static_cast<unsigned char>(v >> 8);
+        p[3] = static_cast<unsigned char>(v);
+    }
+
+#ifdef SHA256MB_X86
+    typedef uint32_t V4 __attribute__((vector_size(16)));
+    typedef uint32_t V8 __attribute__((vector_size(32)));
+    typedef uint32_t V16 __attribute__((vector_size(64)));
+
+    // a macro rather than a function: wide vectors must not cross a call
+    // boundary compiled without the matching ISA
+#define SHA256MB_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+    // Compresses up to 'Lanes' messages in lockstep. Written with GCC vector
+    // extensions and always inlined into the target-specific entry points
+    // below, so each instantiation is compiled for that entry point's ISA.
+    template <class V, size_t Lanes>
+    __attribute__((always_inline)) inline void HashLanes(const std::string_view* in, size_t count, unsigned char* out) {
+        alignas(64) unsigned char block[Lanes][64];
+        size_t blocks[Lanes];
+        size_t maxBlocks = 0;
+        for (size_t l = 0; l < Lanes; l++) {
+            blocks[l] = l < count ? BlockCount(in[l].size()) : 0;
+            maxBlocks = std::max(maxBlocks, blocks[l]);
+        }
+
+        V state[8];
+        for (int j = 0; j < 8; j++)
+            state[j] = V{} + kInitial[j];
+
+        for (size_t b = 0; b < maxBlocks; b++) {
+            V active{};
+            for (size_t l = 0; l < Lanes; l++) {
+                if (b < blocks[l]) {
+                    PadBlock(in[l], b, block[l]);
+                    active[l] = 0xFFFFFFFFu;
+                }
+            }
+
+            V w[16];
+            for (int t = 0; t < 16; t++)
+                for (size_t l = 0; l < Lanes; l++)
+                    w[t][l] = LoadBE32(block[l] + 4 * t);
+
+            V a = state[0], bb = state[1], c = state[2], d = state[3];
+            V e = state[4], f = state[5], g = state[6], h = state[7];
+            for (int t = 0; t < 64; t++) {
+                V wt;
+                if (t < 16) {
+                    wt = w[t];
+                }
+                else {
+                    V w15 = w[(t - 15) & 15], w2 = w[(t - 2) & 15];
+                    V s0 = SHA256MB_ROTR(w15, 7) ^ SHA256MB_ROTR(w15, 18) ^ (w15 >> 3);
+                    V s1 = SHA256MB_ROTR(w2, 17) ^ SHA256MB_ROTR(w2, 19) ^ (w2 >> 10);
+                    wt = w[t & 15] = w[t & 15] + s0 + w[(t - 7) & 15] + s1;
+                }
+                V S1 = SHA256MB_ROTR(e, 6) ^ SHA256MB_ROTR(e, 11) ^ SHA256MB_ROTR(e, 25);
+                V ch = (e & f) ^ (~e & g);
+                V t1 = h + S1 + ch + kRound[t] + wt;
+                V S0 = SHA256MB_ROTR(a, 2) ^ SHA256MB_ROTR(a, 13) ^ SHA256MB_ROTR(a, 22);
+                V maj = (a & bb) ^ (a & c) ^ (bb & c);
+                V t2 = S0 + maj;
+                h = g; g = f; f = e; e = d + t1;
+                d = c; c = bb; bb = a; a = t1 + t2;
+            }
+
+            // finished lanes keep their state
+            V add[8] = { a, bb, c, d, e, f, g, h };
+            for (int j = 0; j < 8; j++)
+                state[j] = ((state[j] + add[j]) & active) | (state[j] & ~active);
+        }
+
+        for (size_t l = 0; l < count; l++)
+            for (int j = 0; j < 8; j++)
+                StoreBE32(out + kDigestBytes * l + 4 * j, state[j][l]);
+    }
+
+    __attribute__((target("sse4.1"))) void HashX4(const std::string_view* in, size_t count, unsigned char* out) {
+        HashLanes<V4, 4>(in, count, out);
+    }
+
+    __attribute__((target("avx2"))) void HashX8(const std::string_view* in, size_t count, unsigned char* out) {
+        HashLanes<V8, 8>(in, count, out);
+    }
+
+    __attribute__((target("avx512f"))) void HashX16(const std::string_view* in, size_t count, unsigned char* out) {
+        HashLanes<V16, 16>(in, count, out);
+    }
+
+    __attribute__((target("ssse3"))) void HexSsse3(const unsigned char* bytes, size_t n, char* out) {
+        const __m128i digits = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7',
+                                             '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+        const __m128i nibble = _mm_set1_epi8(0x0F);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i));
+            __m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+            __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(v, nibble));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+        }
+        static constexpr char kHex[] = "0123456789abcdef";
+        for (; i < n; i++) {
+            out[2 * i] = kHex[bytes[i] >> 4];
+            out[2 * i + 1] = kHex[bytes[i] & 0x0F];
+        }
+    }
+#endif
+}
+
+Isa Detect() {
+    static const Isa isa = [] {
+#ifdef SHA256MB_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return Isa::AVX512;
+        if (__builtin_cpu_supports("avx2"))
+            return Isa::AVX2;
+        if (__builtin_cpu_supports("sse4.1"))
+            return Isa::SSE41;
+#endif
+        return Isa::Scalar;
+    }();
+    return isa;
+}
+
+size_t Lanes(Isa isa) {
+    switch (isa) {
+    case Isa::SSE41: return 4;
+    case Isa::AVX2: return 8;
+    case Isa::AVX512: return 16;
+    default: return 1;
+    }
+}
+
+const char* Name(Isa isa) {
+    switch (isa) {
+    case Isa::SSE41: return "sse4.1 x4";
+    case Isa::AVX2: return "avx2 x8";
+    case Isa::AVX512: return "avx512 x16";
+    default: return "scalar";
+    }
+}
+
+void Hash(std::span<const std::string_view> inputs, unsigned char* digests) {
+    Hash(inputs, digests, Detect());
+}
+
+void Hash(std::span<const std::string_view> inputs, unsigned char* digests, Isa isa) {
+    size_t lanes = Lanes(isa);
+    for (size_t i = 0; i < inputs.size(); i += lanes) {
+        size_t n = std::min(lanes, inputs.size() - i);
+        unsigned char* out = digests + kDigestBytes * i;
+        switch (isa) {
+#ifdef SHA256MB_X86
+        case Isa::SSE41: HashX4(&inputs[i], n, out); break;
+        case Isa::AVX2: HashX8(&inputs[i], n, out); break;
+        case Isa::AVX512: HashX16(&inputs[i], n, out); break;
+#endif
+        default:
+            SHA256(reinterpret_cast<const unsigned char*>(inputs[i].data()), inputs[i].size(), out);
+            break;
+        }
+    }
+}
+
+void HexEncode(const unsigned char* bytes, size_t n, char* out) {
+#ifdef SHA256MB_X86
+    static const bool ssse3 = (__builtin_cpu_init(), __builtin_cpu_supports("ssse3"));
+    if (ssse3) {
+        HexSsse3(bytes, n, out);
+        return;
+    }
+#endif
+    static constexpr char kHex[] = "0123456789abcdef";
+    for (size_t i = 0; i < n; i++) {
+        out[2 * i] = kHex[bytes[i] >> 4];
+        out[2 * i + 1] = kHex[bytes[i] & 0x0F];
+    }
+}
+}
+
+// --------------------- FieldCipher ---------------------
+namespace {
+    // One encrypt and one decrypt context per thread, reused by every
+    // cipher: each call loads its own key, so nothing leaks between them
+    struct GcmContexts {
+        EVP_CIPHER_CTX* seal = EVP_CIPHER_CTX_new();
+        EVP_CIPHER_CTX* open = EVP_CIPHER_CTX_new();
+        ~GcmContexts() {
+            EVP_CIPHER_CTX_free(seal);
+            EVP_CIPHER_CTX_free(open);
+        }
+    };
+
+    GcmContexts& ThreadGcm() {
+        thread_local GcmContexts contexts;
+        if (!contexts.seal || !contexts.open)
+            throw std::bad_alloc();
+        return contexts;
+    }
+
+    const unsigned char* Bytes(std::string_view s) {
+        return reinterpret_cast<const unsigned char*>(s.data());
+    }
+}
+
+FieldCipher::Key FieldCipher::GenerateKey() {
+    Key k;
+    if (RAND_bytes(k.data(), static_cast<int>(k.size())) != 1)
+        throw std::runtime_error("FieldCipher: no randomness for a key");
+    return k;
+}
+
+FieldCipher::FieldCipher(const Key& key) : key(key) {}
+
+FieldCipher::~FieldCipher() noexcept {
+    OPENSSL_cleanse(key.data(), key.size());
+}
+
+bool FieldCipher::Seal(std::string_view plain, std::string_view aad, char* out) {
+    size_t offsets[2];
+    return SealBatch({ &plain, 1 }, aad.empty() ? std::span<const std::string_view>() : std::span(&aad, 1), out,
+                     offsets) == 1;
+}
+
+bool FieldCipher::Open(std::string_view sealed, std::string_view aad, char* out) {
+    size_t offsets[2];
+    bool opened = false;
+    OpenBatch({ &sealed, 1 }, aad.empty() ? std::span<const std::string_view>() : std::span(&aad, 1), out, offsets,
+              &opened);
+    return opened;
+}
+
+size_t FieldCipher::SealedBytes(std::span<const std::string_view> plain) {
+    size_t total = 0;
+    for (std::string_view p : plain)
+        total += SealedSize(p.size());
+    return total;
+}
+
+size_t FieldCipher::OpenedBytes(std::span<const std::string_view> sealed) {
+    size_t total = 0;
+    for (std::string_view s : sealed)
+        total += s.size() > kOverhead ? s.size() - kOverhead : 0;
+    return total;
+}
+
+size_t FieldCipher::SealBatch(std::span<const std::string_view> plain, std::span<const std::string_view> aad,
+                              char* out, std::span<size_t> offsets) {
+    assert(aad.empty() || aad.size() == plain.size());
+    assert(offsets.size() > plain.size());
+    EVP_CIPHER_CTX* ctx = ThreadGcm().seal;
+    offsets[0] = 0;
+    if (EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr, key.data(), nullptr) != 1)
+        return 0;
+    // count the batch against the key's budget with one atomic add
+    if (seals.fetch_add(plain.size(), std::memory_order_relaxed) + plain.size() > kMaxSeals)
+        return 0;
+    // and draw all of its nonces with one call to the generator
+    thread_local std::vector<unsigned char> nonces;
+    nonces.resize(plain.size() * kNonceBytes);
+    if (!nonces.empty() && RAND_bytes(nonces.data(), static_cast<int>(nonces.size())) != 1)
+        return 0;
+    size_t at = 0;
+    for (size_t i = 0; i < plain.size(); i++) {
+        unsigned char* nonce = reinterpret_cast<unsigned char*>(out + at);
+        unsigned char* body = nonce + kNonceBytes;
+        unsigned char* tag = body + plain[i].size();
+        std::memcpy(nonce, nonces.data() + kNonceBytes * i, kNonceBytes);
+        int len = 0;
+        bool ok = EVP_EncryptInit_ex(ctx, nullptr, nullptr, nullptr, nonce) == 1;
+        if (ok && !aad.empty() && !aad[i].empty())
+            ok = EVP_EncryptUpdate(ctx, nullptr, &len, Bytes(aad[i]), static_cast<int>(aad[i].size())) == 1;
+        if (ok && !plain[i].empty())
+            ok = EVP_EncryptUpdate(ctx, body, &len, Bytes(plain[i]), static_cast<int>(plain[i].size())) == 1;
+        ok = ok && EVP_EncryptFinal_ex(ctx, tag, &len) == 1
+            && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, static_cast<int>(kTagBytes), tag) == 1;
+        if (!ok)
+            return i;
+        at += SealedSize(plain[i].size());
+        offsets[i + 1] = at;
+    }
+    return plain.size();
+}
+
+size_t FieldCipher::OpenBatch(std::span<const std::string_view> sealed, std::span<const std::string_view> aad,
+                              char* out, std::span<size_t> offsets, bool* opened) {
+    assert(aad.empty() || aad.size() == sealed.size());
+    assert(offsets.size() > sealed.size());
+    EVP_CIPHER_CTX* ctx = ThreadGcm().open;
+    bool keyed = EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), nullptr, key.data(), nullptr) == 1;
+    size_t count = 0;
+    size_t at = 0;
+    offsets[0] = 0;
+    for (size_t i = 0; i < sealed.size(); i++) {
+        std::string_view in = sealed[i];
+        size_t bodyBytes = in.size() >= kOverhead ? in.size() - kOverhead : 0;
+        unsigned char* body = reinterpret_cast<unsigned char*>(out + at);
+        bool ok = keyed && in.size() >= kOverhead;
+        if (ok) {
+            const unsigned char* nonce = Bytes(in);
+            unsigned char tag[kTagBytes];   // the ctrl call takes a non-const pointer
+            std::memcpy(tag, nonce + kNonceBytes + bodyBytes, kTagBytes);
+            int len = 0;
+            ok = EVP_DecryptInit_ex(ctx, nullptr, nullptr, nullptr, nonce) == 1;
+            if (ok && !aad.empty() && !aad[i].empty())
+                ok = EVP_DecryptUpdate(ctx, nullptr, &len, Bytes(aad[i]), static_cast<int>(aad[i].size())) == 1;
+            if (ok && bodyBytes)
+                ok = EVP_DecryptUpdate(ctx, body, &len, nonce + kNonceBytes, static_cast<int>(bodyBytes)) == 1;
+            ok = ok && EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, static_cast<int>(kTagBytes), tag) == 1
+                && EVP_DecryptFinal_ex(ctx, body + bodyBytes, &len) == 1;
+        }
+        if (!ok)
+            OPENSSL_cleanse(body, bodyBytes);
+        opened[i] = ok;
+        count += ok;
+        at += bodyBytes;
+        offsets[i + 1] = at;
+    }
+    return count;
+}
+
+size_t FieldCipher::SealColumn(std::span<User> users, std::string User::* column) {
+    assert(column != &User::username);     // the username is the associated data
+    std::vector<std::string_view> plain;
+    std::vector<std::string_view> aad;
+    plain.reserve(users.size());
+    aad.reserve(users.size());
+    for (const User& u : users) {
+        plain.push_back(u.*column);
+        aad.push_back(u.username);
+    }
+    std::string out(SealedBytes(plain), '\0');
+    std::vector<size_t> offsets(users.size() + 1);
+    size_t sealed = SealBatch(plain, aad, out.data(), offsets);
+    for (size_t i = 0; i < sealed; i++)
+        (users[i].*column).assign(out, offsets[i], offsets[i + 1] - offsets[i]);
+    OPENSSL_cleanse(out.data(), out.size());
+    return sealed;
+}
+
+size_t FieldCipher::OpenColumn(std::span<User> users, std::string User::* column) {
+    assert(column != &User::username);
+    std::vector<std::string_view> sealed;
+    std::vector<std::string_view> aad;
+    sealed.reserve(users.size());
+    aad.reserve(users.size());
+    for (const User& u : users) {
+        sealed.push_back(u.*column);
+        aad.push_back(u.username);
+    }
+    std::string out(OpenedBytes(sealed), '\0');
+    std::vector<size_t> offsets(users.size() + 1);
+    std::unique_ptr<bool[]> opened(new bool[users.size()]);
+    size_t count = OpenBatch(sealed, aad, out.data(), offsets, opened.get());
+    for (size_t i = 0; i < users.size(); i++)
+        if (opened[i])
+            (users[i].*column).assign(out, offsets[i], offsets[i + 1] - offsets[i]);
+    OPENSSL_cleanse(out.data(), out.size());
+    return count;
+}
+
+// --------------------- AuditLog ---------------------
+// Appends records to the binary block file; only the writer thread touches it
+struct AuditLog::BinarySink {
+    int fd = -1;
+    uint64_t block = 0;             // index of the block being filled
+    uint32_t flushed = 0;           // records of that block already on disk
+    uint64_t lastTimestamp = 0;
+    bool failing = false;           // the last write failed; reported once per run of failures
+    auditfile::BlockHeader header{};
+    std::unique_ptr<auditfile::Record[]> records{ new auditfile::Record[auditfile::kRecordsPerBlock] };
+
+    ~BinarySink() {
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    // Picks up a partly filled last block so a restart keeps appending to it
+    bool Open(const std::string& path) {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+            return false;
+        size_t size = static_cast<size_t>(st.st_size);
+        StartBlock(0);
+        if (size == 0)
+            return true;
+        uint64_t last = (size - 1) / auditfile::kBlockBytes;
+        off_t at = static_cast<off_t>(last * auditfile::kBlockBytes);
+        auditfile::BlockHeader h;
+        if (::pread(fd, &h, sizeof(h), at) != static_cast<ssize_t>(sizeof(h)) || h.magic != auditfile::kMagic)
+            return false;   // not ours; never write into it
+        size_t onDisk = (size - static_cast<size_t>(at) - sizeof(h)) / sizeof(auditfile::Record);
+        uint32_t count = static_cast<uint32_t>(std::min<size_t>({ h.count, onDisk, auditfile::kRecordsPerBlock }));
+        lastTimestamp = h.maxTimestamp;
+        if (count == auditfile::kRecordsPerBlock) {
+            StartBlock(last + 1);
+            return true;
+        }
+        size_t bytes = count * sizeof(auditfile::Record);
+        if (::pread(fd, records.get(), bytes, at + static_cast<off_t>(sizeof(h))) != static_cast<ssize_t>(bytes))
+            return false;
+        block = last;
+        header = h;
+        header.count = count;
+        flushed = count;
+        return true;
+    }
+
+    void StartBlock(uint64_t index) {
+        block = index;
+        flushed = 0;
+        header = auditfile::BlockHeader{};
+        header.magic = auditfile::kMagic;
+    }
+
+    // Records first, then the header that makes them visible. 'flushed'
+    // only moves once both are down, so after a failure the next call
+    // writes the same records again
+    bool WriteBlock() {
+        off_t at = static_cast<off_t>(block * auditfile::kBlockBytes);
+        size_t bytes = (header.count - flushed) * sizeof(auditfile::Record);
+        off_t recordsAt = at + static_cast<off_t>(sizeof(header) + flushed * sizeof(auditfile::Record));
+        if (!WriteAllAt(fd, records.get() + flushed, bytes, recordsAt) || !WriteAllAt(fd, &header, sizeof(header), at)) {
+            if (!failing)
+                std::cout << "Binary audit log write failed: " << std::strerror(errno) << "\n";
+            failing = true;
+            return false;
+        }
+        failing = false;
+        flushed = header.count;
+        return true;
+    }
+
+    // 'batch' is sorted; timestamps are clamped so the file stays in order
+    // even when a producer was preempted after stamping, or the clock stepped back.
+    // Returns the records lost because a full block could still not be written
+    uint64_t Append(std::vector<auditfile::Record>& batch) {
+        uint64_t lost = 0;
+        for (auditfile::Record& r : batch) {
+            // a full block is only left behind once it is on disk
+            if (header.count == auditfile::kRecordsPerBlock) {
+                if (flushed < header.count && !WriteBlock()) {
+                    lost++;
+                    continue;
+                }
+                StartBlock(block + 1);
+            }
+            r.timestampNanos = std::max(r.timestampNanos, lastTimestamp);
+            lastTimestamp = r.timestampNanos;
+            if (header.count == 0)
+                header.minTimestamp = r.timestampNanos;
+            header.maxTimestamp = r.timestampNanos;
+            header.opMask |= auditfile::OpBit(r.op);
+            header.roleMask |= auditfile::RoleBit(r.role);
+            header.kindMask |= auditfile::KindBit(r.kind);
+            records[header.count++] = r;
+            if (header.count == auditfile::kRecordsPerBlock && WriteBlock())
+                StartBlock(block + 1);
+        }
+        if (header.count > flushed)
+            WriteBlock();
+        return lost;
+    }
+};
+
+AuditLog::AuditLog(const std::string& path, size_t capacity, AuditOverflow overflow, AuditFormat format)
+    : overflow(overflow) {
+    size_t size = 2;
+    while (size < capacity)
+        size *= 2;
+    cells = std::make_unique<Cell[]>(size);
+    mask = size - 1;
+    for (size_t i = 0; i < size; i++)
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+
+    if (!path.empty() && format == AuditFormat::Binary) {
+        binary = std::make_unique<BinarySink>();
+        if (!binary->Open(path)) {
+            std::cout << "Could not open binary audit log " << path << ", using stdout\n";
+            binary.reset();
+        }
+    }
+    else if (!path.empty()) {
+        sink = std::fopen(path.c_str(), "a");
+        ownsSink = sink != nullptr;
+        if (!sink)
+            std::cout << "Could not open audit log " << path << ", using stdout\n";
+    }
+    if (!sink && !binary)
+        sink = stdout;
+    writer = std::thread(&AuditLog::WriterLoop, this);
+}
+
+AuditLog::~AuditLog() noexcept {
+    stopping.store(true, std::memory_order_release);
+    if (writer.joinable())
+        writer.join();
+    if (sink)
+        std::fflush(sink);
+    if (ownsSink)
+        std::fclose(sink);
+}
+
+bool AuditLog::Push(std::string_view message, AuditKind kind, uint8_t op, uint8_t role) {
+    uint64_t pos = head.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+        cell = &cells[pos & mask];
+        uint64_t seq = cell->sequence.load(std::memory_order_acquire);
+        int64_t diff = static_cast<int64_t>(seq) - static_cast<int64_t>(pos);
+        if (diff == 0) {
+            if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0) {
+            // ring full: the slot still holds a record from the previous lap
+            if (overflow == AuditOverflow::Drop) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            std::this_thread::yield();
+            pos = head.load(std::memory_order_relaxed);
+        }
+        else {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    AuditRecord& rec = cell->record;
+    rec.timestampNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    rec.length = static_cast<uint32_t>(std::min(message.size(), AuditRecord::kMaxText));
+    rec.kind = kind;
+    rec.op = op;
+    rec.role = role;
+    std::memcpy(rec.text, message.data(), rec.length);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+// Hands published records to 'emit' until it returns false (batch full); returns how many were taken
+template <class Emit>
+size_t AuditLog::Drain(Emit&& emit) {
+    uint64_t pos = consumed.load(std::memory_order_relaxed);
+    size_t taken = 0;
+    for (;;) {
+        Cell& cell = cells[pos & mask];
+        if (cell.sequence.load(std::memory_order_acquire) != pos + 1)
+            break;
+        bool more = emit(cell.record);
+        cell.sequence.store(pos + mask + 1, std::memory_order_release);
+        ++pos;
+        ++taken;
+        if (!more)
+            break;
+    }
+    return taken;
+}
+
+void AuditLog::WriterLoop() {
+    std::string buffer;
+    std::vector<auditfile::Record> batch;
+    auto text = [&](const AuditRecord& rec) {
+        char stamp[32];
+        int n = std::snprintf(stamp, sizeof(stamp), "[LOG] %llu.%03llu ",
+            static_cast<unsigned long long>(rec.timestampNanos / 1000000000ull),
+            static_cast<unsigned long long>(rec.timestampNanos / 1000000ull % 1000ull));
+        buffer.append(stamp, n);
+        buffer.append(rec.text, rec.length);
+        buffer += '\n';
+        return buffer.size() < kBatchBytes;
+    };
+    auto record = [&](const AuditRecord& rec) {
+        auditfile::Record& r = batch.emplace_back();
+        r.timestampNanos = rec.timestampNanos;
+        r.kind = static_cast<uint8_t>(rec.kind);
+        r.op = rec.op;
+        r.role = rec.role;
+        r.length = static_cast<uint8_t>(std::min<size_t>(rec.length, auditfile::kTextBytes));
+        std::memcpy(r.text, rec.text, r.length);
+        std::memset(r.text + r.length, 0, auditfile::kTextBytes - r.length);
+        return batch.size() * sizeof(auditfile::Record) < kBatchBytes;
+    };
+    // a record of its own for drops since the last report, written with the batch that follows them
+    uint64_t reported = 0;
+    auto reportDrops = [&] {
+        uint64_t total = dropped.load(std::memory_order_relaxed);
+        if (total == reported)
+            return false;
+        AuditRecord rec;
+        rec.timestampNanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        int n = std::snprintf(rec.text, sizeof(rec.text), "AUDIT LOG OVERFLOW: %llu records dropped (%llu total)",
+            static_cast<unsigned long long>(total - reported), static_cast<unsigned long long>(total));
+        rec.length = static_cast<uint32_t>(n);
+        rec.kind = AuditKind::Failure;
+        rec.op = kAuditNoOp;
+        rec.role = kAuditNoRole;
+        reported = total;
+        if (binary)
+            record(rec);
+        else
+            text(rec);
+        return true;
+    };
+    buffer.reserve(kBatchBytes + 512);
+    batch.reserve(kBatchBytes / sizeof(auditfile::Record));
+    for (;;) {
+        bool last = stopping.load(std::memory_order_acquire);
+        size_t taken = binary ? Drain(record) : Drain(text);
+        bool overflowed = reportDrops();
+        if (taken || overflowed) {
+            if (binary) {
+                // slots are claimed before they are stamped, so a batch can be slightly out of order
+                std::stable_sort(batch.begin(), batch.end(), [](const auditfile::Record& a, const auditfile::Record& b) {
+                    return a.timestampNanos < b.timestampNanos;
+                });
+                lost.fetch_add(binary->Append(batch), std::memory_order_relaxed);
+                batch.clear();
+            }
+            else {
+                std::fwrite(buffer.data(), 1, buffer.size(), sink);
+                std::fflush(sink);
+                buffer.clear();
+            }
+            batches.fetch_add(1, std::memory_order_relaxed);
+            consumed.fetch_add(taken, std::memory_order_release);
+            continue;
+        }
+        // 'last' was read before the final drain, so nothing pushed before shutdown is lost
+        if (last)
+            return;
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+}
+
+void AuditLog::Flush() {
+    uint64_t target = head.load(std::memory_order_acquire);
+    while (consumed.load(std::memory_order_acquire) < target)
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+}
+
+AuditLogStats AuditLog::Stats() const {
+    return { consumed.load(std::memory_order_acquire), dropped.load(std::memory_order_relaxed),
+             batches.load(std::memory_order_relaxed), lost.load(std::memory_order_relaxed) };
+}
+
+// --------------------- UserCache ---------------------
+UserCache::UserCache(size_t capacityBytes, size_t shardCount) {
+    size_t n = 1;
+    while (n < shardCount)
+        n *= 2;
+    shards = std::make_unique<Shard[]>(n);
+    shardMask = n - 1;
+    shardCapacity = capacityBytes / n;
+}
+
+UserCache::Shard& UserCache::ShardFor(std::string_view username) const {
+    return shards[UserTable::Hash(username) & shardMask];
+}
+
+// Strings, the list node and the index node, roughly
+size_t UserCache::EntryBytes(const User& user) {
+    return sizeof(User) + 2 * sizeof(void*)
+        + user.username.capacity() + user.password.capacity() + user.role.capacity()
+        + sizeof(std::string_view) + sizeof(std::list<User>::iterator) + 2 * sizeof(void*);
+}
+
+bool UserCache::Get(std::string_view username, User& out, uint64_t& ticket) {
+    Shard& shard = ShardFor(username);
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    auto it = shard.index.find(username);
+    if (it == shard.index.end()) {
+        ++shard.misses;
+        ticket = shard.generation;
+        return false;
+    }
+    ++shard.hits;
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    out = *it->second;
+    return true;
+}
+
+void UserCache::Put(const User& user, uint64_t ticket) {
+    Shard& shard = ShardFor(user.username);
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    if (ticket != shard.generation || shard.index.count(user.username))
+        return;
+
+    shard.lru.push_front(user);
+    size_t size = EntryBytes(shard.lru.front());
+    if (size > shardCapacity) {
+        shard.lru.pop_front();
+        return;
+    }
+    shard.index.emplace(shard.lru.front().username, shard.lru.begin());
+    shard.bytes += size;
+
+    while (shard.bytes > shardCapacity) {
+        User& victim = shard.lru.back();
+        shard.bytes -= EntryBytes(victim);
+        shard.index.erase(victim.username);
+        shard.lru.pop_back();
+        ++shard.evictions;
+    }
+}
+
+void UserCache::Invalidate(std::string_view username) {
+    Shard& shard = ShardFor(username);
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    ++shard.generation;
+    auto it = shard.index.find(username);
+    if (it == shard.index.end())
+        return;
+    shard.bytes -= EntryBytes(*it->second);
+    shard.lru.erase(it->second);
+    shard.index.erase(it);
+    ++shard.invalidations;
+}
+
+void UserCache::InvalidateAll() {
+    for (size_t i = 0; i <= shardMask; i++) {
+        Shard& shard = shards[i];
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        ++shard.generation;
+        shard.invalidations += shard.lru.size();
+        shard.index.clear();
+        shard.lru.clear();
+        shard.bytes = 0;
+    }
+}
+
+UserCacheStats UserCache::Stats() const {
+    UserCacheStats total;
+    total.capacityBytes = shardCapacity * (shardMask + 1);
+    for (size_t i = 0; i <= shardMask; i++) {
+        std::lock_guard<std::mutex> guard(shards[i].mutex);
+        total.hits += shards[i].hits;
+        total.misses += shards[i].misses;
+        total.evictions += shards[i].evictions;
+        total.invalidations += shards[i].invalidations;
+        total.entries += shards[i].index.size();
+        total.bytes += shards[i].bytes;
+    }
+    return total;
+}
+
+// --------------------- CuckooFilter ---------------------
+namespace {
+    uint64_t Mix64(uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    uint64_t Hash64(std::string_view key) {
+        uint64_t h = 14695981039346656037ull;
+        for (unsigned char c : key) {
+            h ^= c;
+            h *= 1099511628211ull;
+        }
+        return Mix64(h);
+    }
+}
+
+CuckooFilter::CuckooFilter(size_t capacity, double falsePositiveRate) {
+    // eps ~= 2 * slots / 2^f  =>  f = log2(8 / eps)
+    bits = 4;
+    while (bits < 16 && std::ldexp(1.0, static_cast<int>(bits)) < 2.0 * kSlots / falsePositiveRate)
+        ++bits;
+
+    // size for ~95% occupancy at the requested capacity
+    size_t buckets = 1;
+    while (buckets * kSlots * 95 < capacity * 100)
+        buckets *= 2;
+    mask = buckets - 1;
+    fingerprints.assign(buckets * kSlots, 0);
+}
+
+void CuckooFilter::Locate(std::string_view key, uint16_t& fp, size_t& b1, size_t& b2) const {
+    uint64_t h = Hash64(key);
+    fp = static_cast<uint16_t>((h >> 32) % ((1u << bits) - 1) + 1);   // never 0 (empty)
+    b1 = h & mask;
+    b2 = AltBucket(b1, fp);
+}
+
+size_t CuckooFilter::AltBucket(size_t bucket, uint16_t fp) const {
+    return (bucket ^ Mix64(fp)) & mask;
+}
+
+bool CuckooFilter::TryPlace(size_t bucket, uint16_t fp) {
+    uint16_t* slots = &fingerprints[bucket * kSlots];
+    for (size_t i = 0; i < kSlots; i++) {
+        if (slots[i] == 0) {
+            slots[i] = fp;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CuckooFilter::Insert(std::string_view key) {
+    uint16_t fp;
+    size_t b1, b2;
+    Locate(key, fp, b1, b2);
+    if (TryPlace(b1, fp) || TryPlace(b2, fp)) {
+        ++items;
+        return true;
+    }
+
+    // relocate residents along a random walk; undo the walk if it runs out
+    std::vector<std::pair<size_t, size_t>> path;
+    size_t bucket = (rng & 1) ? b1 : b2;
+    uint16_t carry = fp;
+    for (int kick = 0; kick < kMaxKicks; kick++) {
+        rng = rng * 1664525u + 1013904223u;
+        size_t slot = (rng >> 16) % kSlots;
+        std::swap(carry, fingerprints[bucket * kSlots + slot]);
+        path.emplace_back(bucket, slot);
+        bucket = AltBucket(bucket, carry);
+        if (TryPlace(bucket, carry)) {
+            ++items;
+            return true;
+        }
+    }
+    for (auto it = path.rbegin(); it != path.rend(); ++it)
+        std::swap(carry, fingerprints[it->first * kSlots + it->second]);
+    return false;
+}
+
+bool CuckooFilter::Erase(std::string_view key) {
+    uint16_t fp;
+    size_t b1, b2;
+    Locate(key, fp, b1, b2);
+    for (size_t bucket : { b1, b2 }) {
+        uint16_t* slots = &fingerprints[bucket * kSlots];
+        for (size_t i = 0; i < kSlots; i++) {
+            if (slots[i] == fp) {
+                slots[i] = 0;
+                --items;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool CuckooFilter::MayContain(std::string_view key) const {
+    uint16_t fp;
+    size_t b1, b2;
+    Locate(key, fp, b1, b2);
+    const uint16_t* s1 = &fingerprints[b1 * kSlots];
+    const uint16_t* s2 = &fingerprints[b2 * kSlots];
+    return s1[0] == fp || s1[1] == fp || s1[2] == fp || s1[3] == fp
+        || s2[0] == fp || s2[1] == fp || s2[2] == fp || s2[3] == fp;
+}
+
+// --------------------- WorkStealingPool ---------------------
+namespace {
+    thread_local const WorkStealingPool* t_workerPool = nullptr;
+    thread_local size_t t_workerIndex = 0;
+}
+
+WorkStealingPool::WorkStealingPool(size_t threads) {
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    workers.reserve(threads);
+    for (size_t i = 0; i < threads; i++)
+        workers.push_back(std::make_unique<Worker>());
+    // every deque exists before any thread can try to steal from it
+    for (size_t i = 0; i < threads; i++)
+        workers[i]->thread = std::thread(&WorkStealingPool::WorkerLoop, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool() noexcept {
+    {
+        std::lock_guard<std::mutex> guard(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    // workers leave only once every queue is empty
+    for (auto& w : workers)
+        w->thread.join();
+}
+
+bool WorkStealingPool::InWorker() const {
+    return t_workerPool == this;
+}
+
+void WorkStealingPool::Submit(Task task) {
+    // a task submitted from a worker stays on that worker's deque
+    size_t target = InWorker() ? t_workerIndex : nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+    {
+        std::lock_guard<std::mutex> guard(workers[target]->mutex);
+        workers[target]->tasks.push_back(Queued{ std::move(task), std::chrono::steady_clock::now() });
+    }
+    submitted.fetch_add(1, std::memory_order_relaxed);
+    size_t depth = pending.fetch_add(1) + 1;
+    size_t peak = peakPending.load(std::memory_order_relaxed);
+    while (depth > peak && !peakPending.compare_exchange_weak(peak, depth, std::memory_order_relaxed)) {}
+    // pairs with the sleeper count in WorkerLoop: either the worker sees
+    // 'pending' before it waits, or we see it asleep and wake it
+    if (sleepers.load() > 0) {
+        { std::lock_guard<std::mutex> guard(sleepMutex); }
+        wake.notify_one();
+    }
+}
+
+// Oldest task from our own deque first, so queued logins finish in
+// roughly the order they came in; otherwise the newest from a neighbour
+bool WorkStealingPool::Take(size_t self, Queued& out) {
+    {
+        Worker& own = *workers[self];
+        std::lock_guard<std::mutex> guard(own.mutex);
+        if (!own.tasks.empty()) {
+            out = std::move(own.tasks.front());
+            own.tasks.pop_front();
+            pending.fetch_sub(1);
+            return true;
+        }
+    }
+    for (size_t k = 1; k < workers.size(); k++) {
+        Worker& victim = *workers[(self + k) % workers.size()];
+        std::lock_guard<std::mutex> guard(victim.mutex);
+        if (!victim.tasks.empty()) {
+            out = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+            pending.fetch_sub(1);
+            steals.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::WorkerLoop(size_t self) {
+    t_workerPool = this;
+    t_workerIndex = self;
+    Queued task;
+    for (;;) {
+        if (Take(self, task)) {
+            auto waited = std::chrono::steady_clock::now() - task.queued;
+            waitNanos.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(waited).count(),
+                                std::memory_order_relaxed);
+            task.run();
+            task.run = nullptr;     // release captures before sleeping
+            completed.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        std::unique_lock<std::mutex> guard(sleepMutex);
+        if (pending.load() > 0) {
+            // a task is between its push and a thief's pop; look again
+            guard.unlock();
+            std::this_thread::yield();
+            continue;
+        }
+        if (stopping)
+            return;
+        sleepers.fetch_add(1);
+        wake.wait(guard, [&] { return pending.load() > 0 || stopping; });
+        sleepers.fetch_sub(1);
+    }
+}
+
+WorkPoolStats WorkStealingPool::Stats() const {
+    WorkPoolStats st;
+    st.threads = workers.size();
+    st.workerDepths.reserve(workers.size());
+    for (const auto& w : workers) {
+        std::lock_guard<std::mutex> guard(w->mutex);
+        st.workerDepths.push_back(w->tasks.size());
+        st.queueDepth += w->tasks.size();
+    }
+    st.peakQueueDepth = peakPending.load(std::memory_order_relaxed);
+    st.submitted = submitted.load(std::memory_order_relaxed);
+    st.completed = completed.load(std::memory_order_relaxed);
+    st.steals = steals.load(std::memory_order_relaxed);
+    st.queueWaitNanos = waitNanos.load(std::memory_order_relaxed);
+    return st;
+}
+
+// --------------------- Metrics ---------------------
+const char* DbOpName(DbOp op) {
+    static constexpr const char* kNames[] = {
+        "AddUser", "GetUser", "UpdatePassword", "DeleteUser", "AddUsers", "DeleteUsers", "SelectUsers", "ListUsers",
+        "ListUsersByRole", "ChangeRole", "ImportUsers", "ExportUsers", "VerifyPassword", "Compact", "Encrypt", "Authorized"
+    };
+    static_assert(std::size(kNames) == kDbOpCount, "one name per DbOp, in DbOp order");
+    return static_cast<size_t>(op) < kDbOpCount ? kNames[static_cast<size_t>(op)] : "?";
+}
+
+uint64_t LatencyHistogram::BucketLow(size_t bucket) {
+    if (bucket < (size_t(1) << kSubBits))
+        return bucket;
+    int shift = static_cast<int>(bucket >> kSubBits) - 1;
+    return (uint64_t((size_t(1) << kSubBits) | (bucket & ((size_t(1) << kSubBits) - 1)))) << shift;
+}
+
+uint64_t LatencyHistogram::BucketWidth(size_t bucket) {
+    if (bucket < (size_t(1) << kSubBits))
+        return 1;
+    return uint64_t(1) << ((bucket >> kSubBits) - 1);
+}
+
+void LatencyHistogram::Record(uint64_t nanos) {
+    counts[Bucket(nanos)]++;
+    count++;
+    sum += nanos;
+    max = std::max(max, nanos);
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < kBuckets; i++)
+        counts[i] += other.counts[i];
+    count += other.count;
+    sum += other.sum;
+    max = std::max(max, other.max);
+}
+
+uint64_t LatencyHistogram::Percentile(double fraction) const {
+    if (!count)
+        return 0;
+    uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * double(count))));
+    uint64_t seen = 0;
+    for (size_t i = 0; i + 1 < kBuckets; i++) {
+        seen += counts[i];
+        if (seen >= target)
+            return std::min(max, BucketLow(i) + BucketWidth(i) / 2);
+    }
+    return max;     // the overflow bucket
+}
+
+DatabaseStats& DatabaseStats::operator+=(const DatabaseStats& other) {
+    sampleEvery = std::max(sampleEvery, other.sampleEvery);
+    for (size_t i = 0; i < kDbOpCount; i++) {
+        ops[i].calls += other.ops[i].calls;
+        ops[i].denied += other.ops[i].denied;
+        ops[i].failures += other.ops[i].failures;
+        ops[i].latency.Merge(other.ops[i].latency);
+    }
+    return *this;
+}
+
+namespace {
+    std::string FormatNanos(double nanos) {
+        char buf[32];
+        if (nanos < 1e4)
+            snprintf(buf, sizeof(buf), "%.0fns", nanos);
+        else if (nanos < 1e6)
+            snprintf(buf, sizeof(buf), "%.1fus", nanos / 1e3);
+        else if (nanos < 1e9)
+            snprintf(buf, sizeof(buf), "%.1fms", nanos / 1e6);
+        else
+            snprintf(buf, sizeof(buf), "%.1fs", nanos / 1e9);
+        return buf;
+    }
+}
+
+std::string DatabaseStats::ToText() const {
+    std::string text;
+    char line[256];
+    snprintf(line, sizeof(line), "%-16s %10s %8s %8s %9s %9s %9s %9s %9s %9s %9s\n", "operation", "calls", "denied",
+             "failures", "sampled", "mean", "p50", "p90", "p99", "p99.9", "max");
+    text += line;
+    for (size_t i = 0; i < kDbOpCount; i++) {
+        const OpStats& op = ops[i];
+        if (!op.calls)
+            continue;
+        const LatencyHistogram& h = op.latency;
+        snprintf(line, sizeof(line), "%-16s %10llu %8llu %8llu %9llu %9s %9s %9s %9s %9s %9s\n",
+                 DbOpName(static_cast<DbOp>(i)), static_cast<unsigned long long>(op.calls),
+                 static_cast<unsigned long long>(op.denied), static_cast<unsigned long long>(op.failures),
+                 static_cast<unsigned long long>(h.count), FormatNanos(h.Mean()).c_str(),
+                 FormatNanos(double(h.Percentile(0.5))).c_str(), FormatNanos(double(h.Percentile(0.9))).c_str(),
+                 FormatNanos(double(h.Percentile(0.99))).c_str(), FormatNanos(double(h.Percentile(0.999))).c_str(),
+                 FormatNanos(double(h.max)).c_str());
+        text += line;
+    }
+    return text;
+}
+
+std::string DatabaseStats::ToJson() const {
+    std::string json = "{\"sampleEvery\":" + std::to_string(sampleEvery) + ",\"operations\":{";
+    for (size_t i = 0; i < kDbOpCount; i++) {
+        const OpStats& op = ops[i];
+        const LatencyHistogram& h = op.latency;
+        char fields[512];
+        snprintf(fields, sizeof(fields),
+                 "%s\"%s\":{\"calls\":%llu,\"denied\":%llu,\"failures\":%llu,\"sampled\":%llu,\"meanNs\":%.1f,"
+                 "\"p50Ns\":%llu,\"p90Ns\":%llu,\"p99Ns\":%llu,\"p999Ns\":%llu,\"maxNs\":%llu}",
+                 i ? "," : "", DbOpName(static_cast<DbOp>(i)), static_cast<unsigned long long>(op.calls),
+                 static_cast<unsigned long long>(op.denied), static_cast<unsigned long long>(op.failures),
+                 static_cast<unsigned long long>(h.count), h.Mean(),
+                 static_cast<unsigned long long>(h.Percentile(0.5)), static_cast<unsigned long long>(h.Percentile(0.9)),
+                 static_cast<unsigned long long>(h.Percentile(0.99)), static_cast<unsigned long long>(h.Percentile(0.999)),
+                 static_cast<unsigned long long>(h.max));
+        json += fields;
+    }
+    json += "}}";
+    return json;
+}
+
+namespace {
+    // Owner-thread increment: a plain load and store, no locked instruction
+    inline void Bump(std::atomic<uint64_t>& counter, uint64_t by = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+    }
+
+    // Direct-mapped front for the shard lookup; trivially destructible so
+    // the hot path needs no TLS init guard
+    constexpr size_t kMetricsCacheSlots = 64;
+    struct MetricsCacheEntry {
+        uint64_t owner;
+        OpMetrics::Shard* shard;
+    };
+    thread_local MetricsCacheEntry t_metricsCache[kMetricsCacheSlots];
+    thread_local OpMetrics::Scope* t_activeScope = nullptr;
+
+    // Live recorders by id, so an exiting thread can hand its shards back
+    struct MetricsRegistry {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, OpMetrics*> live;
+        uint64_t nextId = 1;
+    };
+    MetricsRegistry& Registry() {
+        static MetricsRegistry* registry = new MetricsRegistry;     // outlives every thread's exit
+        return *registry;
+    }
+
+    // Every shard this thread holds; returned to the idle lists at exit
+    struct MetricsThreadState {
+        std::vector<MetricsCacheEntry> owned;
+        ~MetricsThreadState() noexcept {
+            MetricsRegistry& registry = Registry();
+            std::lock_guard<std::mutex> guard(registry.mutex);
+            for (const MetricsCacheEntry& e : owned) {
+                auto it = registry.live.find(e.owner);
+                if (it != registry.live.end())
+                    it->second->Release(e.shard);
+            }
+        }
+    };
+    thread_local MetricsThreadState t_metricsOwned;
+}
+
+OpMetrics::OpMetrics(uint32_t sampleEvery) : sampleEvery(std::max<uint32_t>(1, sampleEvery)) {
+    MetricsRegistry& registry = Registry();
+    std::lock_guard<std::mutex> guard(registry.mutex);
+    id = registry.nextId++;
+    registry.live.emplace(id, this);
+}
+
+OpMetrics::~OpMetrics() noexcept {
+    MetricsRegistry& registry = Registry();
+    std::lock_guard<std::mutex> guard(registry.mutex);
+    registry.live.erase(id);
+}
+
+inline OpMetrics::Shard& OpMetrics::Local() {
+    MetricsCacheEntry& e = t_metricsCache[id & (kMetricsCacheSlots - 1)];
+    if (e.owner == id) [[likely]]
+        return *e.shard;
+    return Register();
+}
+
+// Slow path: the thread's shard was evicted from the cache, or it has none yet
+OpMetrics::Shard& OpMetrics::Register() {
+    Shard* shard = nullptr;
+    for (const MetricsCacheEntry& e : t_metricsOwned.owned) {
+        if (e.owner == id) {
+            shard = e.shard;
+            break;
+        }
+    }
+    if (!shard) {
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            if (!idle.empty()) {
+                // a shard left by an exited thread keeps its counts
+                shard = idle.back();
+                idle.pop_back();
+            }
+            else {
+                shards.push_back(std::make_unique<Shard>());
+                shard = shards.back().get();
+            }
+        }
+        t_metricsOwned.owned.push_back(MetricsCacheEntry{ id, shard });
+    }
+    t_metricsCache[id & (kMetricsCacheSlots - 1)] = MetricsCacheEntry{ id, shard };
+    return *shard;
+}
+
+void OpMetrics::Release(Shard* shard) {
+    std::lock_guard<std::mutex> guard(mutex);
+    idle.push_back(shard);
+}
+
+void OpMetrics::Failed() {
+    if (t_activeScope)
+        Bump(t_activeScope->counters->failures);
+}
+
+namespace {
+    // Counts down to the next sampled call of one operation on this thread
+    inline bool Sampled(OpMetrics::Counters& c, uint32_t every) {
+        if (--c.untilSample != 0) [[likely]]
+            return false;
+        c.untilSample = every;
+        return true;
+    }
+
+    void RecordSample(OpMetrics::Counters& c, std::chrono::steady_clock::time_point start) noexcept {
+        uint64_t nanos = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        std::atomic<uint32_t>& bucket = c.buckets[LatencyHistogram::Bucket(nanos)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        Bump(c.sum, nanos);
+        if (nanos > c.max.load(std::memory_order_relaxed))
+            c.max.store(nanos, std::memory_order_relaxed);
+    }
+}
+
+inline OpMetrics::Scope::Scope(OpMetrics* metrics, DbOp op) {
+    if (!metrics)
+        return;
+    shard = &metrics->Local();
+    counters = &shard->ops[static_cast<size_t>(op)];
+    Bump(counters->calls);
+    outer = std::exchange(t_activeScope, this);
+    if (Sampled(*counters, metrics->sampleEvery)) {
+        timed = true;
+        start = std::chrono::steady_clock::now();
+    }
+}
+
+inline OpMetrics::Scope::~Scope() noexcept {
+    if (!counters)
+        return;
+    t_activeScope = outer;
+    if (timed) [[unlikely]]
+        RecordSample(*counters, start);
+}
+
+inline OpMetrics::Step::Step(OpMetrics* metrics, DbOp op) {
+    Scope* scope = t_activeScope;
+    if (!metrics || !scope)
+        return;
+    counters = &scope->shard->ops[static_cast<size_t>(op)];
+    Bump(counters->calls);
+    if (Sampled(*counters, metrics->sampleEvery)) {
+        timed = true;
+        start = std::chrono::steady_clock::now();
+    }
+}
+
+inline OpMetrics::Step::~Step() noexcept {
+    if (timed) [[unlikely]]
+        RecordSample(*counters, start);
+}
+
+inline OpMetrics::Check::Check(OpMetrics* metrics) {
+    if (!metrics || !t_activeScope)
+        return;
+    scope = t_activeScope;
+    Counters& c = *scope->counters;
+    Bump(c.checks);
+    if (--c.untilCheckSample == 0) [[unlikely]] {
+        c.untilCheckSample = metrics->sampleEvery;
+        timed = true;
+        start = std::chrono::steady_clock::now();
+    }
+}
+
+inline OpMetrics::Check::~Check() noexcept {
+    if (timed) [[unlikely]]
+        RecordSample(scope->shard->ops[static_cast<size_t>(DbOp::Authorized)], start);
+}
+
+void OpMetrics::Check::Deny() {
+    if (!scope)
+        return;
+    Bump(scope->counters->denied);
+    Bump(scope->shard->ops[static_cast<size_t>(DbOp::Authorized)].denied);
+}
+
+DatabaseStats OpMetrics::Snapshot() const {
+    DatabaseStats stats;
+    stats.sampleEvery = sampleEvery;
+    std::lock_guard<std::mutex> guard(mutex);
+    for (const auto& shard : shards) {
+        for (size_t i = 0; i < kDbOpCount; i++) {
+            const Counters& c = shard->ops[i];
+            OpStats& op = stats.ops[i];
+            op.calls += c.calls.load(std::memory_order_relaxed);
+            stats[DbOp::Authorized].calls += c.checks.load(std::memory_order_relaxed);
+            op.denied += c.denied.load(std::memory_order_relaxed);
+            op.failures += c.failures.load(std::memory_order_relaxed);
+            LatencyHistogram& h = op.latency;
+            for (size_t b = 0; b < LatencyHistogram::kBuckets; b++) {
+                uint32_t n = c.buckets[b].load(std::memory_order_relaxed);
+                h.counts[b] += n;
+                h.count += n;
+            }
+            h.sum += c.sum.load(std::memory_order_relaxed);
+            h.max = std::max(h.max, c.max.load(std::memory_order_relaxed));
+        }
+    }
+    return stats;
+}
+
+// --------------------- Roles ---------------------
+Role ParseRole(std::string_view role) {
+    if (role == "admin") return Role::Admin;
+    if (role == "user") return Role::User;
+    return Role::Guest;
+}
+
+const char* RoleName(Role role) {
+    switch (role) {
+    case Role::Admin: return "admin";
+    case Role::User: return "user";
+    default: return "guest";
+    }
+}
+
+// --------------------- SecureDatabase ---------------------
+SecureDatabase::SecureDatabase() : SecureDatabase(SecureDatabaseOptions{}) {}
+
+namespace {
+    SecureDatabaseOptions PoolOptions(size_t poolSize, std::chrono::milliseconds acquireTimeout) {
+        SecureDatabaseOptions options;
+        options.poolSize = poolSize;
+        options.acquireTimeout = acquireTimeout;
+        return options;
+    }
+}
+
+SecureDatabase::SecureDatabase(size_t poolSize, std::chrono::milliseconds acquireTimeout)
+    : SecureDatabase(PoolOptions(poolSize, acquireTimeout)) {}
+
+SecureDatabase::SecureDatabase(const SecureDatabaseOptions& options) {
+    audit = options.auditLog ? options.auditLog
+                             : std::make_shared<AuditLog>(options.auditLogPath, options.auditCapacity, options.auditOverflow,
+                                                      options.auditFormat);
+    store = std::make_shared<UserStore>();
+    store->lockFreeReads = options.lockFreeReads;
+    // a copy: replaying the WAL may rebase the store onto a new view
+    std::shared_ptr<const Snapshot> snapshot;
+    if (!options.snapshotPath.empty()) {
+        // mapped, not loaded: rows are read straight from the file
+        snapshot = Snapshot::Open(options.snapshotPath);
+        store->view.load()->snapshot = snapshot;
+        // one pass now, so no ChangeRole or ListUsersByRole has to build it under the writer lock
+        store->IndexRoles();
+        snapshotPath = options.snapshotPath;
+        compactWalBytes = options.compactWalBytes;
+        if (!snapshot && ::access(options.snapshotPath.c_str(), F_OK) == 0) {
+            // never compact over a file we could not read
+            Log("Snapshot " + options.snapshotPath + " is corrupt or unreadable; starting without it");
+            snapshotPath.clear();
+        }
+    }
+    if (!options.walPath.empty()) {
+        // crash recovery: replay the log on top of the snapshot before anything can read the store
+        uint32_t logged = 0;
+        recovered = WriteAheadLog::Recover(options.walPath, *store, snapshot ? snapshot->WalMark() : 0, logged);
+        walMark = std::max(snapshot ? snapshot->WalMark() : 0, logged);
+        wal = std::make_unique<WriteAheadLog>(options.walPath, options.walGroupWindow, options.walMaxGroupBytes);
+        if (wal->IsOpen()) {
+            store->wal = wal.get();
+        }
+        else {
+            Log("Could not open write-ahead log " + options.walPath + "; mutations are not durable");
+            wal.reset();
+        }
+    }
+    pool = std::make_unique<ConnectionPool>(store, options.poolSize, options.acquireTimeout);
+    verifyThreads = options.verifyThreads;
+    verifyPool = options.verifyPool;
+    verifyWorkers = verifyPool.get();
+    if (options.metricsSampleEvery)
+        metrics = std::make_unique<OpMetrics>(options.metricsSampleEvery);
+    if (options.userCacheBytes)
+        cache = std::make_unique<UserCache>(options.userCacheBytes, options.userCacheShards);
+    if (options.usernameFilterFpr > 0.0) {
+        filterFpr = options.usernameFilterFpr;
+        filterCapacity = options.usernameFilterCapacity;
+        if (snapshot) {
+            // filling the filter means reading every row; do it off the startup path
+            filterBuildRequested = true;
+        }
+        else {
+            std::unique_lock<std::shared_mutex> guard(filterLock);
+            filter = BuildFilter(std::max(filterCapacity, store->view.load()->delta.Rows() * 2));
+        }
+    }
+    if (!snapshotPath.empty())
+        maintenance = std::thread(&SecureDatabase::MaintenanceLoop, this);
+
+    // prepared statements carry no connection state, so one set serves the whole pool
+    auto conn = pool->Acquire();
+    insertStmt = conn->prepare(sql::kInsertUser);
+    selectStmt = conn->prepare(sql::kSelectUser);
+    updateStmt = conn->prepare(sql::kUpdatePassword);
+    deleteStmt = conn->prepare(sql::kDeleteUser);
+}
+
+SecureDatabase::~SecureDatabase() noexcept {
+    {
+        // queued verifications still read the store and call back into us
+        std::unique_lock<std::mutex> guard(verifyMutex);
+        verifyIdle.wait(guard, [&] { return verifyInFlight == 0; });
+    }
+    {
+        std::lock_guard<std::mutex> guard(maintenanceMutex);
+        maintenanceStopping = true;
+    }
+    maintenanceWake.notify_all();
+    if (maintenance.joinable())
+        maintenance.join();
+    // drain and flush queued audit records before anything else goes away;
+    // RAII then cleans up the pool and its connections
+    audit.reset();
+}
+
+// SHA-256 encryption simulation
+std::string SecureDatabase::Encrypt(const std::string& plainText) {
+    std::string encrypted(kEncryptedLength, '\0');
+    EncryptTo(plainText, encrypted.data());
+    return encrypted;
+}
+
+// Hashes into a caller-provided buffer, so the CRUD paths can bind the result by view
+void SecureDatabase::EncryptTo(std::string_view plainText, char* hexOut) {
+    OpMetrics::Step step(metrics.get(), DbOp::Encrypt);
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256(reinterpret_cast<const unsigned char*>(plainText.data()), plainText.size(), hash);
+    sha256mb::HexEncode(hash, SHA256_DIGEST_LENGTH, hexOut);
+}
+
+void SecureDatabase::EncryptBatch(std::span<const std::string_view> plainTexts, char* hexOut) {
+    // hash in groups of 64 so the digest scratch stays on the stack
+    constexpr size_t kGroup = 64;
+    unsigned char digests[kGroup * sha256mb::kDigestBytes];
+    for (size_t i = 0; i < plainTexts.size(); i += kGroup) {
+        size_t n = std::min(kGroup, plainTexts.size() - i);
+        sha256mb::Hash(plainTexts.subspan(i, n), digests);
+        sha256mb::HexEncode(digests, n * sha256mb::kDigestBytes, hexOut + kEncryptedLength * i);
+    }
+}
+
+// --------------------- Username filter ---------------------
+bool SecureDatabase::MayExist(std::string_view username) const {
+    if (filterFpr == 0.0)
+        return true;
+    std::shared_lock<std::shared_mutex> guard(filterLock);
+    if (!filter || filter->MayContain(username))
+        return true;
+    filterRejected.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void SecureDatabase::MayExist(std::span<const std::string> usernames, std::vector<std::string>& out) const {
+    std::shared_lock<std::shared_mutex> guard(filterLock, std::defer_lock);
+    if (filterFpr != 0.0)
+        guard.lock();
+    for (const std::string& username : usernames) {
+        // no stored username is longer
+        if (username.size() > kMaxFieldBytes)
+            continue;
+        if (!filter || filter->MayContain(username))
+            out.push_back(username);
+        else
+            filterRejected.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void SecureDatabase::FilterInsert(std::string_view username) {
+    if (filterFpr == 0.0)
+        return;
+    std::unique_lock<std::shared_mutex> guard(filterLock);
+    InsertPending(username);
+}
+
+void SecureDatabase::FilterInsert(std::span<const User> rows) {
+    if (filterFpr == 0.0)
+        return;
+    std::unique_lock<std::shared_mutex> guard(filterLock);
+    for (const User& row : rows)
+        InsertPending(row.username);
+}
+
+void SecureDatabase::InsertPending(std::string_view username) {
+    auto it = filterPending.find(username);
+    if (it == filterPending.end())
+        it = filterPending.emplace(std::string(username), PendingKey{}).first;
+    PendingKey& key = it->second;
+    if (key.inserts++ || !filter)
+        return;     // already covered, or not built yet: the background build picks up pending keys
+    if (filter->MayContain(username)) {
+        // a stored row already has its fingerprint; FilterErase keeps it while this insert is in flight
+        std::shared_lock<std::shared_mutex> storeGuard(store->lock);
+        UserRef row;
+        if (store->Current(username, row))
+            return;
+    }
+    key.added = true;
+    if (filter->Insert(username))
+        return;
+
+    // full: rebuild at twice the capacity
+    filter = BuildFilter(filter->Capacity() * 2);
+    ++filterRebuilds;
+}
+
+// Builds a filter from the rows already stored plus every key whose insert
+// is still in flight, doubling the capacity until everything fits. Each key
+// goes in once per source, so a fit is only missed for want of space; the
+// doubling is still bounded, and the filter is switched off (every lookup
+// reaches the store) rather than grown without limit.
+std::unique_ptr<CuckooFilter> SecureDatabase::BuildFilter(size_t capacity) {
+    std::shared_lock<std::shared_mutex> storeGuard(store->lock);
+    for (int attempt = 0; attempt <= kMaxFilterGrowth; attempt++, capacity *= 2) {
+        auto built = std::make_unique<CuckooFilter>(capacity, filterFpr);
+        bool fits = true;
+        store->ForEach([&](const UserRef& r) { fits = fits && built->Insert(r.username); });
+        for (const auto& entry : filterPending)
+            fits = fits && built->Insert(entry.first);
+        if (fits) {
+            for (auto& entry : filterPending)
+                entry.second.added = true;
+            filterEpoch.fetch_add(1, std::memory_order_release);
+            return built;
+        }
+    }
+    Log("Username filter could not be rebuilt; negative lookups go to the store");
+    filterEpoch.fetch_add(1, std::memory_order_release);
+    return nullptr;
+}
+
+// Initial build after a snapshot is opened. Lookups skip the filter until
+// it is installed; the snapshot rows are read without holding any lock
+// (the file is immutable and compactions are held off), then the delta and
+// in-flight keys are added under the locks. Deleted snapshot rows stay in
+// as false positives.
+void SecureDatabase::BuildFilterInBackground() {
+    std::lock_guard<std::mutex> serial(compactMutex);
+    std::shared_ptr<const Snapshot> base;
+    {
+        std::shared_lock<std::shared_mutex> storeGuard(store->lock);
+        base = store->view.load()->snapshot;
+    }
+    size_t capacity = std::max(filterCapacity, base->Size() * 2);
+    for (int attempt = 0; attempt <= kMaxFilterGrowth; attempt++, capacity *= 2) {
+        auto built = std::make_unique<CuckooFilter>(capacity, filterFpr);
+        bool fits = true;
+        base->ForEach([&](const UserRef& r) { fits = fits && built->Insert(r.username); });
+
+        std::unique_lock<std::shared_mutex> guard(filterLock);
+        {
+            std::shared_lock<std::shared_mutex> storeGuard(store->lock);
+            store->view.load()->delta.ForEach([&](const UserVersion& v) {
+                if (!v.deleted && !base->Contains(v.row.username))
+                    fits = fits && built->Insert(v.row.username);
+            });
+        }
+        for (const auto& entry : filterPending)
+            fits = fits && built->Insert(entry.first);
+        if (fits) {
+            for (auto& entry : filterPending)
+                entry.second.added = true;
+            filter = std::move(built);
+            filterEpoch.fetch_add(1, std::memory_order_release);
+            return;
+        }
+    }
+    Log("Username filter could not be built; negative lookups go to the store");
+}
+
+// Ends an insert begun with FilterInsert. Once the last in-flight insert of
+// a name settles, a fingerprint it added is given back unless one of them
+// stored the row.
+void SecureDatabase::FilterSettle(std::string_view username, bool stored) {
+    if (filterFpr == 0.0)
+        return;
+    std::unique_lock<std::shared_mutex> guard(filterLock);
+    SettlePending(username, stored);
+}
+
+void SecureDatabase::FilterSettle(std::span<const User> rows, const std::vector<uint8_t>& stored) {
+    if (filterFpr == 0.0)
+        return;
+    std::unique_lock<std::shared_mutex> guard(filterLock);
+    for (size_t i = 0; i < rows.size(); i++)
+        SettlePending(rows[i].username, stored[i]);
+}
+
+void SecureDatabase::SettlePending(std::string_view username, bool stored) {
+    auto it = filterPending.find(username);
+    if (it == filterPending.end())
+        return;
+    PendingKey& key = it->second;
+    key.stored = key.stored || stored;
+    if (--key.inserts)
+        return;
+    bool giveBack = key.added && !key.stored;
+    filterPending.erase(it);
+    if (giveBack && filter)
+        filter->Erase(username);
+}
+
+// 'epoch' is FilterEpoch() read before the delete ran. A rebuild since then
+// may already have missed the row, and erasing again could drop another
+// key's fingerprint; leaving a stale one only costs a false positive. So
+// does skipping the erase while an insert of the name is in flight, which
+// may be relying on the row's fingerprint.
+void SecureDatabase::FilterErase(std::string_view username, uint64_t epoch) {
+    if (filterFpr == 0.0)
+        return;
+    std::unique_lock<std::shared_mutex> guard(filterLock);
+    EraseSettled(username, epoch);
+}
+
+void SecureDatabase::FilterErase(std::span<const std::string> usernames, const std::vector<uint8_t>& erased, uint64_t epoch) {
+    if (filterFpr == 0.0)
+        return;
+    std::unique_lock<std::shared_mutex> guard(filterLock);
+    for (size_t i = 0; i < usernames.size(); i++)
+        if (erased[i])
+            EraseSettled(usernames[i], epoch);
+}
+
+void SecureDatabase::EraseSettled(std::string_view username, uint64_t epoch) {
+    if (filter && epoch == filterEpoch.load(std::memory_order_relaxed) && filterPending.find(username) == filterPending.end())
+        filter->Erase(username);
+}
+
+FilterStats SecureDatabase::UsernameFilterStats() const {
+    FilterStats stats;
+    std::shared_lock<std::shared_mutex> guard(filterLock);
+    if (!filter)
+        return stats;
+    stats.items = filter->Size();
+    stats.bytes = filter->Bytes();
+    stats.fingerprintBits = filter->FingerprintBits();
+    stats.targetFalsePositiveRate = filterFpr;
+    stats.rejected = filterRejected.load(std::memory_order_relaxed);
+    stats.rebuilds = filterRebuilds;
+    return stats;
+}
+
+// Blocks until a mutation's WAL group is on disk; trivially true without a WAL
+bool SecureDatabase::AwaitDurable(const std::shared_future<void>& commit) {
+    if (!commit.valid())
+        return true;
+    try {
+        commit.get();
+        // the delta only grows through commits, so this is where compaction is scheduled
+        if (!snapshotPath.empty() && wal->Size() >= compactWalBytes) {
+            std::lock_guard<std::mutex> guard(maintenanceMutex);
+            compactRequested = true;
+            maintenanceWake.notify_one();
+        }
+        return true;
+    }
+    catch (const std::exception& e) {
+        Log(std::string("Durability failure: ") + e.what());
+        return false;
+    }
+}
+
+inline bool SecureDatabase::Authorized(const Session& session, Operation operation) {
+    OpMetrics::Check check(metrics.get());
+    if (session.Can(operation))
+        return true;
+    check.Deny();
+    return false;
+}
+
+// Simple logging (masking sensitive data); queued for the audit writer thread
+void SecureDatabase::Log(const std::string& message, DbOp op) {
+    OpMetrics::Failed();
+    audit->Push(message, AuditKind::Failure, op == DbOp::Count ? kAuditNoOp : static_cast<uint8_t>(op));
+}
+
+void SecureDatabase::LogDenied(DbOp op, const Session& session, const std::string& message) {
+    OpMetrics::Failed();
+    audit->Push(message, AuditKind::Denied, static_cast<uint8_t>(op), static_cast<uint8_t>(session.GetRole()));
+}
+
+// --------------------- Compaction ---------------------
+void SecureDatabase::MaintenanceLoop() {
+    std::unique_lock<std::mutex> guard(maintenanceMutex);
+    for (;;) {
+        maintenanceWake.wait(guard, [this] { return maintenanceStopping || compactRequested || filterBuildRequested; });
+        if (maintenanceStopping)
+            return;
+        bool build = std::exchange(filterBuildRequested, false);
+        bool compact = std::exchange(compactRequested, false);
+        guard.unlock();
+        if (build)
+            BuildFilterInBackground();
+        if (compact)
+            Compact();
+        guard.lock();
+    }
+}
+
+// Three steps, so neither readers nor writers wait on the snapshot write:
+//  1. under the shared lock, copy the (small) delta and take the snapshot
+//  2. unlocked, write old snapshot + copied delta as the new snapshot
+//  3. under the exclusive lock, re-express the delta that accumulated in the
+//     meantime against the new snapshot, swap it in and rewrite the WAL
+// ChangeRole does not wait for it: remaps published after step 1 are not in
+// the rows written, so step 3 carries them over to the new view.
+bool SecureDatabase::Compact() {
+    OpMetrics::Scope scope(metrics.get(), DbOp::Compact);
+    if (snapshotPath.empty())
+        return false;
+    std::lock_guard<std::mutex> serial(compactMutex);
+    auto start = std::chrono::steady_clock::now();
+
+    std::shared_ptr<const Snapshot> base;
+    UserTable delta;
+    UserTable deleted;
+    RoleRemaps remaps;      // folded into the rows written
+    uint64_t copied;        // clock of the copy: later remaps are carried over, not folded
+    uint32_t mark = walMark + 1;
+    {
+        std::shared_lock<std::shared_mutex> guard(store->lock);
+        // writers log under the exclusive lock, so the mark lands exactly
+        // after the last record this copy includes
+        if (wal) {
+            std::string record;
+            WriteAheadLog::EncodeMark(record, mark);
+            wal->Append(record, 1);
+            walMark = mark;
+        }
+        const UserStore::View& current = *store->view.load();
+        base = current.snapshot;
+        copied = store->clock.load();
+        store->compacting.store(true, std::memory_order_relaxed);
+        if (const RoleRemaps* r = current.remaps.load())
+            remaps = *r;
+        current.delta.ForEach([&](const UserVersion& v) {
+            if (v.deleted)
+                deleted.Insert(User{ v.row.username, {}, {} });
+            else
+                delta.Insert(User{ v.row.username, v.row.password,
+                                   std::string(UserStore::RemapRole(&remaps, v.row.role, v.commit, UINT64_MAX)) });
+        });
+    }
+
+    std::vector<UserRef> rows;
+    rows.reserve((base ? base->Size() : 0) + delta.Size());
+    if (base) {
+        base->ForEach([&](const UserRef& r) {
+            if (!delta.Find(r.username) && !deleted.Find(r.username))
+                rows.push_back(UserRef{ r.username, r.password, UserStore::RemapRole(&remaps, r.role, 0, UINT64_MAX) });
+        });
+    }
+    delta.ForEach([&](const User& u) { rows.push_back(UserRef{ u.username, u.password, u.role }); });
+    std::shared_ptr<const Snapshot> fresh;
+    if (!Snapshot::Write(snapshotPath, rows, wal ? mark : 0) || !(fresh = Snapshot::Open(snapshotPath))) {
+        Log("Compaction failed writing snapshot " + snapshotPath, DbOp::Compact);
+        std::unique_lock<std::shared_mutex> guard(store->lock);
+        store->compacting.store(false, std::memory_order_relaxed);
+        return false;
+    }
+
+    std::unique_lock<std::shared_mutex> guard(store->lock);
+    UserStore::View* current = store->view.load();
+    auto next = std::make_unique<UserStore::View>();
+    next->snapshot = fresh;
+    // Remaps from after the copy still apply to the rows written; the
+    // current view still has them, in commit order, as nothing rebased it
+    store->compacting.store(false, std::memory_order_relaxed);
+    auto late = std::make_unique<RoleRemaps>();
+    if (const RoleRemaps* r = current->remaps.load()) {
+        for (const RoleRemap& remap : *r)
+            if (remap.commit > copied)
+                late->push_back(remap);
+    }
+    // rebased versions carry the current clock: readers of the new view see
+    // them at once, and no remap applies to them
+    uint64_t now = store->clock.load();
+    auto rebase = [&](std::string_view username) {
+        if (next->delta.Find(username))
+            return;
+        UserRef live;
+        UserRef written;
+        bool exists = store->Current(username, live);
+        bool inFresh = fresh->Find(username, written);
+        if (inFresh)
+            written.role = UserStore::RemapRole(late.get(), written.role, 0, UINT64_MAX);
+        if (exists && !(inFresh && live.password == written.password && live.role == written.role)) {
+            next->delta.Publish(new UserVersion{
+                User{ std::string(live.username), std::string(live.password), std::string(live.role) }, false, now });
+        }
+        else if (!exists && inFresh) {
+            next->delta.Publish(new UserVersion{ User{ std::string(username), {}, {} }, true, now });
+        }
+    };
+    // every username whose state may differ between the two snapshots
+    current->delta.ForEach([&](const UserVersion& v) { rebase(v.row.username); });
+    delta.ForEach([&](const User& u) { rebase(u.username); });
+    deleted.ForEach([&](const User& u) { rebase(u.username); });
+    if (!late->empty())
+        next->remaps.store(late.release(), std::memory_order_relaxed);
+    store->view.store(next.release(), std::memory_order_release);
+    Epoch::Retire(current);
+
+    if (wal) {
+        // the WAL now only needs to rebuild the remaining delta. Until it is
+        // replaced, recovery skips the old log up to the mark
+        std::string records;
+        WriteAheadLog::EncodeMark(records, mark);
+        // carried remaps first, so on replay they reach the snapshot rows and none of the versions below
+        if (const RoleRemaps* carried = store->view.load()->remaps.load()) {
+            for (const RoleRemap& remap : *carried)
+                WriteAheadLog::Encode(records, WalOp::ChangeRole, remap.from, {}, remap.to);
+        }
+        store->view.load()->delta.ForEach([&](const UserVersion& v) {
+            if (v.deleted)
+                WriteAheadLog::Encode(records, WalOp::Delete, v.row.username);
+            else
+                WriteAheadLog::Encode(records, WalOp::Put, v.row.username, v.row.password, v.row.role);
+        });
+        if (!wal->Rewrite(records))
+            Log("Compaction could not rewrite the write-ahead log; recovery replays it from the new mark", DbOp::Compact);
+    }
+    guard.unlock();
+
+    compactions.fetch_add(1, std::memory_order_relaxed);
+    lastCompactionNanos.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+    return true;
+}
+
+std::vector<User> SecureDatabase::SelectUsers(const Session& session, const std::function<bool(const UserRef&)>& match) {
+    OpMetrics::Scope scope(metrics.get(), DbOp::SelectUsers);
+    std::vector<User> found;
+    if (!Authorized(session, Operation::Select)) {
+        LogDenied(DbOp::SelectUsers, session, "Unauthorized attempt to scan users by role: " + std::string(RoleName(session.GetRole())));
+        return found;
+    }
+    std::shared_lock<std::shared_mutex> guard(store->lock, std::defer_lock);
+    if (!store->lockFreeReads)
+        guard.lock();
+    Epoch::Guard pin;
+    store->Scan([&](const UserRef& r) {
+        if (match(r))
+            found.push_back(User{ std::string(r.username), std::string(r.password), std::string(r.role) });
+    });
+    return found;
+}
+
+std::string SecureDatabase::ListUsers(std::string_view prefix, size_t limit, std::string_view cursor,
+                                      const Session& session, const std::function<void(const UserRef&)>& visit) {
+    OpMetrics::Scope scope(metrics.get(), DbOp::ListUsers);
+    std::string next;
+    if (!Authorized(session, Operation::Select)) {
+        LogDenied(DbOp::ListUsers, session, "Unauthorized attempt to list users by role: " + std::string(RoleName(session.GetRole())));
+        return next;
+    }
+    std::shared_lock<std::shared_mutex> guard(store->lock, std::defer_lock);
+    if (!store->lockFreeReads)
+        guard.lock();
+    Epoch::Guard pin;
+    size_t visited = 0;
+    store->List(prefix, cursor, limit, [&](const UserRef& r) {
+        visit(r);
+        if (++visited == limit)
+            next = r.username;
+    });
+    return next;
+}
+
+size_t SecureDatabase::ListUsersByRole(std::string_view role, const Session& session,
+                                       const std::function<void(const UserRef&)>& visit) {
+    OpMetrics::Scope scope(metrics.get(), DbOp::ListUsersByRole);
+    if (!Authorized(session, Operation::Select)) {
+        LogDenied(DbOp::ListUsersByRole, session, "Unauthorized attempt to list users of a role by role: " + std::string(RoleName(session.GetRole())));
+        return 0;
+    }
+    // the bitmaps change with every write, so they are read under the shared lock
+    std::shared_lock<std::shared_mutex> guard(store->lock);
+    // copied out first: 'visit' runs with no lock held, so a slow callback
+    // does not stall writers and one that writes to the database cannot deadlock
+    std::vector<User> rows;
+    {
+        Epoch::Guard pin;
+        store->UsersWithRole(role, [&](const UserRef& r) {
+            rows.push_back(User{ std::string(r.username), std::string(r.password), std::string(r.role) });
+        });
+    }
+    guard.unlock();
+    for (const User& u : rows)
+        visit(UserRef{ u.username, u.password, u.role });
+    return rows.size();
+}
+
+size_t SecureDatabase::ChangeRole(std::string_view from, std::string_view to, const Session& session) {
+    OpMetrics::Scope scope(metrics.get(), DbOp::ChangeRole);
+    if (!Authorized(session, Operation::Update)) {
+        LogDenied(DbOp::ChangeRole, session, "Unauthorized attempt to change roles by role: " + std::string(RoleName(session.GetRole())));
+        return 0;
+    }
+    if (to.size() > kMaxFieldBytes || from.size() > kMaxFieldBytes) {
+        Log("ChangeRole rejected a role longer than " + std::to_string(kMaxFieldBytes) + " bytes", DbOp::ChangeRole);
+        return 0;
+    }
+    InlineParams params = { to, from };
+    size_t changed;
+    std::shared_future<void> commit;
+    {
+        // never waits on a compaction: one in progress carries later remaps over to its new view
+        auto conn = pool->Acquire();
+        if (!conn) {
+            Log("Connection pool timeout in ChangeRole", DbOp::ChangeRole);
+            return 0;
+        }
+        conn->execute(*conn->prepare(sql::kChangeRole), params);
+        changed = conn->changes();
+        commit = conn->durable();
+    }
+    if (cache && changed)
+        cache->InvalidateAll();
+    return AwaitDurable(commit) ? changed : 0;
+}
+
+StorageStats SecureDatabase::StoreStats() const {
+    StorageStats stats;
+    std::shared_lock<std::shared_mutex> guard(store->lock);
+    const UserStore::View& current = *store->view.load();
+    if (current.snapshot) {
+        stats.snapshotRows = current.snapshot->Size();
+        stats.snapshotBytes = current.snapshot->Bytes();
+    }
+    stats.deltaRows = current.delta.Rows();
+    stats.tombstones = current.delta.Tombstones();
+    stats.compactions = compactions.load(std::memory_order_relaxed);
+    stats.lastCompactionNanos = lastCompactionNanos.load(std::memory_order_relaxed);
+    stats.roles = store->Roles()->Roles();
+    stats.roleIndexBytes = store->Roles()->Bytes();
+    return stats;
+}
+
+// --------------------- CRUD ---------------------
+bool SecureDatabase::AddUser(const User& user, const Session& session) {
+    assert(!user.username.empty() && !user.password.empty());
+    OpMetrics::Scope scope(metrics.get(), DbOp::AddUser);
+    if (!Authorized(session, Operation::Insert)) {
+        LogDenied(DbOp::AddUser, session, "Unauthorized attempt to add user by role: " + std::string(RoleName(session.GetRole())));
+        return false;
+    }
+    if (user.username.size() > kMaxFieldBytes || user.role.size() > kMaxFieldBytes) {
+        Log("AddUser rejected a username or role longer than " + std::to_string(kMaxFieldBytes) + " bytes", DbOp::AddUser);
+        return false;
+    }
+    char hash[kEncryptedLength];
+    EncryptTo(user.password, hash);
+    InlineParams params = { user.username, std::string_view(hash, kEncryptedLength), user.role };
+    auto conn = pool->Acquire();
+    if (!conn) {
+        Log("Connection pool timeout in AddUser", DbOp::AddUser);
+        return false;
+    }
+    FilterInsert(user.username);
+    bool added = conn->execute(*insertStmt, params);
+    auto commit = conn->durable();
+    conn = ConnectionPool::Lease();     // hand the connection back before waiting on the disk
+    FilterSettle(user.username, added);
+    return AwaitDurable(commit) && added;
+}
+
+std::unique_ptr<User> SecureDatabase::GetUser(std::string_view username, const Session& session) {
+    auto u = std::make_unique<User>();
+    if (!GetUserInto(username, session, *u))
+        return nullptr;
+    return u;
+}
+
+bool SecureDatabase::GetUserInto(std::string_view username, const Session& session, User& out) {
+    assert(!username.empty());
+    OpMetrics::Scope scope(metrics.get(), DbOp::GetUser);
+    if (!Authorized(session, Operation::Select)) {
+        LogDenied(DbOp::GetUser, session, "Unauthorized attempt to get user by role: " + std::string(RoleName(session.GetRole())));
+        return false;
+    }
+    if (!MayExist(username))
+        return false;
+    uint64_t ticket = 0;
+    if (cache && cache->Get(username, out, ticket))
+        return true;
+
+    InlineParams params = { username };
+    auto conn = pool->Acquire();
+    if (!conn) {
+        Log("Connection pool timeout in GetUser", DbOp::GetUser);
+        return false;
+    }
+    if (!conn->query(*selectStmt, params, out))
+        return false;
+    if (cache)
+        cache->Put(out, ticket);
+    return true;
+}
+
+bool SecureDatabase::UpdatePassword(std::string_view username, std::string_view newPassword, const Session& session) {
+    assert(!username.empty() && !newPassword.empty());
+    OpMetrics::Scope scope(metrics.get(), DbOp::UpdatePassword);
+    if (!Authorized(session, Operation::Update)) {
+        LogDenied(DbOp::UpdatePassword, session, "Unauthorized attempt to update password by role: " + std::string(RoleName(session.GetRole())));
+        return false;
+    }
+    if (!MayExist(username))
+        return false;
+    char hash[kEncryptedLength];
+    EncryptTo(newPassword, hash);
+    InlineParams params = { std::string_view(hash, kEncryptedLength), username };
+    auto conn = pool->Acquire();
+    if (!conn) {
+        Log("Connection pool timeout in UpdatePassword", DbOp::UpdatePassword);
+        return false;
+    }
+    bool updated = conn->execute(*updateStmt, params);
+    auto commit = conn->durable();
+    conn = ConnectionPool::Lease();
+    if (cache)
+        cache->Invalidate(username);
+    return AwaitDurable(commit) && updated;
+}
+
+bool SecureDatabase::DeleteUser(std::string_view username, const Session& session) {
+    assert(!username.empty());
+    OpMetrics::Scope scope(metrics.get(), DbOp::DeleteUser);
+    if (!Authorized(session, Operation::Delete)) {
+        LogDenied(DbOp::DeleteUser, session, "Unauthorized attempt to delete user by role: " + std::string(RoleName(session.GetRole())));
+        return false;
+    }
+    if (!MayExist(username))
+        return false;
+    InlineParams params = { username };
+    auto conn = pool->Acquire();
+    if (!conn) {
+        Log("Connection pool timeout in DeleteUser", DbOp::DeleteUser);
+        return false;
+    }
+    uint64_t epoch = FilterEpoch();
+    bool deleted = conn->execute(*deleteStmt, params);
+    auto commit = conn->durable();
+    conn = ConnectionPool::Lease();
+    if (deleted)
+        FilterErase(username, epoch);
+    if (cache)
+        cache->Invalidate(username);
+    return AwaitDurable(commit) && deleted;
+}
+
+// String-role shims
+bool SecureDatabase::AddUser(const User& user, const std::string& currentRole) {
+    return AddUser(user, Session(currentRole));
+}
+
+std::unique_ptr<User> SecureDatabase::GetUser(const std::string& username, const std::string& currentRole) {
+    return GetUser(username, Session(currentRole));
+}
+
+bool SecureDatabase::UpdatePassword(const std::string& username, const std::string& newPassword, const std::string& currentRole) {
+    return UpdatePassword(username, newPassword, Session(currentRole));
+}
+
+bool SecureDatabase::DeleteUser(const std::string& username, const std::string& currentRole) {
+    return DeleteUser(username, Session(currentRole));
+}
+
+// --------------------- Batch CRUD ---------------------
+size_t SecureDatabase::AddUsers(std::span<const User> users, const Session& session, size_t chunkSize) {
+    OpMetrics::Scope scope(metrics.get(), DbOp::AddUsers);
+    if (!Authorized(session, Operation::Insert)) {
+        LogDenied(DbOp::AddUsers, session, "Unauthorized attempt to add " + std::to_string(users.size()) + " users by role: " + std::string(RoleName(session.GetRole())));
+        return 0;
+    }
+    if (chunkSize == 0)
+        chunkSize = kDefaultBatchChunk;
+    // one oversized row would fail its whole multi-row statement, so those rows are left out up front
+    // (passwords are stored hashed, whatever their length)
+    auto fits = [](const User& u) { return u.username.size() <= kMaxFieldBytes && u.role.size() <= kMaxFieldBytes; };
+    std::vector<User> fitting;
+    if (!std::all_of(users.begin(), users.end(), fits)) {
+        std::copy_if(users.begin(), users.end(), std::back_inserter(fitting), fits);
+        Log("AddUsers skipped " + std::to_string(users.size() - fitting.size()) + " rows with a field longer than "
+            + std::to_string(kMaxFieldBytes) + " bytes", DbOp::AddUsers);
+        users = fitting;
+    }
+    auto conn = pool->Acquire();
+    if (!conn) {
+        Log("Connection pool timeout in AddUsers", DbOp::AddUsers);
+        return 0;
+    }
+
+    InsertBatch batch;
+    std::vector<std::string_view> passwords;
+    std::string hashes;
+    size_t added = 0;
+    for (size_t start = 0; start < users.size(); start += chunkSize) {
+        auto chunk = users.subspan(start, std::min(chunkSize, users.size() - start));
+        // hash the whole chunk in one multi-buffer pass, then bind the columns
+        passwords.clear();
+        for (const User& u : chunk) {
+            assert(!u.username.empty() && !u.password.empty());
+            passwords.push_back(u.password);
+        }
+        hashes.resize(chunk.size() * kEncryptedLength);
+        EncryptBatch(passwords, hashes.data());
+        added += InsertHashed(*conn, batch, chunk, hashes.data());
+    }
+    conn = ConnectionPool::Lease();
+    for (const auto& commit : batch.commits)
+        if (!AwaitDurable(commit))
+            return 0;
+    return added;
+}
+
+size_t SecureDatabase::InsertHashed(DBConnection& conn, InsertBatch& batch, std::span<const User> chunk, const char* hashes) {
+    if (batch.params.size() != chunk.size() * 3) {
+        batch.stmt = conn.prepare(sql::InsertUsers(chunk.size()));
+        batch.params.resize(chunk.size() * 3);
+    }
+    for (size_t i = 0; i < chunk.size(); i++) {
+        batch.params[3 * i] = chunk[i].username;
+        batch.params[3 * i + 1].assign(hashes + kEncryptedLength * i, kEncryptedLength);
+        batch.params[3 * i + 2] = chunk[i].role;
+    }
+    FilterInsert(chunk);
+    conn.execute(*batch.stmt, batch.params);
+    batch.commits.push_back(conn.durable());
+    FilterSettle(chunk, conn.rowResults());
+    return conn.changes();
+}
+
+size_t SecureDatabase::DeleteUsers(std::span<const std::string> usernames, const Session& session, size_t chunkSize) {
+    OpMetrics::Scope scope(metrics.get(), DbOp::DeleteUsers);
+    if (!Authorized(session, Operation::Delete)) {
+        LogDenied(DbOp::DeleteUsers, session, "Unauthorized attempt to delete " + std::to_string(usernames.size()) + " users by role: " + std::string(RoleName(session.GetRole())));
+        return 0;
+    }
+    if (chunkSize == 0)
+        chunkSize = kDefaultBatchChunk;
+    auto conn = pool->Acquire();
+    if (!conn) {
+        Log("Connection pool timeout in DeleteUsers", DbOp::DeleteUsers);
+        return 0;
+    }
+
+    const PreparedStatement* stmt = nullptr;
+    std::vector<std::string> params;
+    std::vector<std::shared_future<void>> commits;
+    size_t deleted = 0;
+    for (size_t start = 0; start < usernames.size(); start += chunkSize) {
+        auto chunk = usernames.subspan(start, std::min(chunkSize, usernames.size() - start));
+        // names the filter rules out, or too long to have been stored, never reach the statement
+        size_t before = params.size();
+        params.clear();
+        MayExist(chunk, params);
+        if (params.empty())
+            continue;
+        if (!stmt || params.size() != before)
+            stmt = conn->prepare(sql::DeleteUsers(params.size()));
+        uint64_t epoch = FilterEpoch();
+        conn->execute(*stmt, params);
+        deleted += conn->changes();
+        commits.push_back(conn->durable());
+        FilterErase(params, conn->rowResults(), epoch);
+        if (cache) {
+            for (const std::string& name : params)
+                cache->Invalidate(name);
+        }
+    }
+    conn = ConnectionPool::Lease();
+    for (const auto& commit : commits)
+        if (!AwaitDurable(commit))
+            return 0;
+    return deleted;
+}
+
+size_t SecureDatabase::AddUsers(std::span<const User> users, const std::string& currentRole, size_t chunkSize) {
+    return AddUsers(users, Session(currentRole), chunkSize);
+}
+
+size_t SecureDatabase::DeleteUsers(std::span<const std::string> usernames, const std::string& currentRole, size_t chunkSize) {
+    return DeleteUsers(usernames, Session(currentRole), chunkSize);
+}
+
+// --------------------- Password verification ---------------------
+WorkStealingPool& SecureDatabase::VerifyPool() {
+    std::call_once(verifyStart, [&] {
+        if (!verifyPool)
+            verifyPool = std::make_shared<WorkStealingPool>(verifyThreads);
+        verifyWorkers = verifyPool.get();
+    });
+    return *verifyPool;
+}
+
+bool SecureDatabase::CheckPassword(std::string_view username, std::string_view password, const Session& session) {
+    OpMetrics::Scope scope(metrics.get(), DbOp::VerifyPassword);
+    if (!Authorized(session, Operation::Select)) {
+        LogDenied(DbOp::VerifyPassword, session, "Unauthorized attempt to verify password by role: " + std::string(RoleName(session.GetRole())));
+        return false;
+    }
+    // Hash first and go straight to the store: no filter, cache or pool,
+    // whose hit/miss timing would tell a caller which usernames exist
+    char hash[kEncryptedLength];
+    EncryptTo(password, hash);
+    static const std::string kNoUser(kEncryptedLength, '0');
+    std::shared_lock<std::shared_mutex> guard(store->lock, std::defer_lock);
+    if (!store->lockFreeReads)
+        guard.lock();
+    Epoch::Guard pin;
+    UserRef found;
+    bool known = store->Lookup(username, found) && found.password.size() == kEncryptedLength;
+    // an unknown user is compared against a dummy hash so both paths do the same work
+    const char* expected = known ? found.password.data() : kNoUser.data();
+    bool match = CRYPTO_memcmp(hash, expected, kEncryptedLength) == 0;
+    return known && match;
+}
+
+bool SecureDatabase::VerifyPassword(std::string_view username, std::string_view password, const Session& session) {
+    WorkStealingPool& workers = VerifyPool();
+    if (workers.InWorker())
+        return CheckPassword(username, password, session);     // waiting here could starve the pool
+    std::mutex doneMutex;
+    std::condition_variable doneCv;
+    bool done = false;
+    bool verified = false;
+    workers.Submit([&] {
+        bool ok = false;
+        try {
+            ok = CheckPassword(username, password, session);
+        }
+        catch (const std::exception& e) {
+            Log(std::string("VerifyPassword failed: ") + e.what(), DbOp::VerifyPassword);
+        }
+        // notify under the lock: the waiter owns doneCv and may return as soon as it sees 'done'
+        std::lock_guard<std::mutex> guard(doneMutex);
+        verified = ok;
+        done = true;
+        doneCv.notify_one();
+    });
+    std::unique_lock<std::mutex> guard(doneMutex);
+    doneCv.wait(guard, [&] { return done; });
+    return verified;
+}
+
+void SecureDatabase::VerifyPasswordAsync(std::string username, std::string password, const Session& session,
+                                         std::function<void(bool)> done) {
+    WorkStealingPool& workers = VerifyPool();
+    {
+        std::lock_guard<std::mutex> guard(verifyMutex);
+        verifyInFlight++;
+    }
+    workers.Submit([this, username = std::move(username), password = std::move(password), session,
+                    done = std::move(done)] {
+        bool ok = false;
+        try {
+            ok = CheckPassword(username, password, session);
+        }
+        catch (const std::exception& e) {
+            Log(std::string("VerifyPassword failed: ") + e.what(), DbOp::VerifyPassword);
+        }
+        try {
+            done(ok);
+        }
+        catch (...) {
+            Log("VerifyPassword callback threw; ignored", DbOp::VerifyPassword);
+        }
+        std::lock_guard<std::mutex> guard(verifyMutex);
+        if (--verifyInFlight == 0)
+            verifyIdle.notify_all();
+    });
+}
+
+WorkPoolStats SecureDatabase::VerifyStats() const {
+    // no verification yet means no pool yet; report an empty one
+    WorkStealingPool* workers = verifyWorkers.load();
+    return workers ? workers->Stats() : WorkPoolStats{};
+}
+
+// --------------------- Bulk import/export ---------------------
+namespace {
+    constexpr std::string_view kCsvHeader = "username,password,role";
+
+    // Hand-off between two pipeline stages: Push blocks while the queue is
+    // full, Pop while it is empty. After Close, Push fails and Pop drains
+    // what is left before failing.
+    template <class T>
+    class BoundedQueue {
+    public:
+        explicit BoundedQueue(size_t capacity) : capacity(std::max<size_t>(1, capacity)) {}
+
+        bool Push(T item) {
+            std::unique_lock<std::mutex> guard(mutex);
+            notFull.wait(guard, [&] { return closed || items.size() < capacity; });
+            if (closed)
+                return false;
+            items.push_back(std::move(item));
+            notEmpty.notify_one();
+            return true;
+        }
+
+        bool Pop(T& out) {
+            std::unique_lock<std::mutex> guard(mutex);
+            notEmpty.wait(guard, [&] { return closed || !items.empty(); });
+            if (items.empty())
+                return false;
+            out = std::move(items.front());
+            items.pop_front();
+            notFull.notify_one();
+            return true;
+        }
+
+        void Close() {
+            std::lock_guard<std::mutex> guard(mutex);
+            closed = true;
+            notFull.notify_all();
+            notEmpty.notify_all();
+        }
+
+    private:
+        std::mutex mutex;
+        std::condition_variable notFull;
+        std::condition_variable notEmpty;
+        std::deque<T> items;
+        size_t capacity;
+        bool closed = false;
+    };
+
+    enum class CsvResult { Ok, Malformed, Incomplete };
+
+    // Parses the record at data[pos] into 'fields' and moves pos past its
+    // line break. Incomplete if the record may continue past the end of
+    // 'data'; with 'last' set no more input follows, so it never is.
+    CsvResult ParseCsvRecord(std::string_view data, size_t& pos, bool last, std::vector<std::string>& fields) {
+        fields.clear();
+        fields.emplace_back();
+        bool quoted = false;
+        bool malformed = false;
+        size_t i = pos;
+        for (;;) {
+            if (i == data.size()) {
+                if (!last)
+                    return CsvResult::Incomplete;
+                malformed |= quoted;    // unterminated quote
+                break;
+            }
+            // copy runs of plain characters at once
+            size_t run = i;
+            if (quoted)
+                while (run < data.size() && data[run] != '"')
+                    run++;
+            else
+                while (run < data.size() && data[run] != ',' && data[run] != '"' && data[run] != '\n' && data[run] != '\r')
+                    run++;
+            if (run != i) {
+                fields.back().append(data.data() + i, run - i);
+                i = run;
+                continue;
+            }
+            char c = data[i++];
+            if (quoted) {
+                // a doubled quote is a literal one, a single quote ends the field
+                if (i == data.size() && !last)
+                    return CsvResult::Incomplete;
+                if (i < data.size() && data[i] == '"')
+                    fields.back() += data[i++];
+                else
+                    quoted = false;
+            }
+            else if (c == '"') {
+                // a quote only opens a field at its start; elsewhere the record
+                // is rejected, without swallowing the lines after it
+                if (fields.back().empty())
+                    quoted = true;
+                else
+                    malformed = true;
+            }
+            else if (c == ',')
+                fields.emplace_back();
+            else if (c == '\n')
+                break;
+            else if (c != '\r')
+                fields.back() += c;
+        }
+        pos = i;
+        return malformed ? CsvResult::Malformed : CsvResult::Ok;
+    }
+
+    void AppendCsvField(std::string& out, std::string_view field) {
+        if (field.find_first_of(",\"\r\n") == std::string_view::npos) {
+            out += field;
+            return;
+        }
+        out += '"';
+        for (char c : field) {
+            if (c == '"')
+                out += '"';
+            out += c;
+        }
+        out += '"';
+    }
+
+    bool IsHexDigest(std::string_view s) {
+        return s.size() == SecureDatabase::kEncryptedLength
+            && std::all_of(s.begin(), s.end(), [](char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); });
+    }
+
+    struct ImportBatch {
+        size_t seq = 0;
+        std::vector<User> rows;
+        std::string hashes;     // kEncryptedLength chars per row, filled by the hashing stage
+
+        // Keeps the first row of each username, so one INSERT never carries
+        // a name twice; returns the number of rows dropped
+        size_t DropRepeatedNames() {
+            constexpr size_t kEncryptedLength = SecureDatabase::kEncryptedLength;
+            std::vector<bool> keep(rows.size());
+            {
+                std::unordered_set<std::string_view> seen;
+                for (size_t i = 0; i < rows.size(); i++)
+                    keep[i] = seen.insert(rows[i].username).second;
+            }
+            size_t kept = 0;
+            for (size_t i = 0; i < rows.size(); i++) {
+                if (!keep[i])
+                    continue;
+                if (kept != i) {
+                    rows[kept] = std::move(rows[i]);
+                    std::memcpy(hashes.data() + kEncryptedLength * kept, hashes.data() + kEncryptedLength * i, kEncryptedLength);
+                }
+                kept++;
+            }
+            size_t dropped = rows.size() - kept;
+            rows.resize(kept);
+            hashes.resize(kEncryptedLength * kept);
+            return dropped;
+        }
+    };
+
+    // Runs 'onExit' when it goes out of scope, on return or unwind alike
+    template <class F>
+    struct ScopeExit {
+        F onExit;
+        ~ScopeExit() { onExit(); }
+    };
+
+    // First exception thrown by any pipeline stage, kept for the caller to
+    // rethrow once every thread has been joined
+    class StageError {
+    public:
+        template <class F, class Stop>
+        void Run(F&& body, Stop&& stop) {
+            try {
+                body();
+            }
+            catch (...) {
+                {
+                    std::lock_guard<std::mutex> guard(mutex);
+                    if (!error)
+                        error = std::current_exception();
+                }
+                stop();
+            }
+        }
+
+        void Rethrow() {
+            std::lock_guard<std::mutex> guard(mutex);
+            if (error)
+                std::rethrow_exception(error);
+        }
+
+    private:
+        std::mutex mutex;
+        std::exception_ptr error;
+    };
+}
+
+BulkStats SecureDatabase::ImportUsers(std::istream& in, const Session& session, const BulkOptions& options) {
+    OpMetrics::Scope scope(metrics.get(), DbOp::ImportUsers);
+    BulkStats stats;
+    if (!Authorized(session, Operation::Insert)) {
+        LogDenied(DbOp::ImportUsers, session, "Unauthorized attempt to import users by role: " + std::string(RoleName(session.GetRole())));
+        return stats;
+    }
+    auto conn = pool->Acquire();
+    if (!conn) {
+        Log("Connection pool timeout in ImportUsers", DbOp::ImportUsers);
+        return stats;
+    }
+    auto start = std::chrono::steady_clock::now();
+    const size_t batchRows = std::max<size_t>(1, options.batchRows);
+    const size_t blockBytes = std::max<size_t>(1, options.blockBytes);
+    const size_t hashers = options.hashThreads ? options.hashThreads
+                                               : std::max(1u, std::thread::hardware_concurrency());
+    BoundedQueue<std::string> blocks(options.queueDepth);
+    BoundedQueue<ImportBatch> parsed(options.queueDepth);
+    BoundedQueue<ImportBatch> hashed(options.queueDepth);
+    std::atomic<uint64_t> malformed{ 0 };
+
+    // Closing every queue unblocks every stage. The guard is declared after
+    // the threads, so on unwind it runs before their destructors join them;
+    // a stage that throws closes them too and the caller rethrows.
+    auto stop = [&] {
+        blocks.Close();
+        parsed.Close();
+        hashed.Close();
+    };
+    StageError failed;
+    std::jthread reader;
+    std::jthread parser;
+    std::vector<std::jthread> workers;
+    ScopeExit stopOnExit{ stop };
+
+    // read: fixed-size blocks, record boundaries are the parser's problem
+    reader = std::jthread([&] { failed.Run([&] {
+        for (;;) {
+            std::string block(blockBytes, '\0');
+            in.read(block.data(), static_cast<std::streamsize>(block.size()));
+            block.resize(static_cast<size_t>(in.gcount()));
+            if (block.empty())
+                break;
+            stats.bytes += block.size();
+            if (!blocks.Push(std::move(block)))
+                return;     // pipeline stopped
+        }
+        if (in.bad())
+            Log("Read error during user import", DbOp::ImportUsers);
+        blocks.Close();
+    }, stop); });
+
+    // parse: carries a partial record over to the next block
+    parser = std::jthread([&] { failed.Run([&] {
+        std::string text;
+        std::string block;
+        std::vector<std::string> fields;
+        ImportBatch batch;
+        size_t seq = 0;
+        bool first = true;
+        auto flush = [&] {
+            if (batch.rows.empty())
+                return;
+            batch.seq = seq++;
+            parsed.Push(std::move(batch));
+            batch = ImportBatch();
+            batch.rows.reserve(batchRows);
+        };
+        batch.rows.reserve(batchRows);
+        for (bool more = true; more;) {
+            more = blocks.Pop(block);
+            if (more)
+                text += block;
+            size_t pos = 0;
+            while (pos < text.size()) {
+                size_t record = pos;
+                CsvResult result = ParseCsvRecord(text, pos, !more, fields);
+                if (result == CsvResult::Incomplete) {
+                    pos = record;
+                    break;
+                }
+                bool header = first && fields.size() == 3 && fields[0] == "username" && fields[1] == "password"
+                              && fields[2] == "role";
+                first = false;
+                if (header || (fields.size() == 1 && fields[0].empty()))
+                    continue;   // header or blank line
+                bool valid = result == CsvResult::Ok && fields.size() == 3 && !fields[0].empty()
+                             && !fields[1].empty() && std::all_of(fields.begin(), fields.end(),
+                                                                  [](const std::string& f) { return f.size() <= kMaxFieldBytes; })
+                             && (!options.passwordsHashed || IsHexDigest(fields[1]));
+                if (!valid) {
+                    malformed.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                batch.rows.push_back(User{ std::move(fields[0]), std::move(fields[1]), std::move(fields[2]) });
+                if (batch.rows.size() == batchRows)
+                    flush();
+            }
+            text.erase(0, pos);
+        }
+        flush();
+        parsed.Close();
+    }, stop); });
+
+    // hash: one multi-buffer pass per batch on each worker
+    std::atomic<size_t> hashing{ hashers };
+    for (size_t t = 0; t < hashers; t++) {
+        workers.emplace_back([&] { failed.Run([&] {
+            ImportBatch batch;
+            std::vector<std::string_view> passwords;
+            while (parsed.Pop(batch)) {
+                batch.hashes.resize(batch.rows.size() * kEncryptedLength);
+                if (options.passwordsHashed) {
+                    for (size_t i = 0; i < batch.rows.size(); i++)
+                        std::memcpy(batch.hashes.data() + kEncryptedLength * i, batch.rows[i].password.data(), kEncryptedLength);
+                }
+                else {
+                    passwords.clear();
+                    for (const User& u : batch.rows)
+                        passwords.push_back(u.password);
+                    EncryptBatch(passwords, batch.hashes.data());
+                }
+                hashed.Push(std::move(batch));
+            }
+            if (hashing.fetch_sub(1) == 1)
+                hashed.Close();
+        }, stop); });
+    }
+
+    // insert, on this thread and in input order: a username repeated in the
+    // input keeps its first record
+    InsertBatch insert;
+    std::map<size_t, ImportBatch> early;
+    size_t next = 0;
+    ImportBatch batch;
+    while (hashed.Pop(batch)) {
+        early.emplace(batch.seq, std::move(batch));
+        for (auto it = early.find(next); it != early.end(); it = early.find(++next)) {
+            ImportBatch& b = it->second;
+            stats.rows += b.rows.size();
+            stats.duplicates += b.DropRepeatedNames();
+            size_t added = InsertHashed(*conn, insert, b.rows, b.hashes.data());
+            stats.added += added;
+            stats.duplicates += b.rows.size() - added;
+            early.erase(it);
+        }
+    }
+    reader.join();
+    parser.join();
+    for (auto& w : workers)
+        w.join();
+    conn = ConnectionPool::Lease();
+    failed.Rethrow();
+
+    for (const auto& commit : insert.commits) {
+        if (!AwaitDurable(commit)) {
+            stats.added = 0;
+            break;
+        }
+    }
+    stats.malformed = malformed.load();
+    stats.nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+BulkStats SecureDatabase::ExportUsers(std::ostream& out, const Session& session, const BulkOptions& options) {
+    OpMetrics::Scope scope(metrics.get(), DbOp::ExportUsers);
+    BulkStats stats;
+    if (!Authorized(session, Operation::Select)) {
+        LogDenied(DbOp::ExportUsers, session, "Unauthorized attempt to export users by role: " + std::string(RoleName(session.GetRole())));
+        return stats;
+    }
+    auto start = std::chrono::steady_clock::now();
+    const size_t batchRows = std::max<size_t>(1, options.batchRows);
+    const size_t blockBytes = std::max<size_t>(1, options.blockBytes);
+    BoundedQueue<std::string> blocks(options.queueDepth);
+    auto stop = [&] { blocks.Close(); };
+    StageError failed;
+    std::jthread writer([&] { failed.Run([&] {
+        std::string block;
+        while (blocks.Pop(block))
+            out.write(block.data(), static_cast<std::streamsize>(block.size()));
+    }, stop); });
+    ScopeExit stopOnExit{ stop };   // runs before the writer is joined on unwind
+
+    std::string block(kCsvHeader);
+    block += '\n';
+    std::string cursor;
+    do {
+        // format a page, then hand blocks over outside the callback so a slow
+        // writer never holds up epoch reclamation
+        cursor = ListUsers({}, batchRows, cursor, session, [&](const UserRef& r) {
+            AppendCsvField(block, r.username);
+            block += ',';
+            AppendCsvField(block, r.password);
+            block += ',';
+            AppendCsvField(block, r.role);
+            block += '\n';
+            stats.rows++;
+        });
+        if (block.size() >= blockBytes || cursor.empty()) {
+            stats.bytes += block.size();
+            if (!blocks.Push(std::move(block)))
+                break;  // the writer failed
+            block.clear();
+        }
+    } while (!cursor.empty());
+    blocks.Close();
+    writer.join();
+    failed.Rethrow();
+    out.flush();
+    if (!out)
+        Log("Write error during user export", DbOp::ExportUsers);
+    stats.nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+// --------------------- Sharding ---------------------
+namespace {
+    // Partition count the files under 'base' were written with: from the
+    // manifest, else by counting base.0, base.1, ...; 0 for a new database
+    size_t StoredShardCount(const std::string& base) {
+        if (FILE* in = std::fopen((base + ".shards").c_str(), "r")) {
+            unsigned long long count = 0;
+            bool read = std::fscanf(in, "shards %llu", &count) == 1;
+            std::fclose(in);
+            return read ? static_cast<size_t>(count) : SIZE_MAX;
+        }
+        size_t count = 0;
+        while (::access((base + "." + std::to_string(count)).c_str(), F_OK) == 0)
+            count++;
+        return count;
+    }
+}
+
+ShardedSecureDatabase::ShardedSecureDatabase(size_t shardCount, const SecureDatabaseOptions& options) {
+    assert(shardCount > 0);
+    const std::string& base = options.walPath.empty() ? options.snapshotPath : options.walPath;
+    if (!base.empty()) {
+        size_t stored = StoredShardCount(base);
+        if (stored != 0 && stored != shardCount)
+            throw std::runtime_error(base + " holds " + (stored == SIZE_MAX ? "an unreadable shard count" : std::to_string(stored) + " shards")
+                                     + "; opening it with " + std::to_string(shardCount) + " would misroute users");
+        if (stored == 0 && !ReplaceFile(base + ".shards", "shards " + std::to_string(shardCount) + "\n"))
+            throw std::runtime_error("could not write " + base + ".shards");
+    }
+
+    SecureDatabaseOptions part = options;
+    if (!part.auditLog)
+        part.auditLog = std::make_shared<AuditLog>(options.auditLogPath, options.auditCapacity, options.auditOverflow,
+                                                      options.auditFormat);
+    part.userCacheBytes = options.userCacheBytes / shardCount;
+    part.usernameFilterCapacity = std::max<size_t>(options.usernameFilterCapacity / shardCount, 1024);
+    if (!part.verifyPool)
+        part.verifyPool = std::make_shared<WorkStealingPool>(options.verifyThreads);
+    for (size_t i = 0; i < shardCount; i++) {
+        if (!options.walPath.empty())
+            part.walPath = options.walPath + "." + std::to_string(i);
+        if (!options.snapshotPath.empty())
+            part.snapshotPath = options.snapshotPath + "." + std::to_string(i);
+        shards.push_back(std::make_unique<SecureDatabase>(part));
+    }
+    if (shardCount > 1)
+        fanOut = std::make_unique<WorkStealingPool>(std::min<size_t>(shardCount - 1, std::max(1u, std::thread::hardware_concurrency())));
+}
+
+void ShardedSecureDatabase::FanOut(const std::function<void(size_t)>& work) {
+    if (!fanOut) {
+        work(0);
+        return;
+    }
+    std::mutex mutex;
+    std::condition_variable finished;
+    size_t remaining = shards.size();
+    std::exception_ptr error;
+    auto run = [&](size_t i) {
+        std::exception_ptr caught;
+        try {
+            work(i);
+        }
+        catch (...) {
+            caught = std::current_exception();
+        }
+        // notified under the lock: once it is released the caller may return and take these locals with it
+        std::lock_guard<std::mutex> guard(mutex);
+        if (caught && !error)
+            error = caught;
+        if (--remaining == 0)
+            finished.notify_one();
+    };
+    for (size_t i = 1; i < shards.size(); i++)
+        fanOut->Submit([&run, i] { run(i); });
+    run(0);
+    std::unique_lock<std::mutex> guard(mutex);
+    finished.wait(guard, [&] { return remaining == 0; });
+    if (error)
+        std::rethrow_exception(error);
+}
+
+// Denied calls go to shard 0 alone, so they are rejected and audited once
+size_t ShardedSecureDatabase::AddUsers(std::span<const User> users, const Session& session, size_t chunkSize) {
+    if (shards.size() == 1 || !session.Can(Operation::Insert))
+        return shards[0]->AddUsers(users, session, chunkSize);
+    std::vector<std::vector<User>> parts(shards.size());
+    for (const User& u : users)
+        parts[ShardOf(u.username)].push_back(u);
+    std::atomic<size_t> added{ 0 };
+    FanOut([&](size_t i) {
+        if (!parts[i].empty())
+            added.fetch_add(shards[i]->AddUsers(parts[i], session, chunkSize), std::memory_order_relaxed);
+    });
+    return added.load();
+}
+
+size_t ShardedSecureDatabase::DeleteUsers(std::span<const std::string> usernames, const Session& session, size_t chunkSize) {
+    if (shards.size() == 1 || !session.Can(Operation::Delete))
+        return shards[0]->DeleteUsers(usernames, session, chunkSize);
+    std::vector<std::vector<std::string>> parts(shards.size());
+    for (const std::string& name : usernames)
+        parts[ShardOf(name)].push_back(name);
+    std::atomic<size_t> deleted{ 0 };
+    FanOut([&](size_t i) {
+        if (!parts[i].empty())
+            deleted.fetch_add(shards[i]->DeleteUsers(parts[i], session, chunkSize), std::memory_order_relaxed);
+    });
+    return deleted.load();
+}
+
+std::vector<User> ShardedSecureDatabase::SelectUsers(const Session& session,
+                                                     const std::function<bool(const UserRef&)>& match) {
+    if (shards.size() == 1 || !session.Can(Operation::Select))
+        return shards[0]->SelectUsers(session, match);
+    std::vector<std::vector<User>> parts(shards.size());
+    FanOut([&](size_t i) { parts[i] = shards[i]->SelectUsers(session, match); });
+    std::vector<User> found;
+    size_t total = 0;
+    for (const auto& part : parts)
+        total += part.size();
+    found.reserve(total);
+    for (auto& part : parts)
+        std::move(part.begin(), part.end(), std::back_inserter(found));
+    return found;
+}
+
+std::string ShardedSecureDatabase::ListUsers(std::string_view prefix, size_t limit, std::string_view cursor,
+                                             const Session& session, const std::function<void(const UserRef&)>& visit) {
+    if (shards.size() == 1 || !session.Can(Operation::Select))
+        return shards[0]->ListUsers(prefix, limit, cursor, session, visit);
+    // each partition is already sorted: a page of 'limit' from each covers the merged page
+    std::vector<std::vector<User>> parts(shards.size());
+    FanOut([&](size_t i) {
+        shards[i]->ListUsers(prefix, limit, cursor, session, [&](const UserRef& r) {
+            parts[i].push_back(User{ std::string(r.username), std::string(r.password), std::string(r.role) });
+        });
+    });
+
+    std::vector<size_t> at(parts.size(), 0);
+    std::string next;
+    for (size_t visited = 0; visited < limit; visited++) {
+        size_t best = parts.size();
+        for (size_t i = 0; i < parts.size(); i++) {
+            if (at[i] < parts[i].size()
+                && (best == parts.size() || parts[i][at[i]].username < parts[best][at[best]].username))
+                best = i;
+        }
+        if (best == parts.size())
+            break;
+        const User& u = parts[best][at[best]++];
+        visit(UserRef{ u.username, u.password, u.role });
+        if (visited + 1 == limit)
+            next = u.username;
+    }
+    return next;
+}
+
+size_t ShardedSecureDatabase::ListUsersByRole(std::string_view role, const Session& session,
+                                              const std::function<void(const UserRef&)>& visit) {
+    if (!session.Can(Operation::Select))
+        return shards[0]->ListUsersByRole(role, session, visit);
+    // one partition at a time, so 'visit' still streams straight from each store
+    size_t visited = 0;
+    for (auto& shard : shards)
+        visited += shard->ListUsersByRole(role, session, visit);
+    return visited;
+}
+
+size_t ShardedSecureDatabase::ChangeRole(std::string_view from, std::string_view to, const Session& session) {
+    if (shards.size() == 1 || !session.Can(Operation::Update))
+        return shards[0]->ChangeRole(from, to, session);
+    std::atomic<size_t> changed{ 0 };
+    FanOut([&](size_t i) { changed.fetch_add(shards[i]->ChangeRole(from, to, session), std::memory_order_relaxed); });
+    return changed.load();
+}
+
+DatabaseStats ShardedSecureDatabase::Stats() const {
+    DatabaseStats stats;
+    for (const auto& shard : shards)
+        stats += shard->Stats();
+    return stats;
+}
+
+// --------------------- Async API ---------------------
+namespace {
+    thread_local EventLoop* t_currentLoop = nullptr;
+
+    // Fire-and-forget coroutine that frees itself when it finishes
+    struct Detached {
+        struct promise_type {
+            Detached get_return_object() { return { std::coroutine_handle<promise_type>::from_promise(*this) }; }
+            std::suspend_always initial_suspend() const noexcept { return {}; }
+            std::suspend_never final_suspend() const noexcept { return {}; }
+            void return_void() const noexcept {}
+            void unhandled_exception() const noexcept { std::terminate(); }
+        };
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    Detached RunDetached(Task<void> task, size_t& live) {
+        try {
+            co_await task;
+        }
+        catch (const std::exception& e) {
+            std::cout << "Unhandled exception in spawned task: " << e.what() << "\n";
+        }
+        --live;
+    }
+}
+
+EventLoop* EventLoop::Current() {
+    return t_currentLoop;
+}
+
+void EventLoop::Post(std::coroutine_handle<> resume) {
+    std::lock_guard<std::mutex> guard(mutex);
+    ready.push_back(resume);
+    wake.notify_one();
+}
+
+void EventLoop::Spawn(Task<void> task) {
+    ++live;
+    Post(RunDetached(std::move(task), live).handle);
+}
+
+void EventLoop::Run() {
+    EventLoop* outer = std::exchange(t_currentLoop, this);
+    std::deque<std::coroutine_handle<>> batch;
+    while (live) {
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            wake.wait(guard, [&] { return !ready.empty(); });
+            batch.swap(ready);
+        }
+        for (std::coroutine_handle<> h : batch)
+            h.resume();
+        batch.clear();
+    }
+    t_currentLoop = outer;
+}
+
+IoExecutor::IoExecutor(size_t threads) {
+    for (size_t i = 0; i < std::max<size_t>(1, threads); i++)
+        workers.emplace_back(&IoExecutor::WorkerLoop, this);
+}
+
+IoExecutor::~IoExecutor() noexcept {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& w : workers)
+        w.join();
+}
+
+void IoExecutor::Post(IoWork* work) {
+    work->next = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (tail)
+            tail->next = work;
+        else
+            head = work;
+        tail = work;
+    }
+    depth.fetch_add(1, std::memory_order_relaxed);
+    wake.notify_one();
+}
+
+void IoExecutor::WorkerLoop() {
+    for (;;) {
+        IoWork* work;
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            wake.wait(guard, [&] { return stopping || head; });
+            if (!head)
+                return;     // stopping and drained
+            work = head;
+            head = work->next;
+            if (!head)
+                tail = nullptr;
+        }
+        depth.fetch_sub(1, std::memory_order_relaxed);
+        work->run(work);
+    }
+}
+
+Task<bool> AsyncSecureDatabase::AddUser(User user, Session session) {
+    co_return co_await IoOperation(io, [&] { return db.AddUser(user, session); });
+}
+
+Task<std::unique_ptr<User>> AsyncSecureDatabase::GetUser(std::string username, Session session) {
+    co_return co_await IoOperation(io, [&] { return db.GetUser(username, session); });
+}
+
+Task<bool> AsyncSecureDatabase::UpdatePassword(std::string username, std::string newPassword, Session session) {
+    co_return co_await IoOperation(io, [&] { return db.UpdatePassword(username, newPassword, session); });
+}
+
+Task<bool> AsyncSecureDatabase::DeleteUser(std::string username, Session session) {
+    co_return co_await IoOperation(io, [&] { return db.DeleteUser(username, session); });
+}
@@ -1,45 +1,1915 @@
-#pragma once
-#ifndef SECUREDATABASE_H
-#define SECUREDATABASE_H
-
-#include <string>
-#include <memory>
-#include <vector>
-#include <iostream>
-#include <cassert>
-
-// Simple user structure
-struct User {
-    std::string username;
-    std::string password; // stored encrypted
-    std::string role;     // e.g., "admin", "user"
-};
-
-// RAII wrapper for database connection (simulated)
-class DBConnection {
-public:
-    DBConnection();
-    ~DBConnection() noexcept;
-    bool execute(const std::string& query, const std::vector<std::string>& params);
-};
-
-class SecureDatabase {
-public:
-    SecureDatabase();
-    ~SecureDatabase() noexcept;
-
-    // CRUD operations
-    bool AddUser(const User& user, const std::string& currentRole);
-    std::unique_ptr<User> GetUser(const std::string& username, const std::string& currentRole);
-    bool UpdatePassword(const std::string& username, const std::string& newPassword, const std::string& currentRole);
-    bool DeleteUser(const std::string& username, const std::string& currentRole);
-
-private:
-    std::unique_ptr<DBConnection> db;
-
-    bool Authorized(const std::string& role, const std::string& operation);
-    std::string Encrypt(const std::string& plainText);
-    void Log(const std::string& message);
-};
-
-#endif // SECUREDATABASE_H
+#pragma once
+#ifndef SECUREDATABASE_H
+#define SECUREDATABASE_H
+
+#include <string>
+#include <string_view>
+#include <span>
+#include <array>
+#include <bit>
+#include <initializer_list>
+#include <memory>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <list>
+#include <deque>
+#include <unordered_map>
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <condition_variable>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <future>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <cassert>
+
+// Simple user structure
+struct User {
+    std::string username;
+    std::string password; // stored encrypted
+    std::string role;     // e.g., "admin", "user"
+};
+
+// Longest field the storage formats (WAL records, snapshots) can encode;
+// statements binding a longer value are rejected
+constexpr size_t kMaxFieldBytes = UINT16_MAX;
+
+// Parameterized statements understood by the embedded storage engine
+namespace sql {
+    constexpr const char* kInsertUser = "INSERT INTO Users (username, password, role) VALUES (?, ?, ?)";
+    constexpr const char* kSelectUser = "SELECT username, password, role FROM Users WHERE username = ?";
+    constexpr const char* kUpdatePassword = "UPDATE Users SET password = ? WHERE username = ?";
+    constexpr const char* kDeleteUser = "DELETE FROM Users WHERE username = ?";
+    constexpr const char* kChangeRole = "UPDATE Users SET role = ? WHERE role = ?";
+
+    // Multi-row forms: the INSERT prefix is followed by N "(?, ?, ?)" tuples,
+    // the DELETE prefix by N "?" placeholders and a closing ")"
+    constexpr const char* kInsertUsersPrefix = "INSERT INTO Users (username, password, role) VALUES ";
+    constexpr const char* kDeleteUsersPrefix = "DELETE FROM Users WHERE username IN (";
+    std::string InsertUsers(size_t rows);
+    std::string DeleteUsers(size_t rows);
+}
+
+// In-memory user table with an open-addressing hash index on username.
+// Rows live in a dense vector (freed rows are recycled); the index is a
+// power-of-two array of {hash, row} slots probed linearly, so a lookup is
+// a few adjacent cache lines and never allocates.
+class UserTable {
+public:
+    explicit UserTable(size_t expectedRows = 0);
+
+    bool Insert(const User& user);                    // false if username exists
+    const User* Find(std::string_view username) const;
+    User* Find(std::string_view username);
+    bool Erase(std::string_view username);
+    void Reserve(size_t expectedRows);
+    size_t Size() const { return count; }
+
+    // Visits every live row (order unspecified)
+    template <class F>
+    void ForEach(F&& visit) const {
+        for (const Slot& s : slots)
+            if (s.row != kEmpty && s.row != kDeleted)
+                visit(rows[s.row]);
+    }
+
+    static uint32_t Hash(std::string_view key);
+
+private:
+    static constexpr uint32_t kEmpty = 0xFFFFFFFFu;
+    static constexpr uint32_t kDeleted = 0xFFFFFFFEu;
+
+    struct Slot {
+        uint32_t hash;
+        uint32_t row;   // kEmpty / kDeleted or index into rows
+    };
+
+    std::vector<User> rows;
+    std::vector<uint32_t> freeRows;
+    std::vector<Slot> slots;
+    size_t mask = 0;
+    size_t count = 0;
+    size_t deleted = 0;
+
+    size_t FindSlot(std::string_view key, uint32_t hash) const; // slot index or SIZE_MAX
+    void Rehash(size_t newCapacity);
+};
+
+// Borrowed view of a row, e.g. one stored in a memory-mapped snapshot
+struct UserRef {
+    std::string_view username;
+    std::string_view password;
+    std::string_view role;
+};
+
+// Read-only, memory-mapped snapshot of the user table. Lookups probe the
+// mapped index and return views into the mapping, so nothing is
+// deserialized and opening costs the same for any number of rows.
+//
+// File layout (native endian, offsets from the start of the file):
+//   header  64 bytes: magic "UDBSNAP1", version, CRC-32 of the header,
+//           row count, slot count, slot/order/data offsets, body CRC-32,
+//           write-ahead log mark the rows extend to (0: none)
+//   slots   power-of-two array of {u32 hash, u32 unused, u64 record offset}
+//           (offset 0 = empty), probed linearly with UserTable::Hash
+//   order   one u64 record offset per row, in username (byte) order
+//   data    records of u16 username/password/role lengths, then the bytes,
+//           written in username order so range scans read sequentially
+// Version 1 files have no order array; Open() sorts one in memory.
+class Snapshot {
+public:
+    static constexpr uint32_t kVersion = 2;
+
+    ~Snapshot() noexcept;
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    // Maps the file and validates its header only; nullptr if missing or
+    // invalid. The body is not read up front: every record offset and length
+    // taken from it is checked against the mapping when it is decoded, so a
+    // corrupt body costs missing rows, never a read outside the file.
+    static std::shared_ptr<const Snapshot> Open(const std::string& path);
+    // Writes the rows to a temporary file, syncs it and renames it over 'path'.
+    // 'walMark' is the WalOp::Mark generation the rows include the log up to
+    static bool Write(const std::string& path, std::span<const UserRef> rows, uint32_t walMark = 0);
+
+    bool Find(std::string_view username, UserRef& out) const;
+    bool Contains(std::string_view username) const { UserRef r; return Find(username, r); }
+    size_t Size() const { return rows; }
+    size_t Bytes() const { return size; }
+    uint32_t WalMark() const { return walMark; }
+    bool Verify() const;    // checks the body CRC; reads the whole file
+
+    // Position of the first row whose username is >= key (> key if 'after');
+    // Size() if there is none. At() reads the row at a position.
+    size_t Seek(std::string_view key, bool after) const;
+    UserRef At(size_t i) const {
+        UserRef r;
+        uint64_t next;
+        Decode(order[i], r, next);
+        return r;
+    }
+
+    // Visits every row in file order, stopping at a record that does not fit
+    template <class F>
+    void ForEach(F&& visit) const {
+        UserRef r;
+        for (uint64_t at = dataOffset; at < size && Decode(at, r, at);)
+            visit(r);
+    }
+
+private:
+    Snapshot() = default;
+
+    struct Slot {
+        uint32_t hash;
+        uint32_t unused;
+        uint64_t offset;
+    };
+
+    const char* base = nullptr;
+    size_t size = 0;
+    size_t rows = 0;
+    const Slot* slots = nullptr;
+    size_t mask = 0;
+    size_t dataOffset = 0;
+    uint32_t bodyCrc = 0;
+    uint32_t walMark = 0;
+    const uint64_t* order = nullptr;
+    std::vector<uint64_t> legacyOrder;  // version 1 files only
+
+    // Decodes the record at file offset 'at' and sets 'next' past it; false
+    // (and 'out' empty) if the record does not lie inside the data region
+    bool Decode(uint64_t at, UserRef& out, uint64_t& next) const {
+        uint16_t lengths[3];
+        if (at < dataOffset || at > size || size - at < sizeof(lengths)) {
+            out = {};
+            return false;
+        }
+        std::memcpy(lengths, base + at, sizeof(lengths));
+        const char* p = base + at + sizeof(lengths);
+        size_t body = size_t(lengths[0]) + lengths[1] + lengths[2];
+        if (size - at - sizeof(lengths) < body) {
+            out = {};
+            return false;
+        }
+        out = { { p, lengths[0] }, { p + lengths[0], lengths[1] }, { p + lengths[0] + lengths[1], lengths[2] } };
+        next = at + sizeof(lengths) + body;
+        return true;
+    }
+};
+
+// Fixed-capacity list of parameter views: binding needs no heap allocation.
+// The viewed strings must outlive the execute()/query() call.
+template <size_t Capacity>
+class ParamList {
+public:
+    ParamList() = default;
+    ParamList(std::initializer_list<std::string_view> init) {
+        assert(init.size() <= Capacity);
+        for (std::string_view v : init)
+            items[count++] = v;
+    }
+
+    void push_back(std::string_view v) {
+        assert(count < Capacity);
+        items[count++] = v;
+    }
+    std::string_view operator[](size_t i) const { return items[i]; }
+    size_t size() const { return count; }
+
+private:
+    std::array<std::string_view, Capacity> items{};
+    size_t count = 0;
+};
+
+// Enough for every single-row statement
+using InlineParams = ParamList<4>;
+
+// Put (insert or replace) is only written when compaction rewrites the log.
+// ChangeRole carries the old role in the username field. Mark carries a u32
+// compaction generation in the username field: the snapshot stamped with
+// that generation holds every record logged before the mark, so recovery
+// replays only what follows it. Replaying a ChangeRole twice would move rows
+// the second time, so nothing a snapshot already holds may be replayed.
+enum class WalOp : uint8_t { Insert = 1, UpdatePassword = 2, Delete = 3, Put = 4, ChangeRole = 5, Mark = 6 };
+
+struct UserStore;
+
+struct WalStats {
+    uint64_t records = 0;
+    uint64_t groups = 0;        // fdatasync calls
+    uint64_t bytes = 0;
+    uint64_t syncNanos = 0;     // total time spent in write + fdatasync
+};
+
+// Append-only write-ahead log with group commit. Mutations append encoded
+// records to the open group and get back that group's future; a committer
+// thread lets the group collect appends for up to 'window' (or until it
+// reaches maxGroupBytes), then writes it and issues a single fdatasync
+// before completing the future for every record in it. Once a write or
+// sync fails, every later group fails as well until Rewrite() replaces the
+// file, so nothing is acknowledged behind a torn group.
+//
+// Record layout: u32 payload length, u32 CRC-32 of the payload, payload =
+// u8 op, u16 username/password/role lengths, then the bytes.
+class WriteAheadLog {
+public:
+    WriteAheadLog(const std::string& path, std::chrono::microseconds window, size_t maxGroupBytes);
+    ~WriteAheadLog() noexcept;      // commits everything appended so far
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    bool IsOpen() const { return fd >= 0; }
+    std::shared_future<void> Append(std::string_view records, size_t count);
+    WalStats Stats() const;
+    uint64_t Size() const { return fileBytes.load(std::memory_order_relaxed); }     // current file length
+    // Atomically replaces the whole log with 'records' (temp file + rename).
+    // Records still waiting in the open group are dropped: the caller must
+    // hold off appends and make 'records' cover them; their waiters complete
+    // once the new file is synced.
+    bool Rewrite(std::string_view records);
+
+    static void Encode(std::string& out, WalOp op, std::string_view username,
+                       std::string_view password = {}, std::string_view role = {});
+    static void EncodeMark(std::string& out, uint32_t generation);
+    // Replays every intact record that follows Mark(snapshotMark) into
+    // 'store' (all of them for 0, or while the log is older than any mark)
+    // and truncates a torn tail left by a crash. Sets 'lastMark' to the
+    // highest mark seen. Returns the number of records applied.
+    static size_t Recover(const std::string& path, UserStore& store, uint32_t snapshotMark, uint32_t& lastMark);
+
+private:
+    std::string path;
+    int fd = -1;
+    std::atomic<uint64_t> fileBytes{ 0 };
+    std::chrono::microseconds window;
+    size_t maxGroupBytes;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::string pending;
+    size_t pendingRecords = 0;
+    std::promise<void> group;
+    std::shared_future<void> groupFuture;
+    bool stopping = false;
+    bool committing = false;        // committer is using fd without the mutex
+    bool failed = false;            // a group failed; refuse the rest (committer, or under mutex when idle)
+    std::condition_variable idle;
+    WalStats stats;
+    std::thread committer;
+
+    void CommitLoop();
+};
+
+// Epoch-based reclamation for the lock-free read path. A reader pins the
+// global epoch while it holds pointers into shared structures; writers
+// Retire() what they unlink, and it is freed only once every thread that
+// was pinned when it was retired has unpinned. One process-wide domain
+// with a fixed number of thread slots; guards nest.
+class Epoch {
+public:
+    static constexpr size_t kMaxThreads = 1024;
+
+    class Guard {
+    public:
+        Guard();
+        ~Guard() noexcept;
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    };
+
+    template <class T>
+    static void Retire(const T* p) {
+        Retire(const_cast<T*>(p), [](void* q) { delete static_cast<T*>(q); });
+    }
+    static void Retire(void* p, void (*free)(void*));
+    static size_t Pending();    // retired but not yet freed
+};
+
+// One version of a row, immutable once published. 'older' links to the
+// version it replaced, for readers whose timestamp predates this one.
+struct UserVersion {
+    User row;
+    bool deleted = false;       // tombstone
+    uint64_t commit = 0;        // UserStore::clock value that made it visible
+    const UserVersion* older = nullptr;
+
+    // Newest version in the chain visible at 'ts'; nullptr if none
+    static const UserVersion* VisibleAt(const UserVersion* v, uint64_t ts) {
+        while (v && v->commit > ts)
+            v = v->older;
+        return v;
+    }
+};
+
+// Usernames in byte order, readable without locks: an insert-only skip
+// list. Nodes are fully built before a release store links them in,
+// bottom level first, so a reader that follows any link finds a complete
+// node and never misses a key that was linked before it started. Keys
+// are never removed; the list is dropped whole with its VersionedIndex,
+// so nodes, their links and their keys are carved out of large blocks
+// rather than allocated one by one. One writer at a time. A key above the
+// last one inserted starts its search from that insert's path rather than
+// the head, so keys arriving in order (a sorted import, a rebase) cost
+// O(1) each.
+class OrderedKeys {
+public:
+    struct Node;
+
+    OrderedKeys();
+    ~OrderedKeys() noexcept;
+    OrderedKeys(const OrderedKeys&) = delete;
+    OrderedKeys& operator=(const OrderedKeys&) = delete;
+
+    void Insert(std::string_view key);      // the key must not be present yet
+    // First node whose key is >= key (> key if 'after'); nullptr at the end
+    const Node* Seek(std::string_view key, bool after) const;
+    static const Node* Next(const Node* node);
+    static std::string_view Key(const Node* node);
+
+private:
+    static constexpr int kMaxHeight = 16;
+    static constexpr size_t kBlockBytes = 64 << 10;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* tail = nullptr;           // unused end of the newest block
+    size_t tailBytes = 0;
+    Node* head;                     // kMaxHeight links, no key
+    Node* last = nullptr;           // the node inserted last
+    Node* finger[kMaxHeight];       // per level, the rightmost node at or before 'last' when it went in
+    uint64_t random = 0x9E3779B97F4A7C15ull;
+
+    int RandomHeight();
+    void* Allocate(size_t bytes, size_t align);
+    Node* NewNode(std::string_view key, int height);
+};
+
+// Username -> newest version, readable without locks. Open addressing with
+// linear probing like UserTable, but slots are never freed (a delete
+// publishes a tombstone version, dropped when the store swaps in a fresh
+// index: at the next compaction, or by UserStore::Rebase) and
+// growing publishes a new slot array, so a reader still probing the old
+// array sees valid, if older, versions. One writer at a time.
+class VersionedIndex {
+public:
+    explicit VersionedIndex(size_t expectedRows = 0);
+    ~VersionedIndex() noexcept;     // frees the newest versions; replaced ones were retired
+    VersionedIndex(const VersionedIndex&) = delete;
+    VersionedIndex& operator=(const VersionedIndex&) = delete;
+
+    const UserVersion* Find(std::string_view username) const;
+    // Makes 'version' the newest for its username; returns the one it replaced
+    const UserVersion* Publish(UserVersion* version);
+    // Adds a version another index holds, as it is, for a username not in
+    // this one. Once the other index's versions are adopted, Disown() makes
+    // it free only those in 'left' instead.
+    void Adopt(const UserVersion* version);
+    void Disown(std::vector<const UserVersion*> left) { ownsVersions = false; orphans = std::move(left); }
+    size_t Rows() const { return rows; }                // usernames whose newest version is live
+    size_t Tombstones() const { return tombstones; }
+    const OrderedKeys& Keys() const { return keys; }    // every username ever published, sorted
+
+    // Visits the newest version of every username
+    template <class F>
+    void ForEach(F&& visit) const {
+        const Table* t = table.load(std::memory_order_acquire);
+        for (size_t i = 0; i <= t->mask; i++)
+            if (const UserVersion* v = t->slots[i].head.load(std::memory_order_acquire))
+                visit(*v);
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> hash{ 0 };
+        std::atomic<const UserVersion*> head{ nullptr };
+    };
+    struct Table {
+        explicit Table(size_t capacity) : mask(capacity - 1), slots(new Slot[capacity]) {}
+        size_t mask;
+        std::unique_ptr<Slot[]> slots;
+    };
+
+    std::atomic<Table*> table;
+    OrderedKeys keys;
+    bool ownsVersions = true;
+    std::vector<const UserVersion*> orphans;    // freed instead once disowned
+    size_t used = 0;
+    size_t rows = 0;
+    size_t tombstones = 0;
+
+    void Grow();
+};
+
+// Compressed set of 32-bit IDs, roaring style: values are grouped by their
+// high 16 bits into containers holding the low 16 bits, either as a sorted
+// array (up to 4096 values) or as a 65536-bit bitmap, whichever is smaller.
+class RoaringBitmap {
+public:
+    bool Add(uint32_t value);       // false if already present
+    bool Remove(uint32_t value);    // false if absent
+    bool Contains(uint32_t value) const;
+    uint64_t Cardinality() const { return cardinality; }
+    size_t Bytes() const;
+    void Clear();
+    RoaringBitmap& operator|=(const RoaringBitmap& other);
+
+    // Visits every value in ascending order
+    template <class F>
+    void ForEach(F&& visit) const {
+        for (const Container& c : containers) {
+            uint32_t high = uint32_t(c.key) << 16;
+            if (c.bits.empty()) {
+                for (uint16_t low : c.array)
+                    visit(high | low);
+                continue;
+            }
+            for (size_t w = 0; w < kWords; w++)
+                for (uint64_t word = c.bits[w]; word; word &= word - 1)
+                    visit(high | uint32_t(w * 64 + std::countr_zero(word)));
+        }
+    }
+
+private:
+    static constexpr size_t kArrayMax = 4096;   // 8 KiB either way
+    static constexpr size_t kWords = 65536 / 64;
+
+    struct Container {
+        uint16_t key = 0;
+        uint32_t count = 0;
+        std::vector<uint16_t> array;    // sorted; used while 'bits' is empty
+        std::vector<uint64_t> bits;
+    };
+
+    std::vector<Container> containers;  // sorted by key
+    uint64_t cardinality = 0;
+
+    static void ToBitmap(Container& c);
+    static void ToArray(Container& c);
+    static void UnionInto(Container& into, const Container& from);
+};
+
+// Role -> users holding it. Usernames and role strings are interned to
+// dense IDs on first sight and never released, so a bitmap of user IDs per
+// role answers "who has role X" without touching the rows, and a bulk role
+// change is one bitmap union. Guarded by UserStore::lock.
+class RoleIndex {
+public:
+    uint32_t UserId(std::string_view username);         // interns
+    // Valid until the next UserId() call
+    std::string_view Username(uint32_t id) const {
+        size_t start = id ? nameEnds[id - 1] : 0;
+        return std::string_view(names).substr(start, nameEnds[id] - start);
+    }
+    void Add(uint32_t user, std::string_view role);
+    void Remove(uint32_t user, std::string_view role);
+    // Moves every user holding 'from' to 'to'; returns how many moved
+    uint64_t Reassign(std::string_view from, std::string_view to);
+    const RoaringBitmap* Users(std::string_view role) const;    // nullptr if never seen
+    size_t Roles() const { return members.size(); }
+    size_t Bytes() const;
+
+private:
+    struct KeyHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view key) const { return std::hash<std::string_view>{}(key); }
+    };
+    struct Slot {
+        uint32_t hash;
+        uint32_t id;        // kNoUser if empty
+    };
+    static constexpr uint32_t kNoUser = 0xFFFFFFFFu;
+
+    // usernames back to back, found through an open-addressing table of IDs
+    // like UserTable's: no per-name allocation
+    std::string names;
+    std::vector<uint64_t> nameEnds;                 // by ID
+    std::vector<Slot> slots;
+    std::unordered_map<std::string, uint32_t, KeyHash, std::equal_to<>> roleIds;
+    std::vector<RoaringBitmap> members;             // by role ID
+
+    uint32_t RoleId(std::string_view role);
+    void Grow();
+};
+
+// A bulk role change, applied on read to rows written before it
+struct RoleRemap {
+    std::string from;
+    std::string to;
+    uint64_t commit;
+};
+using RoleRemaps = std::vector<RoleRemap>;
+
+// Storage shared by every connection to the same database: an optional
+// read-only snapshot plus a multi-version delta of the rows inserted,
+// changed or deleted since it was written, published together as one View.
+//
+// Writers hold the lock exclusively. Every version a statement writes is
+// stamped clock + 1 and becomes visible when Publish() advances the clock,
+// so readers see a statement's rows all at once. Readers take no lock: they
+// pin the epoch, load the view, read the clock and use the newest version
+// no later than it. Compaction swaps the whole view. With lockFreeReads
+// off, readers take the lock shared instead (the reader-writer baseline).
+// When a WAL is attached, mutations are logged under the lock, so log
+// order is apply order.
+//
+// ChangeRole() does not rewrite rows: it moves the users between the role
+// index bitmaps and publishes a remap that readers apply to every row
+// version written before it. Compaction folds the remaps into the new
+// snapshot and carries over those published while it wrote. The role index is built from the snapshot when the database
+// opens, before the log is replayed, and kept current by every write.
+//
+// Publish() also rebases the delta itself, snapshot or not, once
+// kRebaseRemaps remaps have piled up (every read walks the list), and
+// without a snapshot, where nothing compacts, once deletes have left more
+// tombstones than live rows, unless a compaction is between its copy and
+// its swap: folding remaps away would hide the ones it has to carry over
+// to rows it already wrote. The live rows are copied into a fresh index
+// with their roles resolved, snapshot rows a remap changes get a version
+// of their own, and tombstones are kept only for snapshot rows; the new
+// view has no remaps. The old one, with its tombstones, slots, key-list
+// nodes and remap list, is retired through Epoch and freed once no reader
+// can still be in it.
+struct UserStore {
+    struct View {
+        View() = default;
+        ~View() noexcept { delete remaps.load(std::memory_order_relaxed); }
+        std::shared_ptr<const Snapshot> snapshot;
+        VersionedIndex delta;
+        std::atomic<const RoleRemaps*> remaps{ nullptr };   // ordered by commit
+    };
+
+    UserStore();
+    ~UserStore() noexcept;
+    UserStore(const UserStore&) = delete;
+    UserStore& operator=(const UserStore&) = delete;
+
+    std::atomic<View*> view;
+    std::atomic<uint64_t> clock{ 0 };
+    std::shared_mutex lock;
+    bool lockFreeReads = true;
+    WriteAheadLog* wal = nullptr;
+    std::atomic<bool> compacting{ false };     // holds off Rebase(); set under the lock
+
+    // Reads as of the current clock; the caller holds an Epoch::Guard for
+    // as long as it uses 'out'. Scan visits one consistent point in time.
+    bool Lookup(std::string_view username, UserRef& out) const;
+    void Scan(const std::function<void(const UserRef&)>& visit) const;
+    // Up to 'limit' rows whose username starts with 'prefix', in username
+    // order, starting after 'cursor' if it is set and not before 'prefix'.
+    // Merges the snapshot's order array with the delta's key list at one
+    // point in time; returns the number of rows visited.
+    size_t List(std::string_view prefix, std::string_view cursor, size_t limit,
+        const std::function<void(const UserRef&)>& visit) const;
+
+    // Writes; the caller holds the lock exclusively and calls Publish()
+    bool Insert(User user);                         // false if username exists
+    void Put(User user);                            // insert or replace
+    bool SetPassword(std::string_view username, std::string_view password);
+    bool Erase(std::string_view username);
+    uint64_t ChangeRole(std::string_view from, std::string_view to);    // returns the users moved
+    void Publish();
+    void Rebase();      // see above; the caller holds the lock exclusively
+
+    // Role index; writes keep it current, readers hold the lock at least
+    // shared. IndexRoles() adds the snapshot's rows, once, before any write.
+    // UsersWithRole visits in user ID order.
+    void IndexRoles();
+    size_t UsersWithRole(std::string_view role, const std::function<void(const UserRef&)>& visit) const;
+    const RoleIndex* Roles() const { return roles.get(); }
+
+    // 'role' of a row version committed at 'written', as seen at 'ts'
+    static std::string_view RemapRole(const RoleRemaps* remaps, std::string_view role, uint64_t written, uint64_t ts) {
+        if (remaps) {
+            for (const RoleRemap& r : *remaps) {
+                if (r.commit > ts)
+                    break;
+                if (r.commit > written && role == r.from)
+                    role = r.to;
+            }
+        }
+        return role;
+    }
+
+    // Newest state including unpublished writes; the caller holds the lock
+    bool Current(std::string_view username, UserRef& out) const;
+    template <class F>
+    void ForEach(F&& visit) const {
+        const View& v = *view.load(std::memory_order_acquire);
+        if (v.snapshot) {
+            v.snapshot->ForEach([&](const UserRef& r) {
+                if (!v.delta.Find(r.username))
+                    visit(r);
+            });
+        }
+        v.delta.ForEach([&](const UserVersion& ver) {
+            if (!ver.deleted)
+                visit(UserRef{ ver.row.username, ver.row.password, ver.row.role });
+        });
+    }
+
+private:
+    static constexpr size_t kRebaseTombstones = 1024;  // below this, tombstones are cheaper than a rebase
+    static constexpr size_t kRebaseRemaps = 32;
+
+    std::vector<const UserVersion*> superseded;     // retired by the next Publish()
+    std::unique_ptr<RoleIndex> roles = std::make_unique<RoleIndex>();
+
+    // 'before' is the row 'version' replaces, or nullptr if there is none
+    void Write(UserVersion* version, const UserRef* before);
+};
+
+// Compiled form of a parameterized statement. Handles returned by
+// DBConnection::prepare stay valid for the lifetime of the connection and
+// are rebound with fresh parameters on every execute()/query(). They carry
+// no connection state, so any connection on the same store can run them.
+struct PreparedStatement {
+    enum class Kind { InsertUsers, SelectUser, UpdatePassword, DeleteUser, DeleteUsers, ChangeRole };
+    Kind kind;
+    size_t rows;        // row tuples for the multi-row forms, 1 otherwise
+    size_t paramCount;
+};
+
+struct StatementCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    size_t entries = 0;
+};
+
+// RAII wrapper for database connection (embedded storage engine)
+class DBConnection {
+public:
+    DBConnection();                                   // private store
+    explicit DBConnection(std::shared_ptr<UserStore> store);
+    ~DBConnection() noexcept;
+
+    // Looks the statement up in the prepared-statement cache, compiling it on
+    // a miss. Returns nullptr for statements the engine does not support.
+    const PreparedStatement* prepare(const std::string& query);
+
+    bool execute(const std::string& query, const std::vector<std::string>& params);
+    bool execute(const PreparedStatement& stmt, const std::vector<std::string>& params);
+    bool execute(const PreparedStatement& stmt, const InlineParams& params);
+    // Rows inserted/updated/deleted by the last execute()
+    size_t changes() const { return lastChanges; }
+    // Per-row outcome of the last execute(): 1 if row i was affected
+    const std::vector<uint8_t>& rowResults() const { return rowStatus; }
+    // Completes once the last execute()'s changes are durable; invalid when
+    // nothing was logged (no WAL, or no rows affected)
+    std::shared_future<void> durable() const { return lastDurable; }
+    // SELECT variant: copies the matching row into 'row', false if none
+    bool query(const std::string& query, const std::vector<std::string>& params, User& row);
+    bool query(const PreparedStatement& stmt, const std::vector<std::string>& params, User& row);
+    // Copies into the caller's row, reusing its string capacity
+    bool query(const PreparedStatement& stmt, const InlineParams& params, User& row);
+
+    // Disabling the cache makes prepare() recompile on every call
+    void SetStatementCache(bool enabled) { cacheEnabled = enabled; }
+    StatementCacheStats statementCacheStats() const;
+
+private:
+    struct QueryHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+    };
+
+    std::shared_ptr<UserStore> store;
+    size_t lastChanges = 0;
+    std::vector<uint8_t> rowStatus;
+    std::string walRecords;
+    std::shared_future<void> lastDurable;
+
+    std::unordered_map<std::string, std::unique_ptr<PreparedStatement>, QueryHash, std::equal_to<>> statements;
+    // Uncached compiles, one owned handle per statement shape (kind, rows), so
+    // handles stay valid while the statement text is still parsed every call
+    std::unordered_map<uint64_t, std::unique_ptr<PreparedStatement>> uncached;
+    bool cacheEnabled = true;
+    // counters may be read by another thread while the connection is checked out
+    std::atomic<uint64_t> cacheHits{ 0 };
+    std::atomic<uint64_t> cacheMisses{ 0 };
+    std::atomic<size_t> cacheEntries{ 0 };
+
+    static bool Compile(std::string_view query, PreparedStatement& stmt);
+    template <class Params>
+    bool Execute(const PreparedStatement& stmt, const Params& params);
+    template <class Params>
+    bool Query(const PreparedStatement& stmt, const Params& params, User& row);
+};
+
+struct PoolStats {
+    size_t size = 0;
+    size_t inUse = 0;
+    size_t peakInUse = 0;
+    uint64_t acquires = 0;
+    uint64_t waits = 0;         // acquires that found no idle connection
+    uint64_t timeouts = 0;
+    uint64_t totalWaitNanos = 0;
+};
+
+// Bounded pool of connections to one store. Acquire() blocks until a
+// connection is idle or the timeout expires; the returned Lease checks the
+// connection back in when it goes out of scope.
+class ConnectionPool {
+public:
+    class Lease {
+    public:
+        Lease() = default;
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&& other) noexcept;
+        ~Lease() noexcept;
+
+        explicit operator bool() const { return conn != nullptr; }
+        DBConnection* operator->() const { return conn; }
+        DBConnection& operator*() const { return *conn; }
+
+    private:
+        friend class ConnectionPool;
+        Lease(ConnectionPool* pool, DBConnection* conn) : pool(pool), conn(conn) {}
+        ConnectionPool* pool = nullptr;
+        DBConnection* conn = nullptr;
+    };
+
+    ConnectionPool(std::shared_ptr<UserStore> store, size_t size, std::chrono::milliseconds timeout);
+    ~ConnectionPool() noexcept;
+
+    Lease Acquire();                                   // uses the pool timeout
+    Lease Acquire(std::chrono::milliseconds timeout);  // empty Lease on timeout
+
+    PoolStats Stats() const;
+    StatementCacheStats StatementStats() const;        // summed over all connections
+
+private:
+    void Release(DBConnection* conn) noexcept;
+
+    std::vector<std::unique_ptr<DBConnection>> connections;
+    std::vector<DBConnection*> idle;
+    std::chrono::milliseconds timeout;
+    mutable std::mutex mutex;
+    std::condition_variable available;
+    PoolStats stats;
+};
+
+// AuditKind, DbOp and Role values are stored in binary audit logs, so each
+// has a fixed number: new values go at the end, none is ever renumbered
+enum class AuditKind : uint8_t { Notice = 0, Failure = 1, Denied = 2 };
+constexpr uint8_t kAuditNoOp = 0xff;        // op and role fields hold DbOp / Role values or these
+constexpr uint8_t kAuditNoRole = 0xff;
+
+// Fixed-size audit record; longer messages are truncated
+struct AuditRecord {
+    static constexpr size_t kMaxText = 241;
+    uint64_t timestampNanos;    // system_clock since epoch
+    uint32_t length;
+    AuditKind kind;
+    uint8_t op;
+    uint8_t role;
+    char text[kMaxText];
+};
+
+enum class AuditOverflow { Drop, Block };
+enum class AuditFormat { Text, Binary };
+
+// On-disk layout of a binary audit log. The file is a run of 64 KiB
+// blocks, each a header followed by up to kRecordsPerBlock fixed-width
+// records. Records are in timestamp order through the whole file (the
+// writer sorts every batch and never lets a timestamp go backwards), and
+// each header carries the block's time range and which ops, roles and
+// kinds occur in it, so a reader can binary-search on time and skip
+// blocks that cannot match. Only the last block is ever partly filled;
+// its header is rewritten after its records, so 'count' never covers a
+// record that is not on disk yet. Little-endian, native struct layout.
+namespace auditfile {
+    constexpr uint32_t kMagic = 0x31445541;     // "AUD1"
+    constexpr size_t kBlockBytes = 64 * 1024;
+    constexpr size_t kTextBytes = 116;
+
+    struct Record {
+        uint64_t timestampNanos;
+        uint8_t kind;           // AuditKind
+        uint8_t op;             // DbOp or kAuditNoOp
+        uint8_t role;           // Role or kAuditNoRole
+        uint8_t length;
+        char text[kTextBytes];
+    };
+
+    struct BlockHeader {
+        uint32_t magic;
+        uint32_t count;
+        uint64_t minTimestamp;
+        uint64_t maxTimestamp;
+        uint32_t opMask;        // bit per DbOp; bit 31 for records without one
+        uint8_t roleMask;       // bit per Role; bit 7 for records without one
+        uint8_t kindMask;       // bit per AuditKind
+        uint8_t reserved[sizeof(Record) - 30];
+    };
+
+    static_assert(sizeof(Record) == 128 && sizeof(BlockHeader) == sizeof(Record));
+    constexpr size_t kRecordsPerBlock = (kBlockBytes - sizeof(BlockHeader)) / sizeof(Record);
+
+    constexpr uint32_t OpBit(uint8_t op) { return 1u << (op < 31 ? op : 31); }
+    constexpr uint8_t RoleBit(uint8_t role) { return static_cast<uint8_t>(1u << (role < 7 ? role : 7)); }
+    constexpr uint8_t KindBit(uint8_t kind) { return static_cast<uint8_t>(1u << (kind & 7)); }
+}
+
+struct AuditLogStats {
+    uint64_t written = 0;
+    uint64_t dropped = 0;
+    uint64_t batches = 0;       // buffered writes issued to the sink
+    uint64_t lost = 0;          // binary format: records discarded after their block failed to write
+};
+
+// Asynchronous audit log. Producers claim slots in a lock-free bounded
+// MPSC ring (sequence-numbered cells) and never touch the sink; a single
+// writer thread drains the ring into one large buffered write per batch.
+// When the ring is full, Push() spins until space frees up (Block, the
+// default) or drops the record; drops are counted, and the writer logs a
+// failure record with the running total so the gap is visible in the log
+// itself. Destruction drains every queued record and flushes.
+// The sink is text lines or the binary block format (auditfile above).
+class AuditLog {
+public:
+    static constexpr size_t kDefaultCapacity = 4096;
+
+    // An empty path writes text to stdout, whatever the format
+    explicit AuditLog(const std::string& path = "", size_t capacity = kDefaultCapacity,
+                      AuditOverflow overflow = AuditOverflow::Block, AuditFormat format = AuditFormat::Text);
+    ~AuditLog() noexcept;
+    AuditLog(const AuditLog&) = delete;
+    AuditLog& operator=(const AuditLog&) = delete;
+
+    bool Push(std::string_view message, AuditKind kind = AuditKind::Notice, uint8_t op = kAuditNoOp,
+              uint8_t role = kAuditNoRole);
+    void Flush();               // returns once everything pushed so far is in the sink
+    AuditLogStats Stats() const;
+
+private:
+    struct Cell {
+        std::atomic<uint64_t> sequence;
+        AuditRecord record;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    AuditOverflow overflow;
+    alignas(64) std::atomic<uint64_t> head{ 0 };       // next slot to claim (producers)
+    alignas(64) std::atomic<uint64_t> consumed{ 0 };   // records written by the writer
+
+    FILE* sink = nullptr;
+    bool ownsSink = false;
+    struct BinarySink;
+    std::unique_ptr<BinarySink> binary;     // set in binary format; 'sink' is unused then
+    std::atomic<bool> stopping{ false };
+    std::atomic<uint64_t> dropped{ 0 };
+    std::atomic<uint64_t> batches{ 0 };
+    std::atomic<uint64_t> lost{ 0 };
+    std::thread writer;
+
+    static constexpr size_t kBatchBytes = 64 * 1024;
+
+    void WriterLoop();
+    template <class Emit>
+    size_t Drain(Emit&& emit);
+};
+
+// Multi-buffer SHA-256: hashes 4, 8 or 16 independent inputs at once, one
+// per SIMD lane (SSE4.1 / AVX2 / AVX-512), picked by runtime CPU detection.
+// Lanes whose input has fewer blocks are masked off while the rest finish.
+namespace sha256mb {
+    constexpr size_t kDigestBytes = 32;
+
+    enum class Isa { Scalar, SSE41, AVX2, AVX512 };
+
+    Isa Detect();                       // best ISA on this CPU (cached)
+    size_t Lanes(Isa isa);
+    const char* Name(Isa isa);
+
+    // digests must hold inputs.size() * kDigestBytes bytes
+    void Hash(std::span<const std::string_view> inputs, unsigned char* digests);
+    void Hash(std::span<const std::string_view> inputs, unsigned char* digests, Isa isa);
+
+    // Lower-case hex of n bytes into out[2 * n] (SSSE3 shuffle when available)
+    void HexEncode(const unsigned char* bytes, size_t n, char* out);
+}
+
+// Reversible field-level encryption with AES-256-GCM. OpenSSL's EVP layer
+// picks the AES-NI/VAES + carry-less multiply code on CPUs that have it.
+// A sealed field is nonce (12 bytes) | ciphertext | tag (16 bytes). Every
+// seal draws a fresh random 96-bit nonce, so ciphers sharing a key (other
+// instances, other processes, restarts) need no coordination; the price is
+// NIST SP 800-38D's bound of 2^32 random-nonce seals per key, after which
+// the key must be rotated. A cipher refuses to seal past kMaxSeals itself,
+// but cannot see seals made under the same key by other instances.
+// The associated data (e.g. the username) is authenticated but not stored,
+// so a value copied onto another row fails to open. Thread-safe.
+class FieldCipher {
+public:
+    static constexpr size_t kKeyBytes = 32;
+    static constexpr size_t kNonceBytes = 12;
+    static constexpr size_t kTagBytes = 16;
+    static constexpr size_t kOverhead = kNonceBytes + kTagBytes;
+    static constexpr uint64_t kMaxSeals = uint64_t(1) << 32;
+    static constexpr size_t SealedSize(size_t plainBytes) { return plainBytes + kOverhead; }
+
+    using Key = std::array<unsigned char, kKeyBytes>;
+    static Key GenerateKey();
+
+    explicit FieldCipher(const Key& key);
+    ~FieldCipher() noexcept;        // wipes the key
+    FieldCipher(const FieldCipher&) = delete;
+    FieldCipher& operator=(const FieldCipher&) = delete;
+
+    // out holds SealedSize(plain.size()) bytes
+    bool Seal(std::string_view plain, std::string_view aad, char* out);
+    // out holds sealed.size() - kOverhead bytes; false (and out zeroed) when
+    // the field was tampered with or the associated data does not match
+    bool Open(std::string_view sealed, std::string_view aad, char* out);
+
+    // Batch forms: the key schedule is set up once per call and each record
+    // only re-seeds the nonce. Record i is written to out[offsets[i],
+    // offsets[i + 1]), so offsets holds n + 1 entries; both buffers are the
+    // caller's and can be reused across calls. aad is empty or one per record.
+    static size_t SealedBytes(std::span<const std::string_view> plain);
+    static size_t OpenedBytes(std::span<const std::string_view> sealed);
+    // Returns the number sealed: n, or the index of the first failure
+    // (0 once the cipher has used up kMaxSeals)
+    size_t SealBatch(std::span<const std::string_view> plain, std::span<const std::string_view> aad, char* out,
+                     std::span<size_t> offsets);
+    // Returns the number that opened; opened[i] (n entries) says which did.
+    // A record that fails is zeroed, never left as unauthenticated plaintext
+    size_t OpenBatch(std::span<const std::string_view> sealed, std::span<const std::string_view> aad, char* out,
+                     std::span<size_t> offsets, bool* opened);
+
+    // In place on one User column, with the username as associated data.
+    // Sealed values are binary. Rows that fail to open keep their sealed value.
+    size_t SealColumn(std::span<User> users, std::string User::* column);
+    size_t OpenColumn(std::span<User> users, std::string User::* column);
+
+private:
+    Key key;
+    std::atomic<uint64_t> seals{ 0 };
+};
+
+// Role-based access control resolved at compile time: each role maps to a
+// bitmask of permitted operations, so a check is a single bit test.
+enum class Role : uint8_t { Guest = 0, User = 1, Admin = 2 };  // unknown role strings resolve to Guest
+enum class Operation : uint8_t { Select, Insert, Update, Delete };
+
+using PermissionMask = uint8_t;
+
+constexpr PermissionMask Permit(Operation op) {
+    return static_cast<PermissionMask>(1u << static_cast<unsigned>(op));
+}
+
+constexpr PermissionMask kRolePermissions[] = {
+    /* Guest */ 0,
+    /* User  */ Permit(Operation::Select),
+    /* Admin */ Permit(Operation::Select) | Permit(Operation::Insert) | Permit(Operation::Update) | Permit(Operation::Delete),
+};
+
+constexpr bool Allows(Role role, Operation op) {
+    return (kRolePermissions[static_cast<size_t>(role)] & Permit(op)) != 0;
+}
+
+static_assert(Allows(Role::Admin, Operation::Delete) && Allows(Role::User, Operation::Select));
+static_assert(!Allows(Role::User, Operation::Insert) && !Allows(Role::Guest, Operation::Select));
+
+Role ParseRole(std::string_view role);
+const char* RoleName(Role role);
+
+// Caller identity with its permissions resolved once, up front
+class Session {
+public:
+    constexpr explicit Session(Role role) : role(role), permissions(kRolePermissions[static_cast<size_t>(role)]) {}
+    explicit Session(std::string_view role) : Session(ParseRole(role)) {}
+
+    constexpr bool Can(Operation op) const { return (permissions & Permit(op)) != 0; }
+    constexpr Role GetRole() const { return role; }
+
+private:
+    Role role;
+    PermissionMask permissions;
+};
+
+struct UserCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t invalidations = 0;
+    size_t entries = 0;
+    size_t bytes = 0;           // estimated footprint of cached entries
+    size_t capacityBytes = 0;
+    double HitRate() const { return hits + misses ? double(hits) / double(hits + misses) : 0.0; }
+};
+
+// Read-through cache of user records in front of the store. Usernames hash
+// to one of N shards, each an LRU list plus index under its own mutex with
+// an equal share of the byte budget. Every invalidation bumps the shard's
+// generation; a fill carries the generation seen at miss time and is
+// dropped if a write raced with it, so stale rows are never cached.
+class UserCache {
+public:
+    static constexpr size_t kDefaultShards = 16;
+
+    explicit UserCache(size_t capacityBytes, size_t shards = kDefaultShards);
+
+    bool Get(std::string_view username, User& out, uint64_t& ticket);
+    void Put(const User& user, uint64_t ticket);
+    void Invalidate(std::string_view username);
+    void InvalidateAll();
+    UserCacheStats Stats() const;
+
+private:
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<User> lru;    // front = most recently used
+        std::unordered_map<std::string_view, std::list<User>::iterator> index;  // keys view lru entries
+        size_t bytes = 0;
+        uint64_t generation = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t invalidations = 0;
+    };
+
+    std::unique_ptr<Shard[]> shards;
+    size_t shardMask;
+    size_t shardCapacity;
+
+    Shard& ShardFor(std::string_view username) const;
+    static size_t EntryBytes(const User& user);
+};
+
+struct FilterStats {
+    size_t items = 0;
+    size_t bytes = 0;
+    unsigned fingerprintBits = 0;
+    double targetFalsePositiveRate = 0.0;
+    uint64_t rejected = 0;      // lookups answered "absent" without touching the store
+    uint64_t rebuilds = 0;
+};
+
+// Cuckoo filter over usernames: 4-slot buckets of f-bit fingerprints
+// (f derived from the target false-positive rate, 4..16 bits), two
+// candidate buckets per key. Unlike a Bloom filter it supports deletes,
+// as long as only keys that were inserted are erased.
+class CuckooFilter {
+public:
+    CuckooFilter(size_t capacity, double falsePositiveRate);
+
+    bool Insert(std::string_view key);      // false when full; rebuild larger
+    bool Erase(std::string_view key);
+    bool MayContain(std::string_view key) const;
+
+    size_t Capacity() const { return (mask + 1) * kSlots; }
+    size_t Size() const { return items; }
+    size_t Bytes() const { return fingerprints.size() * sizeof(uint16_t); }
+    unsigned FingerprintBits() const { return bits; }
+
+private:
+    static constexpr size_t kSlots = 4;
+    static constexpr int kMaxKicks = 500;
+
+    std::vector<uint16_t> fingerprints;     // bucket-major, 0 = empty slot
+    size_t mask;
+    unsigned bits;
+    size_t items = 0;
+    uint32_t rng = 0x9E3779B9u;
+
+    void Locate(std::string_view key, uint16_t& fp, size_t& b1, size_t& b2) const;
+    size_t AltBucket(size_t bucket, uint16_t fp) const;
+    bool TryPlace(size_t bucket, uint16_t fp);
+};
+
+struct WorkPoolStats {
+    size_t threads = 0;
+    size_t queueDepth = 0;          // tasks waiting now, over all workers
+    size_t peakQueueDepth = 0;
+    std::vector<size_t> workerDepths;   // per-worker queue depth now
+    uint64_t submitted = 0;
+    uint64_t completed = 0;
+    uint64_t steals = 0;            // tasks taken from another worker's queue
+    uint64_t queueWaitNanos = 0;    // summed time from Submit() to start
+    double MeanWaitMicros() const { return completed ? queueWaitNanos / 1e3 / double(completed) : 0.0; }
+};
+
+// Fixed set of worker threads, each owning a deque. Submit() from outside
+// the pool deals tasks round-robin over the deques; a worker takes the
+// oldest task from its own deque and, when that is empty, steals the
+// newest from another worker's, so a burst that lands unevenly still
+// spreads over every core. Idle workers sleep until work is submitted.
+// Tasks must not throw. Destruction runs every queued task first.
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkStealingPool(size_t threads);     // 0 = one per core
+    ~WorkStealingPool() noexcept;
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    void Submit(Task task);
+    bool InWorker() const;      // true on one of this pool's threads
+    size_t Threads() const { return workers.size(); }
+    WorkPoolStats Stats() const;
+
+private:
+    struct Queued {
+        Task run;
+        std::chrono::steady_clock::time_point queued;
+    };
+    struct alignas(64) Worker {
+        mutable std::mutex mutex;
+        std::deque<Queued> tasks;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> nextWorker{ 0 };
+    alignas(64) std::atomic<size_t> pending{ 0 };  // queued, not yet taken
+    std::atomic<size_t> peakPending{ 0 };
+    std::atomic<size_t> sleepers{ 0 };
+    std::atomic<uint64_t> submitted{ 0 };
+    std::atomic<uint64_t> completed{ 0 };
+    std::atomic<uint64_t> steals{ 0 };
+    std::atomic<uint64_t> waitNanos{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    bool Take(size_t self, Queued& out);
+    void WorkerLoop(size_t self);
+};
+
+struct SecureDatabaseOptions {
+    size_t poolSize = 1;
+    std::chrono::milliseconds acquireTimeout{ 1000 };
+    std::string auditLogPath;   // empty: stdout
+    std::shared_ptr<AuditLog> auditLog;     // shared log to use instead of opening auditLogPath
+    size_t auditCapacity = AuditLog::kDefaultCapacity;
+    AuditOverflow auditOverflow = AuditOverflow::Block;    // Drop trades completeness for latency
+    AuditFormat auditFormat = AuditFormat::Text;    // Binary: query with CS499mod5_auditquery
+    size_t userCacheBytes = 0;  // 0 disables the GetUser cache
+    size_t userCacheShards = UserCache::kDefaultShards;
+    double usernameFilterFpr = 0.001;   // 0 disables the negative-lookup filter
+    size_t usernameFilterCapacity = 1 << 16;    // initial; doubles on rebuild
+    std::string walPath;        // empty: no write-ahead log (mutations are not durable)
+    std::chrono::microseconds walGroupWindow{ 500 };
+    size_t walMaxGroupBytes = 1 << 20;
+    // Rows are served from this memory-mapped snapshot with the WAL replayed
+    // on top as the delta; empty: the store starts from the WAL alone
+    std::string snapshotPath;
+    uint64_t compactWalBytes = 64 << 20;   // WAL size that triggers a background compaction
+    bool lockFreeReads = true;  // false: readers take the store lock shared (reader-writer baseline)
+    // Every call is counted; one in metricsSampleEvery calls per thread and
+    // operation is also timed. 1 times every call, 0 turns Stats() off.
+    uint32_t metricsSampleEvery = 128;
+    size_t verifyThreads = 0;   // VerifyPassword workers, started on first use; 0 = one per core
+    std::shared_ptr<WorkStealingPool> verifyPool;   // shared pool to use instead
+};
+
+struct StorageStats {
+    size_t snapshotRows = 0;
+    size_t snapshotBytes = 0;
+    size_t deltaRows = 0;       // rows inserted or changed since the snapshot
+    size_t tombstones = 0;      // rows deleted since
+    uint64_t compactions = 0;
+    uint64_t lastCompactionNanos = 0;
+    size_t roles = 0;           // distinct roles in the role index
+    size_t roleIndexBytes = 0;
+};
+
+// Bulk import/export. The text format is CSV: a "username,password,role"
+// header, then one record per line; fields holding a comma, quote or line
+// break are quoted, with quotes doubled.
+struct BulkOptions {
+    size_t hashThreads = 0;             // import hashing workers; 0 = one per core
+    size_t batchRows = 4096;            // rows per pipeline batch and per INSERT statement
+    size_t queueDepth = 8;              // batches in flight between two stages
+    size_t blockBytes = size_t(1) << 20;    // read/write granularity
+    bool passwordsHashed = false;       // import: input came from ExportUsers, store passwords as-is
+};
+
+struct BulkStats {
+    uint64_t rows = 0;          // records read (import) or written (export)
+    uint64_t added = 0;         // import: rows inserted
+    uint64_t duplicates = 0;    // import: usernames already present
+    uint64_t malformed = 0;     // import: records skipped as unparseable or invalid
+    uint64_t bytes = 0;
+    uint64_t nanos = 0;
+    double RowsPerSecond() const { return nanos ? rows * 1e9 / double(nanos) : 0.0; }
+};
+
+// Operations reported by SecureDatabase::Stats() and tagged on audit
+// records. The numbers are the on-disk op byte (see AuditKind above)
+enum class DbOp : uint8_t {
+    AddUser = 0,
+    GetUser = 1,
+    UpdatePassword = 2,
+    DeleteUser = 3,
+    AddUsers = 4,
+    DeleteUsers = 5,
+    SelectUsers = 6,
+    ListUsers = 7,
+    ListUsersByRole = 8,
+    ChangeRole = 9,
+    ImportUsers = 10,
+    ExportUsers = 11,
+    VerifyPassword = 12,
+    Compact = 13,
+    Encrypt = 14,
+    Authorized = 15,
+    Count = 16
+};
+constexpr size_t kDbOpCount = static_cast<size_t>(DbOp::Count);
+// every op needs its own bit in auditfile::BlockHeader::opMask, below the no-op bit
+static_assert(kDbOpCount <= 31 && kDbOpCount < kAuditNoOp);
+static_assert(static_cast<uint8_t>(Role::Admin) < 7 && static_cast<uint8_t>(AuditKind::Denied) < 8);
+const char* DbOpName(DbOp op);
+
+// Log-linear latency histogram in the HdrHistogram layout: values below 16
+// get a bucket each, every power of two above is split into 16 equal
+// buckets, so a recorded value is known to within 1/16 (reported at the
+// bucket midpoint). Values from 2^36 ns (about 69 s) share the last bucket.
+struct LatencyHistogram {
+    static constexpr int kSubBits = 4;
+    static constexpr int kMaxBits = 36;
+    static constexpr size_t kBuckets = size_t(kMaxBits - kSubBits + 1) << kSubBits;
+
+    static size_t Bucket(uint64_t nanos) {
+        if (nanos < (uint64_t(1) << kSubBits))
+            return static_cast<size_t>(nanos);
+        int exponent = std::bit_width(nanos) - 1;
+        if (exponent >= kMaxBits)
+            return kBuckets - 1;
+        return (size_t(exponent - kSubBits + 1) << kSubBits)
+             | static_cast<size_t>((nanos >> (exponent - kSubBits)) & ((1u << kSubBits) - 1));
+    }
+    static uint64_t BucketLow(size_t bucket);
+    static uint64_t BucketWidth(size_t bucket);
+
+    void Record(uint64_t nanos);
+    void Merge(const LatencyHistogram& other);
+    uint64_t Percentile(double fraction) const;     // 0.5 = median; 0 when empty
+    double Mean() const { return count ? double(sum) / double(count) : 0.0; }
+
+    std::array<uint64_t, kBuckets> counts{};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+};
+
+struct OpStats {
+    uint64_t calls = 0;
+    uint64_t denied = 0;        // refused by the role check
+    uint64_t failures = 0;      // failures written to the audit log, denials included
+    LatencyHistogram latency;   // sampled calls only; includes one clock read, which dominates Authorized
+};
+
+// Point-in-time copy of the per-operation counters, merged over threads
+struct DatabaseStats {
+    uint32_t sampleEvery = 0;
+    std::array<OpStats, kDbOpCount> ops{};
+
+    const OpStats& operator[](DbOp op) const { return ops[static_cast<size_t>(op)]; }
+    OpStats& operator[](DbOp op) { return ops[static_cast<size_t>(op)]; }
+    DatabaseStats& operator+=(const DatabaseStats& other);
+    std::string ToText() const;     // one line per operation that ran
+    std::string ToJson() const;
+};
+
+// Per-thread recorders behind SecureDatabase::Stats(). Each thread writes
+// only its own shard (plain loads and stores on relaxed atomics, no
+// read-modify-write), found through a small thread-local cache keyed by a
+// never-reused id; Snapshot() sums the shards while they keep recording.
+// A thread's shards go to an idle list when it exits, so threads that
+// come and go reuse them instead of growing the list.
+class OpMetrics {
+public:
+    struct alignas(64) Counters {
+        // hot fields first, on one cache line
+        std::atomic<uint64_t> calls{ 0 };
+        std::atomic<uint64_t> checks{ 0 };     // role checks made by these calls
+        uint32_t untilSample = 1;   // owner thread only
+        uint32_t untilCheckSample = 1;
+        std::atomic<uint64_t> denied{ 0 };
+        std::atomic<uint64_t> failures{ 0 };
+        std::atomic<uint64_t> sum{ 0 };
+        std::atomic<uint64_t> max{ 0 };
+        std::array<std::atomic<uint32_t>, LatencyHistogram::kBuckets> buckets{};
+    };
+    struct Shard {
+        std::array<Counters, kDbOpCount> ops;
+    };
+
+    // Counts one call of 'op' on this thread for its lifetime, timing it if
+    // it is the sampled one; failures logged meanwhile are charged to it
+    class Scope {
+    public:
+        Scope(OpMetrics* metrics, DbOp op);
+        ~Scope() noexcept;
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        friend class OpMetrics;
+        Shard* shard = nullptr;
+        Counters* counters = nullptr;
+        Scope* outer = nullptr;
+        bool timed = false;
+        std::chrono::steady_clock::time_point start{};
+    };
+
+    // A step of the open Scope's operation, such as hashing, counted on
+    // that Scope's shard without a lookup and sampled on its own; does
+    // nothing outside a Scope
+    class Step {
+    public:
+        Step(OpMetrics* metrics, DbOp op);
+        ~Step() noexcept;
+        Step(const Step&) = delete;
+        Step& operator=(const Step&) = delete;
+
+    private:
+        Counters* counters = nullptr;
+        bool timed = false;
+        std::chrono::steady_clock::time_point start{};
+    };
+
+    // The role check of the open Scope's operation. It runs on every call,
+    // so it is counted on that operation's hot line and only touches the
+    // Authorized totals when sampled or denied.
+    class Check {
+    public:
+        explicit Check(OpMetrics* metrics);
+        ~Check() noexcept;
+        Check(const Check&) = delete;
+        Check& operator=(const Check&) = delete;
+
+        void Deny();    // charged to the check and to the operation
+
+    private:
+        Scope* scope = nullptr;
+        bool timed = false;
+        std::chrono::steady_clock::time_point start{};
+    };
+
+    explicit OpMetrics(uint32_t sampleEvery);
+    ~OpMetrics() noexcept;
+    OpMetrics(const OpMetrics&) = delete;
+    OpMetrics& operator=(const OpMetrics&) = delete;
+
+    static void Failed();   // charges the innermost open Scope on this thread
+    DatabaseStats Snapshot() const;
+    void Release(Shard* shard);     // from an exiting thread
+
+private:
+    uint64_t id = 0;
+    uint32_t sampleEvery;
+    mutable std::mutex mutex;
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::vector<Shard*> idle;
+
+    Shard& Local();
+    Shard& Register();
+};
+
+// Thread-safe: CRUD calls check a connection out of the pool for their
+// duration. The default constructor uses a single-connection pool.
+class SecureDatabase {
+public:
+    static constexpr std::chrono::milliseconds kDefaultAcquireTimeout{ 1000 };
+
+    SecureDatabase();
+    explicit SecureDatabase(size_t poolSize, std::chrono::milliseconds acquireTimeout = kDefaultAcquireTimeout);
+    explicit SecureDatabase(const SecureDatabaseOptions& options);
+    ~SecureDatabase() noexcept;    // flushes the audit log
+
+    // CRUD operations. Parameters are bound as views into a fixed-size list,
+    // so apart from storing new rows these calls do not allocate; GetUserInto
+    // fills caller-owned storage and is allocation-free once 'out' has capacity.
+    // With a write-ahead log, mutations return once they are durable. When the
+    // log write fails they return false, but the change is not rolled back:
+    // it stays visible in memory and reaches disk with the next successful
+    // Compact(), which also reopens the log to new commits.
+    bool AddUser(const User& user, const Session& session);
+    std::unique_ptr<User> GetUser(std::string_view username, const Session& session);
+    bool GetUserInto(std::string_view username, const Session& session, User& out);
+    bool UpdatePassword(std::string_view username, std::string_view newPassword, const Session& session);
+    bool DeleteUser(std::string_view username, const Session& session);
+
+    // String-role shims for existing callers; resolve a Session per call
+    bool AddUser(const User& user, const std::string& currentRole);
+    std::unique_ptr<User> GetUser(const std::string& username, const std::string& currentRole);
+    bool UpdatePassword(const std::string& username, const std::string& newPassword, const std::string& currentRole);
+    bool DeleteUser(const std::string& username, const std::string& currentRole);
+
+    // Batch operations: one authorization check, multi-row statements sent in
+    // chunks of 'chunkSize' rows. Return the number of rows affected.
+    static constexpr size_t kDefaultBatchChunk = 512;
+    size_t AddUsers(std::span<const User> users, const Session& session, size_t chunkSize = kDefaultBatchChunk);
+    size_t DeleteUsers(std::span<const std::string> usernames, const Session& session, size_t chunkSize = kDefaultBatchChunk);
+    size_t AddUsers(std::span<const User> users, const std::string& currentRole, size_t chunkSize = kDefaultBatchChunk);
+    size_t DeleteUsers(std::span<const std::string> usernames, const std::string& currentRole, size_t chunkSize = kDefaultBatchChunk);
+
+    // Full scan of one consistent point in time: copies out every user 'match' accepts
+    std::vector<User> SelectUsers(const Session& session, const std::function<bool(const UserRef&)>& match);
+    // One page of users whose username starts with 'prefix', in username
+    // order, streamed to 'visit' without copying; the refs are only valid
+    // during the call. Pass the returned cursor back to continue after the
+    // last row: it is empty once fewer than 'limit' rows were left. Rows
+    // inserted while paging show up if they sort after the cursor.
+    std::string ListUsers(std::string_view prefix, size_t limit, std::string_view cursor, const Session& session,
+                          const std::function<void(const UserRef&)>& visit);
+
+    // Users whose role is exactly 'role', from the role index, as of one
+    // point in time; the refs are only valid during the call. 'visit' runs
+    // after the store lock is released, so it may call back into the
+    // database. The first call builds the index.
+    size_t ListUsersByRole(std::string_view role, const Session& session, const std::function<void(const UserRef&)>& visit);
+    // Gives every user holding role 'from' role 'to' in one statement;
+    // returns how many users changed. Needs Update permission.
+    size_t ChangeRole(std::string_view from, std::string_view to, const Session& session);
+
+    // Streaming bulk load: a reader thread feeds fixed-size blocks to a
+    // parser, which cuts them into batches for a pool of hashing threads;
+    // the calling thread inserts the hashed batches in input order with
+    // multi-row statements. Every hand-off is a bounded queue, so a slow
+    // stage stalls the ones before it and memory stays at roughly
+    // queueDepth batches per stage. Needs Insert permission.
+    BulkStats ImportUsers(std::istream& in, const Session& session, const BulkOptions& options = {});
+    // Writes every user, with the stored password hash, in username order.
+    // Pages through the ordered index while a writer thread drains the
+    // formatted blocks, so the table is never held in memory; rows changed
+    // during the export may appear before or after the change. Needs Select.
+    BulkStats ExportUsers(std::ostream& out, const Session& session, const BulkOptions& options = {});
+
+    // Checks a password against the stored hash with a constant-time
+    // compare; an unknown username costs the same hash and compare, so the
+    // timing does not tell whether it exists. The work runs on the
+    // verification pool, so a burst of logins is hashed on every core.
+    // Needs Select permission. The blocking form waits for the result (it
+    // runs inline when called from a pool thread); the callback form
+    // returns at once and calls 'done' on a pool thread. The database
+    // waits for outstanding verifications when it is destroyed.
+    bool VerifyPassword(std::string_view username, std::string_view password, const Session& session);
+    void VerifyPasswordAsync(std::string username, std::string password, const Session& session,
+                             std::function<void(bool)> done);
+    WorkPoolStats VerifyStats() const;
+
+    // Batched password hashing: writes the 64-character hex SHA-256 of every
+    // input to hexOut + 64 * i. hexOut must hold plainTexts.size() * 64 chars.
+    static constexpr size_t kEncryptedLength = sha256mb::kDigestBytes * 2;
+    static void EncryptBatch(std::span<const std::string_view> plainTexts, char* hexOut);
+
+    StatementCacheStats StatementStats() const { return pool->StatementStats(); }
+    PoolStats ConnectionStats() const { return pool->Stats(); }
+    AuditLogStats AuditStats() const { return audit->Stats(); }
+    UserCacheStats CacheStats() const { return cache ? cache->Stats() : UserCacheStats{}; }
+    WalStats WriteAheadStats() const { return wal ? wal->Stats() : WalStats{}; }
+    size_t RecoveredRecords() const { return recovered; }
+    StorageStats StoreStats() const;
+    // Calls, denials, logged failures and sampled latency per operation;
+    // empty when metricsSampleEvery is 0
+    DatabaseStats Stats() const { return metrics ? metrics->Snapshot() : DatabaseStats{}; }
+
+    // Writes the current contents as a new snapshot and rewrites the WAL to
+    // just the changes made since. Runs in the background once the WAL grows
+    // past compactWalBytes; reads and writes continue while the snapshot is
+    // written. False if no snapshot path is configured or writing fails.
+    bool Compact();
+    FilterStats UsernameFilterStats() const;
+
+private:
+    std::unique_ptr<WriteAheadLog> wal;     // declared first: outlives the connections using it
+    size_t recovered = 0;
+    uint32_t walMark = 0;                   // newest WalOp::Mark logged; under compactMutex
+
+    // Snapshot maintenance: a background thread builds the username filter
+    // after a snapshot is opened and runs compactions
+    std::string snapshotPath;
+    uint64_t compactWalBytes = 0;
+    std::mutex compactMutex;                // one compaction or filter build at a time
+    std::atomic<uint64_t> compactions{ 0 };
+    std::atomic<uint64_t> lastCompactionNanos{ 0 };
+    std::mutex maintenanceMutex;
+    std::condition_variable maintenanceWake;
+    bool maintenanceStopping = false;
+    bool compactRequested = false;
+    bool filterBuildRequested = false;
+    std::thread maintenance;
+
+    std::shared_ptr<UserStore> store;
+    std::unique_ptr<ConnectionPool> pool;
+    std::shared_ptr<AuditLog> audit;
+    std::unique_ptr<UserCache> cache;   // null when disabled
+    std::unique_ptr<OpMetrics> metrics; // null when disabled
+
+    // Password verification; the pool starts on first use unless shared
+    size_t verifyThreads = 0;
+    std::once_flag verifyStart;
+    std::shared_ptr<WorkStealingPool> verifyPool;
+    std::atomic<WorkStealingPool*> verifyWorkers{ nullptr };    // set once verifyPool is
+    std::mutex verifyMutex;
+    std::condition_variable verifyIdle;
+    size_t verifyInFlight = 0;
+
+    WorkStealingPool& VerifyPool();
+    bool CheckPassword(std::string_view username, std::string_view password, const Session& session);
+
+    // Negative-lookup filter over every stored username; null when disabled
+    // or not built yet. Fingerprints are added before a row is inserted and
+    // removed after it is deleted, so the filter never reports an existing
+    // user as absent. Keys between FilterInsert and FilterSettle are tracked
+    // so a rebuild from the store does not lose them, and a delete only
+    // removes its fingerprint if no rebuild ran since it read filterEpoch
+    // and no insert of the same name is in flight. A key gets at most one
+    // fingerprint for its in-flight inserts however many there are, and none
+    // while its row is stored: a cuckoo filter holds only 2 x kSlots copies
+    // of one fingerprint.
+    struct PendingKey {
+        size_t inserts = 0;
+        bool added = false;     // this entry put a fingerprint in the current filter
+        bool stored = false;    // one of its inserts stored the row
+    };
+    struct PendingHash {
+        using is_transparent = void;
+        size_t operator()(std::string_view key) const { return std::hash<std::string_view>{}(key); }
+    };
+    std::unique_ptr<CuckooFilter> filter;
+    mutable std::shared_mutex filterLock;
+    std::unordered_map<std::string, PendingKey, PendingHash, std::equal_to<>> filterPending;
+    double filterFpr = 0.0;
+    size_t filterCapacity = 0;
+    mutable std::atomic<uint64_t> filterRejected{ 0 };
+    std::atomic<uint64_t> filterEpoch{ 0 };
+    uint64_t filterRebuilds = 0;
+
+    bool MayExist(std::string_view username) const;
+    void FilterInsert(std::string_view username);
+    void FilterSettle(std::string_view username, bool stored);
+    uint64_t FilterEpoch() const { return filterEpoch.load(std::memory_order_acquire); }
+    void FilterErase(std::string_view username, uint64_t epoch);
+    // Batch forms take filterLock once per chunk. MayExist appends to 'out'
+    // the names the filter does not rule out; 'stored' and 'erased' are
+    // per-row statement results.
+    void MayExist(std::span<const std::string> usernames, std::vector<std::string>& out) const;
+    void FilterInsert(std::span<const User> rows);
+    void FilterSettle(std::span<const User> rows, const std::vector<uint8_t>& stored);
+    void FilterErase(std::span<const std::string> usernames, const std::vector<uint8_t>& erased, uint64_t epoch);
+    // the single-key steps; the caller holds filterLock exclusively
+    void InsertPending(std::string_view username);
+    void SettlePending(std::string_view username, bool stored);
+    void EraseSettled(std::string_view username, uint64_t epoch);
+    static constexpr int kMaxFilterGrowth = 8;     // doublings a rebuild tries before giving up
+    std::unique_ptr<CuckooFilter> BuildFilter(size_t capacity);     // caller holds filterLock; null if it never fits
+    void BuildFilterInBackground();
+    void MaintenanceLoop();
+
+    // Multi-row INSERT state reused across chunks: the statement is only
+    // re-prepared when the chunk size changes
+    struct InsertBatch {
+        const PreparedStatement* stmt = nullptr;
+        std::vector<std::string> params;
+        std::vector<std::shared_future<void>> commits;
+    };
+    // Inserts 'chunk' with kEncryptedLength chars of password hash per row at
+    // 'hashes'; returns the rows added
+    size_t InsertHashed(DBConnection& conn, InsertBatch& batch, std::span<const User> chunk, const char* hashes);
+
+    // Handles for the fixed CRUD statements, prepared once at construction
+    const PreparedStatement* insertStmt = nullptr;
+    const PreparedStatement* selectStmt = nullptr;
+    const PreparedStatement* updateStmt = nullptr;
+    const PreparedStatement* deleteStmt = nullptr;
+
+    bool Authorized(const Session& session, Operation operation);
+    std::string Encrypt(const std::string& plainText);
+    void EncryptTo(std::string_view plainText, char* hexOut);    // kEncryptedLength chars
+    void Log(const std::string& message, DbOp op = DbOp::Count);        // a failure
+    void LogDenied(DbOp op, const Session& session, const std::string& message);
+    bool AwaitDurable(const std::shared_future<void>& commit);
+};
+
+// Splits users across N independent SecureDatabase partitions by username
+// hash, so each partition has its own store lock, index, connection pool,
+// cache and filter. With WAL or snapshot paths set, partition i uses them
+// with an ".i" suffix, and a "<path>.shards" manifest records the count:
+// reopening with another count would route users to the wrong partition,
+// so the constructor throws std::runtime_error instead. All partitions
+// share one audit log, and the cache and filter budgets are divided
+// between them. Single-user calls touch exactly one partition; batch calls
+// and scans fan out to every partition in parallel on a pool kept for it.
+class ShardedSecureDatabase {
+public:
+    explicit ShardedSecureDatabase(size_t shardCount, const SecureDatabaseOptions& options = {});
+
+    bool AddUser(const User& user, const Session& session) { return ShardFor(user.username).AddUser(user, session); }
+    std::unique_ptr<User> GetUser(std::string_view username, const Session& session) {
+        return ShardFor(username).GetUser(username, session);
+    }
+    bool GetUserInto(std::string_view username, const Session& session, User& out) {
+        return ShardFor(username).GetUserInto(username, session, out);
+    }
+    bool UpdatePassword(std::string_view username, std::string_view newPassword, const Session& session) {
+        return ShardFor(username).UpdatePassword(username, newPassword, session);
+    }
+    bool DeleteUser(std::string_view username, const Session& session) { return ShardFor(username).DeleteUser(username, session); }
+
+    size_t AddUsers(std::span<const User> users, const Session& session,
+                    size_t chunkSize = SecureDatabase::kDefaultBatchChunk);
+    size_t DeleteUsers(std::span<const std::string> usernames, const Session& session,
+                       size_t chunkSize = SecureDatabase::kDefaultBatchChunk);
+    // 'match' runs on several threads at once
+    std::vector<User> SelectUsers(const Session& session, const std::function<bool(const UserRef&)>& match);
+    // Same contract as SecureDatabase::ListUsers; each partition's page is
+    // copied and merged, so 'visit' sees refs into that merge buffer
+    std::string ListUsers(std::string_view prefix, size_t limit, std::string_view cursor, const Session& session,
+                          const std::function<void(const UserRef&)>& visit);
+    // Partition by partition; not one point in time across partitions
+    size_t ListUsersByRole(std::string_view role, const Session& session, const std::function<void(const UserRef&)>& visit);
+    size_t ChangeRole(std::string_view from, std::string_view to, const Session& session);
+    DatabaseStats Stats() const;    // summed over partitions
+    // One verification pool serves every partition
+    bool VerifyPassword(std::string_view username, std::string_view password, const Session& session) {
+        return ShardFor(username).VerifyPassword(username, password, session);
+    }
+    void VerifyPasswordAsync(std::string username, std::string password, const Session& session,
+                             std::function<void(bool)> done) {
+        SecureDatabase& shard = ShardFor(username);
+        shard.VerifyPasswordAsync(std::move(username), std::move(password), session, std::move(done));
+    }
+    WorkPoolStats VerifyStats() const { return shards[0]->VerifyStats(); }
+
+    size_t ShardCount() const { return shards.size(); }
+    // Uses the high hash bits: the low ones pick the slot inside each partition's index
+    size_t ShardOf(std::string_view username) const {
+        return static_cast<size_t>((uint64_t(UserTable::Hash(username)) * shards.size()) >> 32);
+    }
+    SecureDatabase& Shard(size_t i) { return *shards[i]; }
+
+private:
+    std::vector<std::unique_ptr<SecureDatabase>> shards;
+    std::unique_ptr<WorkStealingPool> fanOut;   // null with one partition
+
+    SecureDatabase& ShardFor(std::string_view username) { return *shards[ShardOf(username)]; }
+    // Runs work(i) for every shard, shard 0 on the calling thread and the
+    // rest on the fan-out pool, and waits; rethrows the first exception
+    void FanOut(const std::function<void(size_t)>& work);
+};
+
+// Lazily started coroutine returning T. Awaiting it runs it; when it
+// finishes, the awaiting coroutine resumes through symmetric transfer.
+template <class T>
+class Task;
+
+namespace detail {
+    struct TaskPromiseBase {
+        std::coroutine_handle<> continuation;
+        std::exception_ptr error;
+
+        struct FinalAwaiter {
+            bool await_ready() const noexcept { return false; }
+            template <class P>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<P> done) noexcept {
+                std::coroutine_handle<> next = done.promise().continuation;
+                return next ? next : std::noop_coroutine();
+            }
+            void await_resume() const noexcept {}
+        };
+
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        FinalAwaiter final_suspend() const noexcept { return {}; }
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    template <class T>
+    struct TaskPromise : TaskPromiseBase {
+        std::optional<T> value;
+        Task<T> get_return_object();
+        template <class U>
+        void return_value(U&& v) { value.emplace(std::forward<U>(v)); }
+        T Result() {
+            if (error)
+                std::rethrow_exception(error);
+            return std::move(*value);
+        }
+    };
+
+    template <>
+    struct TaskPromise<void> : TaskPromiseBase {
+        Task<void> get_return_object();
+        void return_void() const noexcept {}
+        void Result() const {
+            if (error)
+                std::rethrow_exception(error);
+        }
+    };
+}
+
+template <class T = void>
+class Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle)
+                handle.destroy();
+            handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+    ~Task() noexcept {
+        if (handle)
+            handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+        handle.promise().continuation = caller;
+        return handle;
+    }
+    T await_resume() { return handle.promise().Result(); }
+
+private:
+    std::coroutine_handle<promise_type> handle;
+};
+
+namespace detail {
+    template <class T>
+    Task<T> TaskPromise<T>::get_return_object() {
+        return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+    }
+    inline Task<void> TaskPromise<void>::get_return_object() {
+        return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+    }
+}
+
+// Single-threaded run queue for coroutines. While Run() executes on a
+// thread, async database calls started there resume on it: the I/O thread
+// that completes a call queues the caller here instead of running it.
+class EventLoop {
+public:
+    EventLoop() = default;
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    void Post(std::coroutine_handle<> resume);      // from any thread
+    void Spawn(Task<void> task);                    // runs detached on this loop
+    void Run();             // until every spawned task has finished
+    size_t Live() const { return live; }            // spawned tasks not yet finished; loop thread only
+    static EventLoop* Current();                    // the loop running on this thread, if any
+
+private:
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::coroutine_handle<>> ready;
+    size_t live = 0;
+};
+
+// Unit of work for IoExecutor, linked intrusively so posting allocates nothing
+struct IoWork {
+    void (*run)(IoWork*) = nullptr;
+    IoWork* next = nullptr;
+};
+
+// Dedicated threads for blocking database calls, fed from one FIFO
+class IoExecutor {
+public:
+    explicit IoExecutor(size_t threads);
+    ~IoExecutor() noexcept;     // finishes the queued work first
+    IoExecutor(const IoExecutor&) = delete;
+    IoExecutor& operator=(const IoExecutor&) = delete;
+
+    void Post(IoWork* work);
+    size_t Threads() const { return workers.size(); }
+    size_t QueueDepth() const { return depth.load(std::memory_order_relaxed); }
+
+private:
+    std::mutex mutex;
+    std::condition_variable wake;
+    IoWork* head = nullptr;
+    IoWork* tail = nullptr;
+    std::atomic<size_t> depth{ 0 };
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    void WorkerLoop();
+};
+
+// Awaitable that runs 'call' on the executor, then resumes the awaiting
+// coroutine on its event loop, or on the I/O thread if it has none
+template <class Call>
+class IoOperation : IoWork {
+public:
+    using Result = std::invoke_result_t<Call&>;
+
+    IoOperation(IoExecutor& io, Call call) : io(io), call(std::move(call)) { run = &Run; }
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> caller) {
+        this->caller = caller;
+        loop = EventLoop::Current();
+        io.Post(this);
+    }
+    Result await_resume() {
+        if (error)
+            std::rethrow_exception(error);
+        return std::move(*result);
+    }
+
+private:
+    IoExecutor& io;
+    Call call;
+    std::optional<Result> result;
+    std::exception_ptr error;
+    std::coroutine_handle<> caller;
+    EventLoop* loop = nullptr;
+
+    static void Run(IoWork* work) {
+        auto* self = static_cast<IoOperation*>(work);
+        try {
+            self->result.emplace(self->call());
+        }
+        catch (...) {
+            self->error = std::current_exception();
+        }
+        if (self->loop)
+            self->loop->Post(self->caller);
+        else
+            self->caller.resume();
+    }
+};
+
+// Awaitable CRUD on top of a SecureDatabase: each call returns a Task that
+// runs the blocking call on the executor's threads, so an event loop
+// thread can keep many requests in flight. Arguments are copied into the
+// coroutine. The database's pool should have a connection per I/O thread,
+// or calls wait for one there. With GCC 12, pass a named User to AddUser:
+// a braced temporary inside a co_await expression is destroyed twice.
+class AsyncSecureDatabase {
+public:
+    AsyncSecureDatabase(SecureDatabase& db, IoExecutor& io) : db(db), io(io) {}
+
+    Task<bool> AddUser(User user, Session session);
+    Task<std::unique_ptr<User>> GetUser(std::string username, Session session);
+    Task<bool> UpdatePassword(std::string username, std::string newPassword, Session session);
+    Task<bool> DeleteUser(std::string username, Session session);
+
+private:
+    SecureDatabase& db;
+    IoExecutor& io;
+};
+
+#endif // SECUREDATABASE_H
@@ -0,0 +1,295 @@
+#include "SecureDatabase.h"
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Offline query over binary audit logs (SecureDatabaseOptions::auditFormat = Binary).
+// Usage: CS499mod5_auditquery [--from T] [--to T] [--op Name,...] [--role name,...]
+//                             [--kind denied|failure|notice,...] [--count] <audit log>...
+// T is Unix seconds, a UTC date or date-time (2024-05-01, 2024-05-01T13:30:00)
+// or an offset back from now (7d, 12h, 30m). The files are mapped, not read:
+// blocks outside the time range are skipped by binary search on their
+// headers, and blocks whose op/role/kind sets cannot match are not touched.
+// Matches stream to stdout as text; a summary goes to stderr.
+
+namespace {
+    int Usage() {
+        std::cerr << "usage: CS499mod5_auditquery [--from T] [--to T] [--op Name,...] [--role name,...]\n"
+                  << "                            [--kind denied|failure|notice,...] [--count] <audit log>...\n"
+                  << "       T: Unix seconds, YYYY-MM-DD[THH:MM:SS] (UTC), or Nd/Nh/Nm ago\n";
+        return 2;
+    }
+
+    const char* const kKindNames[] = { "notice", "failure", "denied" };
+
+    struct Filter {
+        uint64_t from = 0;
+        uint64_t to = UINT64_MAX;
+        uint32_t ops = ~0u;
+        uint8_t roles = 0xff;
+        uint8_t kinds = 0xff;
+
+        bool Matches(const auditfile::Record& r) const {
+            return r.timestampNanos >= from && r.timestampNanos <= to && (ops & auditfile::OpBit(r.op))
+                && (roles & auditfile::RoleBit(r.role)) && (kinds & auditfile::KindBit(r.kind));
+        }
+        bool MayMatch(const auditfile::BlockHeader& h) const {
+            return (ops & h.opMask) && (roles & h.roleMask) && (kinds & h.kindMask);
+        }
+    };
+
+    struct QueryStats {
+        uint64_t matches = 0;
+        uint64_t blocks = 0;
+        uint64_t blocksRead = 0;
+        uint64_t blocksSkipped = 0;     // in the time range but ruled out by the header
+    };
+
+    bool ParseTime(const std::string& text, uint64_t& nanos) {
+        char* end = nullptr;
+        double value = std::strtod(text.c_str(), &end);
+        if (end != text.c_str() && *end && !end[1] && value >= 0) {
+            // an age: 7d, 12h, 30m
+            double unit = *end == 'd' ? 86400 : *end == 'h' ? 3600 : *end == 'm' ? 60 : 0;
+            if (unit == 0)
+                return false;
+            auto now = std::chrono::system_clock::now().time_since_epoch();
+            double ago = value * unit * 1e9;
+            double at = double(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()) - ago;
+            nanos = at > 0 ? static_cast<uint64_t>(at) : 0;
+            return true;
+        }
+        std::tm tm{};
+        int consumed = 0;
+        if (std::sscanf(text.c_str(), "%d-%d-%d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &consumed) == 3
+            && consumed >= 8) {
+            if (text[consumed] == 'T' || text[consumed] == ' ') {
+                if (std::sscanf(text.c_str() + consumed + 1, "%d:%d:%d", &tm.tm_hour, &tm.tm_min, &tm.tm_sec) < 2)
+                    return false;
+            }
+            else if (text[consumed]) {
+                return false;
+            }
+            tm.tm_year -= 1900;
+            tm.tm_mon -= 1;
+            time_t seconds = ::timegm(&tm);
+            if (seconds < 0)
+                return false;
+            nanos = static_cast<uint64_t>(seconds) * 1000000000ull;
+            return true;
+        }
+        if (end == text.c_str() || *end || value < 0)
+            return false;
+        nanos = static_cast<uint64_t>(value * 1e9);
+        return true;
+    }
+
+    // Comma-separated names to a bitmask; 'bit' maps a matched index to its bit
+    template <class Bit>
+    bool ParseNames(const std::string& list, size_t count, const char* (*name)(size_t), Bit bit, uint32_t& mask) {
+        mask = 0;
+        size_t start = 0;
+        while (start <= list.size()) {
+            size_t comma = std::min(list.find(',', start), list.size());
+            std::string item = list.substr(start, comma - start);
+            size_t i = 0;
+            while (i < count && ::strcasecmp(item.c_str(), name(i)) != 0)
+                i++;
+            if (i == count) {
+                std::cerr << "unknown name: " << item << "\n";
+                return false;
+            }
+            mask |= bit(i);
+            start = comma + 1;
+        }
+        return true;
+    }
+
+    const char* OpAt(size_t i) { return DbOpName(static_cast<DbOp>(i)); }
+    const char* RoleAt(size_t i) { return RoleName(static_cast<Role>(i)); }
+    const char* KindAt(size_t i) { return kKindNames[i]; }
+
+    void Format(const auditfile::Record& r, std::string& out) {
+        char line[96];
+        int n = std::snprintf(line, sizeof(line), "[LOG] %llu.%03llu %s %s %s ",
+            static_cast<unsigned long long>(r.timestampNanos / 1000000000ull),
+            static_cast<unsigned long long>(r.timestampNanos / 1000000ull % 1000ull),
+            r.kind < std::size(kKindNames) ? kKindNames[r.kind] : "?",
+            r.op == kAuditNoOp ? "-" : DbOpName(static_cast<DbOp>(r.op)),
+            r.role == kAuditNoRole ? "-" : RoleName(static_cast<Role>(r.role)));
+        out.append(line, n);
+        out.append(r.text, std::min<size_t>(r.length, auditfile::kTextBytes));
+        out += '\n';
+    }
+
+    // Read-only mapping of one audit file
+    class MappedLog {
+    public:
+        explicit MappedLog(const std::string& path) {
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return;
+            struct stat st;
+            if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+                size = static_cast<size_t>(st.st_size);
+                void* p = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED) {
+                    base = static_cast<const char*>(p);
+                    ::madvise(p, size, MADV_RANDOM);    // we jump between block headers
+                }
+            }
+            ::close(fd);
+        }
+        ~MappedLog() {
+            if (base)
+                ::munmap(const_cast<char*>(base), size);
+        }
+        MappedLog(const MappedLog&) = delete;
+        MappedLog& operator=(const MappedLog&) = delete;
+
+        bool IsOpen() const { return base != nullptr; }
+        size_t Blocks() const { return (size + auditfile::kBlockBytes - 1) / auditfile::kBlockBytes; }
+        const auditfile::BlockHeader& Header(size_t block) const {
+            return *reinterpret_cast<const auditfile::BlockHeader*>(base + block * auditfile::kBlockBytes);
+        }
+        const auditfile::Record* Records(size_t block) const {
+            return reinterpret_cast<const auditfile::Record*>(base + block * auditfile::kBlockBytes
+                                                              + sizeof(auditfile::BlockHeader));
+        }
+        // Records the header vouches for that are also inside the file; 0 for a torn or foreign block
+        size_t Count(size_t block) const {
+            size_t at = block * auditfile::kBlockBytes + sizeof(auditfile::BlockHeader);
+            if (size < at || Header(block).magic != auditfile::kMagic)
+                return 0;
+            size_t onDisk = (size - at) / sizeof(auditfile::Record);
+            return std::min<size_t>({ Header(block).count, onDisk, auditfile::kRecordsPerBlock });
+        }
+        // Checks the first header only, so opening does not fault in the whole file
+        bool Valid() const { return size >= sizeof(auditfile::BlockHeader) && Header(0).magic == auditfile::kMagic; }
+
+    private:
+        const char* base = nullptr;
+        size_t size = 0;
+    };
+
+    void Query(const MappedLog& log, const Filter& filter, bool countOnly, std::string& out, QueryStats& st) {
+        size_t blocks = log.Blocks();
+        st.blocks += blocks;
+        // block time ranges rise through the file: find the first that can reach 'from'
+        size_t lo = 0;
+        size_t hi = blocks;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (log.Count(mid) && log.Header(mid).maxTimestamp < filter.from)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        for (size_t b = lo; b < blocks; b++) {
+            const auditfile::BlockHeader& h = log.Header(b);
+            size_t count = log.Count(b);
+            if (count == 0)
+                continue;
+            if (h.minTimestamp > filter.to)
+                break;
+            if (!filter.MayMatch(h)) {
+                st.blocksSkipped++;
+                continue;
+            }
+            st.blocksRead++;
+            const auditfile::Record* first = log.Records(b);
+            const auditfile::Record* last = first + count;
+            first = std::partition_point(first, last, [&](const auditfile::Record& r) {
+                return r.timestampNanos < filter.from;
+            });
+            for (const auditfile::Record* r = first; r != last && r->timestampNanos <= filter.to; r++) {
+                if (!filter.Matches(*r))
+                    continue;
+                st.matches++;
+                if (countOnly)
+                    continue;
+                Format(*r, out);
+                if (out.size() >= 64 * 1024) {
+                    std::fwrite(out.data(), 1, out.size(), stdout);
+                    out.clear();
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    Filter filter;
+    bool countOnly = false;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        uint32_t mask = 0;
+        if (arg == "--from" && hasValue) {
+            if (!ParseTime(argv[++i], filter.from))
+                return Usage();
+        }
+        else if (arg == "--to" && hasValue) {
+            if (!ParseTime(argv[++i], filter.to))
+                return Usage();
+        }
+        else if (arg == "--op" && hasValue) {
+            if (!ParseNames(argv[++i], kDbOpCount, OpAt, [](size_t n) { return auditfile::OpBit(uint8_t(n)); }, mask))
+                return Usage();
+            filter.ops = mask;
+        }
+        else if (arg == "--role" && hasValue) {
+            if (!ParseNames(argv[++i], 3, RoleAt, [](size_t n) { return auditfile::RoleBit(uint8_t(n)); }, mask))
+                return Usage();
+            filter.roles = static_cast<uint8_t>(mask);
+        }
+        else if (arg == "--kind" && hasValue) {
+            if (!ParseNames(argv[++i], std::size(kKindNames), KindAt,
+                            [](size_t n) { return auditfile::KindBit(uint8_t(n)); }, mask))
+                return Usage();
+            filter.kinds = static_cast<uint8_t>(mask);
+        }
+        else if (arg == "--count") {
+            countOnly = true;
+        }
+        else if (!arg.empty() && arg[0] == '-') {
+            return Usage();
+        }
+        else {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty())
+        return Usage();
+
+    QueryStats st;
+    std::string out;
+    out.reserve(64 * 1024 + 512);
+    int status = 0;
+    for (const std::string& file : files) {
+        MappedLog log(file);
+        if (!log.IsOpen()) {
+            std::cerr << "cannot map " << file << "\n";
+            status = 1;
+            continue;
+        }
+        if (!log.Valid()) {
+            std::cerr << file << " is not a binary audit log\n";
+            status = 1;
+            continue;
+        }
+        Query(log, filter, countOnly, out, st);
+    }
+    std::fwrite(out.data(), 1, out.size(), stdout);
+    if (countOnly)
+        std::cout << st.matches << "\n";
+    std::cerr << st.matches << " matching records; read " << st.blocksRead << " of " << st.blocks << " blocks ("
+              << st.blocksSkipped << " ruled out by their index)\n";
+    return status;
+}
@@ -0,0 +1,1165 @@
+#include "SecureDatabase.h"
+#include <sqlite3.h>
+#include <openssl/sha.h>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <new>
+#include <cstdlib>
+#include <atomic>
+#include <algorithm>
+#include <sstream>
+
+// Micro-benchmarks for the secure database layer.
+// Usage: CS499mod5_bench lookup [rows...]   point lookups (default: 1000000 10000000)
+//        CS499mod5_bench batch [rows]       AddUser/DeleteUser vs. AddUsers/DeleteUsers
+//        CS499mod5_bench statements [ops]   prepared-statement cache on/off (link with -lsqlite3)
+//        CS499mod5_bench threads [max]      GetUser throughput, 1..max threads with an equal-size pool
+//        CS499mod5_bench audit [threads]    denied requests/s with the async audit log writing to a file,
+//                                           as text lines and in the binary block format
+//        CS499mod5_bench wal [threads]      durable UpdatePassword commits/s per group-commit window
+//        CS499mod5_bench snapshot [rows...] cold start from a full WAL vs. a mapped snapshot
+//        CS499mod5_bench shards [max] [n]   90/10 read/update Mops/s, 1..max threads, one database vs. n shards
+//        CS499mod5_bench mvcc [readers]     GetUser p50/p99 under heavy writes, rwlock vs. lock-free reads
+//        CS499mod5_bench list [rows]        prefix ListUsers vs. a full scan; paging under concurrent inserts
+//        CS499mod5_bench roles [rows]       ListUsersByRole vs. a full scan, bulk ChangeRole
+//        CS499mod5_bench import [rows]      AddUser loop vs. pipelined ImportUsers; export round trip
+//        CS499mod5_bench async [max]        durable UpdatePassword: blocking loop vs. one event-loop thread
+//                                           keeping 1..max awaitable requests in flight
+//        CS499mod5_bench stats [ops]        GetUserInto cost with metrics off, sampled and timing every call;
+//                                           prints the Stats() table
+//        CS499mod5_bench verify [logins]    password checks/s: caller-thread GetUser + compare vs. blocking
+//                                           VerifyPassword vs. a callback burst on the work-stealing pool
+//        CS499mod5_bench hash [count]       legacy Encrypt vs. multi-buffer SHA-256 per ISA
+//        CS499mod5_bench aes [MB]           AES-GCM field encryption GB/s per field size, one Seal per
+//                                           call vs. SealBatch/OpenBatch
+//        CS499mod5_bench cache [ops]        95% GetUser / 5% UpdatePassword with the user cache off/on
+//        CS499mod5_bench filter [rows]      unknown-username lookups with the cuckoo filter off/on
+//        CS499mod5_bench alloc [ops]        counts heap allocations on the steady-state lookup
+//                                           path; exits non-zero if GetUserInto allocates
+
+// Allocation-counting hook: every global operator new bumps the counter
+namespace {
+    std::atomic<uint64_t> g_allocations{ 0 };
+}
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+// kept out of line: once inlined, GCC pairs the free() with the new-expression and warns
+[[gnu::noinline]] void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    std::string MakeUsername(size_t i) {
+        return "user" + std::to_string(i);
+    }
+
+    void BenchLookups(size_t rows) {
+        const std::string hash(64, 'a');
+        UserTable table(rows);
+        for (size_t i = 0; i < rows; i++)
+            table.Insert(User{ MakeUsername(i), hash, "user" });
+
+        const size_t probes = 1000000;
+        std::mt19937_64 rng(42);
+        std::vector<std::string> hits, misses;
+        hits.reserve(probes);
+        misses.reserve(probes);
+        for (size_t i = 0; i < probes; i++) {
+            hits.push_back(MakeUsername(rng() % rows));
+            misses.push_back(MakeUsername(rows + rng() % rows));
+        }
+
+        auto run = [&](const std::vector<std::string>& keys, const char* label) {
+            size_t found = 0;
+            auto start = Clock::now();
+            for (const auto& k : keys)
+                found += table.Find(k) != nullptr;
+            double secs = std::chrono::duration<double>(Clock::now() - start).count();
+            std::cout << "rows=" << rows << " " << label << ": "
+                      << (keys.size() / secs) / 1e6 << " Mlookups/s ("
+                      << (secs * 1e9 / keys.size()) << " ns/op, found " << found << ")\n";
+        };
+        run(hits, "hit ");
+        run(misses, "miss");
+    }
+
+    double Seconds(Clock::time_point start) {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    void BenchBatch(size_t rows) {
+        std::vector<User> users;
+        std::vector<std::string> names;
+        users.reserve(rows);
+        for (size_t i = 0; i < rows; i++) {
+            users.push_back(User{ MakeUsername(i), "Password!" + std::to_string(i), "user" });
+            names.push_back(users.back().username);
+        }
+
+        {
+            SecureDatabase db;
+            auto start = Clock::now();
+            for (const auto& u : users)
+                db.AddUser(u, "admin");
+            double add = Seconds(start);
+            start = Clock::now();
+            for (const auto& n : names)
+                db.DeleteUser(n, "admin");
+            double del = Seconds(start);
+            std::cout << "single: add " << add * 1e9 / rows << " ns/row, delete " << del * 1e9 / rows << " ns/row\n";
+        }
+        for (size_t chunk : { 64, 512, 4096 }) {
+            SecureDatabase db;
+            auto start = Clock::now();
+            size_t added = db.AddUsers(users, "admin", chunk);
+            double add = Seconds(start);
+            start = Clock::now();
+            size_t deleted = db.DeleteUsers(names, "admin", chunk);
+            double del = Seconds(start);
+            std::cout << "batch chunk=" << chunk << ": add " << add * 1e9 / rows << " ns/row, delete "
+                      << del * 1e9 / rows << " ns/row (" << added << "/" << deleted << " rows)\n";
+        }
+    }
+
+    // Cached vs. uncached statement preparation, first on the embedded engine,
+    // then on an in-memory SQLite database standing in for a real backend.
+    void BenchStatements(size_t ops) {
+        const size_t rows = 10000;
+        for (bool cached : { false, true }) {
+            DBConnection db;
+            db.SetStatementCache(cached);
+            for (size_t i = 0; i < rows; i++)
+                db.execute(sql::kInsertUser, { MakeUsername(i), std::string(64, 'a'), "user" });
+
+            // cached: one handle, rebound per call; uncached: statement text recompiled per call
+            const PreparedStatement* handle = db.prepare(sql::kSelectUser);
+            std::vector<std::string> params(1);
+            User row;
+            auto start = Clock::now();
+            for (size_t i = 0; i < ops; i++) {
+                params[0] = MakeUsername(i % rows);
+                if (cached)
+                    db.query(*handle, params, row);
+                else
+                    db.query(sql::kSelectUser, params, row);
+            }
+            double secs = Seconds(start);
+            auto stats = db.statementCacheStats();
+            std::cout << "engine " << (cached ? "cached  " : "uncached") << ": " << secs * 1e9 / ops
+                      << " ns/op (hits " << stats.hits << ", misses " << stats.misses << ")\n";
+        }
+
+        sqlite3* lite = nullptr;
+        sqlite3_open(":memory:", &lite);
+        sqlite3_exec(lite, "CREATE TABLE Users (username TEXT PRIMARY KEY, password TEXT, role TEXT)", nullptr, nullptr, nullptr);
+        sqlite3_exec(lite, "BEGIN", nullptr, nullptr, nullptr);
+        for (size_t i = 0; i < rows; i++) {
+            std::string name = MakeUsername(i);
+            sqlite3_stmt* st = nullptr;
+            sqlite3_prepare_v2(lite, sql::kInsertUser, -1, &st, nullptr);
+            sqlite3_bind_text(st, 1, name.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(st, 2, std::string(64, 'a').c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(st, 3, "user", -1, SQLITE_STATIC);
+            sqlite3_step(st);
+            sqlite3_finalize(st);
+        }
+        sqlite3_exec(lite, "COMMIT", nullptr, nullptr, nullptr);
+
+        for (bool cached : { false, true }) {
+            sqlite3_stmt* kept = nullptr;
+            if (cached)
+                sqlite3_prepare_v2(lite, sql::kSelectUser, -1, &kept, nullptr);
+            size_t found = 0;
+            auto start = Clock::now();
+            for (size_t i = 0; i < ops; i++) {
+                std::string name = MakeUsername(i % rows);
+                sqlite3_stmt* st = kept;
+                if (!cached)
+                    sqlite3_prepare_v2(lite, sql::kSelectUser, -1, &st, nullptr);
+                sqlite3_bind_text(st, 1, name.c_str(), static_cast<int>(name.size()), SQLITE_STATIC);
+                found += sqlite3_step(st) == SQLITE_ROW;
+                if (cached) {
+                    sqlite3_reset(st);
+                    sqlite3_clear_bindings(st);
+                }
+                else {
+                    sqlite3_finalize(st);
+                }
+            }
+            double secs = Seconds(start);
+            sqlite3_finalize(kept);
+            std::cout << "sqlite " << (cached ? "cached  " : "uncached") << ": " << secs * 1e9 / ops
+                      << " ns/op (found " << found << ")\n";
+        }
+        sqlite3_close(lite);
+    }
+
+    void BenchThreads(size_t maxThreads) {
+        const size_t rows = 100000;
+        const size_t opsPerThread = 200000;
+        std::vector<User> users;
+        for (size_t i = 0; i < rows; i++)
+            users.push_back(User{ MakeUsername(i), "pw", "user" });
+
+        for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+            SecureDatabase db(threads);
+            db.AddUsers(users, "admin");
+
+            std::vector<std::thread> workers;
+            auto start = Clock::now();
+            for (size_t t = 0; t < threads; t++) {
+                workers.emplace_back([&db, t, rows] {
+                    std::mt19937_64 rng(t);
+                    for (size_t i = 0; i < opsPerThread; i++)
+                        db.GetUser(MakeUsername(rng() % rows), "user");
+                });
+            }
+            for (auto& w : workers)
+                w.join();
+            double secs = Seconds(start);
+            PoolStats ps = db.ConnectionStats();
+            std::cout << "threads=" << threads << ": " << (threads * opsPerThread / secs) / 1e6
+                      << " Mops/s (pool peak " << ps.peakInUse << "/" << ps.size << ", waits " << ps.waits
+                      << ", timeouts " << ps.timeouts << ")\n";
+        }
+    }
+
+    void BenchAudit(size_t threads) {
+        const size_t perThread = 200000;
+        const std::pair<AuditOverflow, AuditFormat> runs[] = { { AuditOverflow::Drop, AuditFormat::Text },
+                                                               { AuditOverflow::Block, AuditFormat::Text },
+                                                               { AuditOverflow::Block, AuditFormat::Binary } };
+        for (auto [policy, format] : runs) {
+            std::remove("bench_audit.log");
+            SecureDatabaseOptions options;
+            options.auditLogPath = "bench_audit.log";
+            options.auditOverflow = policy;
+            options.auditFormat = format;
+            SecureDatabase db(options);
+
+            std::vector<std::thread> workers;
+            auto start = Clock::now();
+            for (size_t t = 0; t < threads; t++) {
+                workers.emplace_back([&db] {
+                    for (size_t i = 0; i < perThread; i++)
+                        db.DeleteUser("alice", "user");   // denied, always audited
+                });
+            }
+            for (auto& w : workers)
+                w.join();
+            double secs = Seconds(start);
+            AuditLogStats stats = db.AuditStats();
+            std::cout << (policy == AuditOverflow::Drop ? "drop " : "block") << (format == AuditFormat::Binary ? " binary" : "")
+                      << ": "
+                      << secs * 1e9 / (threads * perThread) << " ns/denied call (written " << stats.written
+                      << ", dropped " << stats.dropped << ", batches " << stats.batches << ")\n";
+        }
+        std::remove("bench_audit.log");
+    }
+
+    // Concurrent UpdatePassword with a WAL; each call returns only once its
+    // group is fdatasync'ed, so throughput shows how well groups amortize the sync
+    void BenchWal(size_t threads) {
+        const size_t rows = 1000;
+        const size_t perThread = 2000;
+        const char* path = "bench_wal.log";
+        const Session admin(Role::Admin);
+        for (long windowUs : { 0L, 100L, 1000L, 5000L }) {
+            std::remove(path);
+            SecureDatabaseOptions options;
+            options.poolSize = threads;
+            options.walPath = path;
+            options.walGroupWindow = std::chrono::microseconds(windowUs);
+            size_t expected = rows;
+            {
+                SecureDatabase db(options);
+                std::vector<User> users;
+                for (size_t i = 0; i < rows; i++)
+                    users.push_back(User{ MakeUsername(i), "pw", "user" });
+                db.AddUsers(users, admin);
+                WalStats before = db.WriteAheadStats();
+
+                std::vector<std::thread> workers;
+                auto start = Clock::now();
+                for (size_t t = 0; t < threads; t++) {
+                    workers.emplace_back([&db, &admin, t, rows] {
+                        for (size_t i = 0; i < perThread; i++)
+                            db.UpdatePassword(MakeUsername((t * perThread + i) % rows), "secret", admin);
+                    });
+                }
+                for (auto& w : workers)
+                    w.join();
+                double secs = Seconds(start);
+                WalStats after = db.WriteAheadStats();
+                uint64_t groups = after.groups - before.groups;
+                expected += after.records - before.records;
+                std::cout << "window=" << windowUs << "us: " << (threads * perThread) / secs << " commits/s, "
+                          << double(after.records - before.records) / groups << " records/group, "
+                          << double(after.syncNanos - before.syncNanos) / groups / 1000 << " us/sync\n";
+            }
+            SecureDatabase reopened(options);
+            std::cout << "  recovered " << reopened.RecoveredRecords() << " of " << expected << " records\n";
+        }
+        std::remove(path);
+    }
+
+    // Cold start: replaying the full WAL vs. mapping a compacted snapshot
+    // (with an empty delta), plus the first lookup against each
+    void BenchSnapshot(const std::vector<size_t>& sizes) {
+        const char* walPath = "bench_snapshot.wal";
+        const char* snapPath = "bench_snapshot.snap";
+        const Session admin(Role::Admin);
+        for (size_t rows : sizes) {
+            std::remove(walPath);
+            std::remove(snapPath);
+            SecureDatabaseOptions options;
+            options.walPath = walPath;
+            options.compactWalBytes = UINT64_MAX;     // compact explicitly below
+            {
+                SecureDatabase db(options);
+                std::vector<User> users;
+                for (size_t i = 0; i < rows; i++)
+                    users.push_back(User{ MakeUsername(i), "pw", "user" });
+                db.AddUsers(users, admin, 4096);
+            }
+
+            auto timeStart = [&](const char* label) {
+                auto start = Clock::now();
+                SecureDatabase db(options);
+                double open = Seconds(start);
+                start = Clock::now();
+                bool found = db.GetUser(MakeUsername(rows / 2), admin) != nullptr;
+                double first = Seconds(start);
+                StorageStats ss = db.StoreStats();
+                std::cout << "rows=" << rows << " " << label << ": start " << open * 1e3 << " ms, first lookup "
+                          << first * 1e6 << " us (found " << found << ", snapshot rows " << ss.snapshotRows
+                          << ", delta rows " << ss.deltaRows << ")\n";
+            };
+            timeStart("wal replay");
+
+            options.snapshotPath = snapPath;
+            {
+                SecureDatabase db(options);
+                auto start = Clock::now();
+                db.Compact();
+                std::cout << "rows=" << rows << " compaction: " << Seconds(start) * 1e3 << " ms\n";
+            }
+            timeStart("snapshot  ");
+            options.snapshotPath.clear();
+        }
+        std::remove(walPath);
+        std::remove(snapPath);
+    }
+
+    // 90% GetUser / 10% UpdatePassword from 1..maxThreads threads against one
+    // database and against 'shardCount' partitions (pool = threads in both)
+    void BenchShards(size_t maxThreads, size_t shardCount) {
+        const size_t rows = 100000;
+        const size_t opsPerThread = 100000;
+        const Session admin(Role::Admin);
+        std::vector<User> users;
+        for (size_t i = 0; i < rows; i++)
+            users.push_back(User{ MakeUsername(i), "pw", "user" });
+
+        auto run = [&](auto& db, size_t threads) {
+            std::vector<std::thread> workers;
+            auto start = Clock::now();
+            for (size_t t = 0; t < threads; t++) {
+                workers.emplace_back([&db, &admin, t, rows] {
+                    std::mt19937_64 rng(t);
+                    User out;
+                    for (size_t i = 0; i < opsPerThread; i++) {
+                        std::string name = MakeUsername(rng() % rows);
+                        if (i % 10 == 0)
+                            db.UpdatePassword(name, "secret", admin);
+                        else
+                            db.GetUserInto(name, admin, out);
+                    }
+                });
+            }
+            for (auto& w : workers)
+                w.join();
+            return (threads * opsPerThread / Seconds(start)) / 1e6;
+        };
+
+        for (size_t threads = 1; threads <= maxThreads; threads *= 2) {
+            SecureDatabaseOptions options;
+            options.poolSize = threads;
+            options.auditLogPath = "bench_shards_audit.log";
+            SecureDatabase single(options);
+            single.AddUsers(users, admin);
+            double one = run(single, threads);
+
+            ShardedSecureDatabase sharded(shardCount, options);
+            auto start = Clock::now();
+            sharded.AddUsers(users, admin);
+            double load = Seconds(start);
+            double many = run(sharded, threads);
+            size_t scanned = sharded.SelectUsers(admin, [](const UserRef& r) { return r.username.back() == '7'; }).size();
+            std::cout << "threads=" << threads << ": single " << one << " Mops/s, " << shardCount << " shards " << many
+                      << " Mops/s (parallel load " << load * 1e3 << " ms, scan matched " << scanned << ")\n";
+        }
+        std::remove("bench_shards_audit.log");
+    }
+
+    // GetUser latency percentiles while writers rotate passwords one by one
+    // and churn 512-row batches, with readers behind the reader-writer lock
+    // vs. on the lock-free multi-version path
+    void BenchMvcc(size_t readers) {
+        const size_t rows = 100000;
+        const size_t batch = 512;
+        const auto duration = std::chrono::seconds(2);
+        const Session admin(Role::Admin);
+        std::vector<User> users;
+        for (size_t i = 0; i < rows; i++)
+            users.push_back(User{ MakeUsername(i), "pw", "user" });
+        std::vector<User> churn;
+        std::vector<std::string> churnNames;
+        for (size_t i = 0; i < batch; i++) {
+            churn.push_back(User{ "churn" + std::to_string(i), "pw", "user" });
+            churnNames.push_back(churn.back().username);
+        }
+
+        for (bool lockFree : { false, true }) {
+            SecureDatabaseOptions options;
+            options.poolSize = readers + 2;
+            options.lockFreeReads = lockFree;
+            options.usernameFilterFpr = 0.0;    // keep the filter lock out of the read path
+            SecureDatabase db(options);
+            db.AddUsers(users, admin);
+
+            std::atomic<bool> stop{ false };
+            std::atomic<uint64_t> writes{ 0 };
+            std::vector<std::vector<uint32_t>> latencies(readers);
+            std::vector<std::thread> threads;
+            threads.emplace_back([&] {
+                std::mt19937_64 rng(99);
+                while (!stop.load(std::memory_order_relaxed)) {
+                    db.UpdatePassword(MakeUsername(rng() % rows), "rotated", admin);
+                    writes.fetch_add(1, std::memory_order_relaxed);
+                }
+            });
+            threads.emplace_back([&] {
+                while (!stop.load(std::memory_order_relaxed)) {
+                    db.AddUsers(churn, admin, batch);
+                    db.DeleteUsers(churnNames, admin, batch);
+                    writes.fetch_add(2 * batch, std::memory_order_relaxed);
+                }
+            });
+            for (size_t t = 0; t < readers; t++) {
+                threads.emplace_back([&, t] {
+                    std::mt19937_64 rng(t);
+                    User out;
+                    auto& samples = latencies[t];
+                    samples.reserve(1 << 20);
+                    while (!stop.load(std::memory_order_relaxed)) {
+                        std::string name = MakeUsername(rng() % rows);
+                        auto start = Clock::now();
+                        db.GetUserInto(name, admin, out);
+                        samples.push_back(static_cast<uint32_t>(
+                            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()));
+                    }
+                });
+            }
+            std::this_thread::sleep_for(duration);
+            stop = true;
+            for (auto& t : threads)
+                t.join();
+
+            std::vector<uint32_t> all;
+            for (const auto& samples : latencies)
+                all.insert(all.end(), samples.begin(), samples.end());
+            std::sort(all.begin(), all.end());
+            auto pct = [&](double p) { return all.empty() ? 0.0 : all[static_cast<size_t>(p * (all.size() - 1))] / 1000.0; };
+            std::cout << (lockFree ? "lock-free mvcc" : "rwlock        ") << ": " << all.size() << " reads, p50 " << pct(0.50)
+                      << " us, p99 " << pct(0.99) << " us, p99.9 " << pct(0.999) << " us, max " << pct(1.0)
+                      << " us (" << writes.load() << " row writes, " << Epoch::Pending() << " versions awaiting reclamation)\n";
+        }
+    }
+
+    void BenchList(size_t rows) {
+        const char* snapPath = "bench_list.snap";
+        const Session admin(Role::Admin);
+        std::remove(snapPath);
+        SecureDatabaseOptions options;
+        options.snapshotPath = snapPath;
+        options.poolSize = 4;
+        SecureDatabase db(options);
+        // even rows in the snapshot, odd ones in the delta: pages merge both
+        std::vector<User> users;
+        for (size_t i = 0; i < rows; i += 2)
+            users.push_back(User{ MakeUsername(i), "pw", "user" });
+        db.AddUsers(users, admin, 4096);
+        db.Compact();
+        users.clear();
+        for (size_t i = 1; i < rows; i += 2)
+            users.push_back(User{ MakeUsername(i), "pw", "user" });
+        db.AddUsers(users, admin, 4096);
+
+        const std::string prefix = "user1234";
+        const int reps = 20;
+        size_t listed = 0;
+        auto start = Clock::now();
+        for (int r = 0; r < reps; r++)
+            db.ListUsers(prefix, SIZE_MAX, {}, admin, [&](const UserRef&) { listed++; });
+        double list = Seconds(start) / reps;
+        size_t scanned = 0;
+        start = Clock::now();
+        for (int r = 0; r < reps; r++)
+            scanned += db.SelectUsers(admin, [&](const UserRef& u) { return u.username.starts_with(prefix); }).size();
+        double scan = Seconds(start) / reps;
+        std::cout << "prefix \"" << prefix << "\" over " << rows << " rows: ListUsers " << list * 1e6 << " us ("
+                  << listed / reps << " rows), SelectUsers scan " << scan * 1e6 << " us (" << scanned / reps << " rows)\n";
+
+        // page through everything while another thread inserts; every original row must appear exactly once
+        std::atomic<bool> stop{ false };
+        std::atomic<size_t> inserted{ 0 };
+        std::thread writer([&] {
+            std::mt19937_64 rng(11);
+            while (!stop.load(std::memory_order_relaxed)) {
+                db.AddUser(User{ MakeUsername(rng() % rows) + "_new" + std::to_string(inserted.load()), "pw", "user" }, admin);
+                inserted.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+        std::vector<uint8_t> seen(rows, 0);
+        size_t pages = 0, total = 0, outOfOrder = 0;
+        std::string cursor, last;
+        start = Clock::now();
+        do {
+            cursor = db.ListUsers("user", 1000, cursor, admin, [&](const UserRef& u) {
+                outOfOrder += !last.empty() && u.username <= last;
+                last = u.username;
+                total++;
+                std::string_view digits = u.username.substr(4);
+                if (digits.find('_') == std::string_view::npos)
+                    seen[std::strtoull(std::string(digits).c_str(), nullptr, 10)]++;
+            });
+            pages++;
+        } while (!cursor.empty());
+        double paging = Seconds(start);
+        stop = true;
+        writer.join();
+        size_t missed = std::count(seen.begin(), seen.end(), 0);
+        size_t duplicated = rows - missed - std::count(seen.begin(), seen.end(), 1);
+        std::cout << "paged " << total << " rows in " << pages << " pages of 1000 in " << paging * 1e3 << " ms with "
+                  << inserted.load() << " concurrent inserts: " << missed << " missed, " << duplicated
+                  << " duplicated, " << outOfOrder << " out of order\n";
+        std::remove(snapPath);
+    }
+
+    void BenchRoles(size_t rows) {
+        const Session admin(Role::Admin);
+        SecureDatabaseOptions options;
+        options.poolSize = 4;
+        SecureDatabase db(options);
+        // 1% admins, 10% support staff, the rest ordinary users
+        std::vector<User> users;
+        for (size_t i = 0; i < rows; i++)
+            users.push_back(User{ MakeUsername(i), "pw", i % 100 == 0 ? "admin" : i % 10 == 0 ? "support" : "user" });
+        db.AddUsers(users, admin, 4096);
+
+        size_t admins = 0;
+        auto start = Clock::now();
+        db.ListUsersByRole("admin", admin, [&](const UserRef&) { admins++; });
+        double build = Seconds(start);
+        admins = 0;
+        start = Clock::now();
+        db.ListUsersByRole("admin", admin, [&](const UserRef&) { admins++; });
+        double indexed = Seconds(start);
+        start = Clock::now();
+        size_t scanned = db.SelectUsers(admin, [](const UserRef& u) { return u.role == "admin"; }).size();
+        double scan = Seconds(start);
+        StorageStats ss = db.StoreStats();
+        std::cout << rows << " users: all admins via index " << indexed * 1e3 << " ms (" << admins << "), full scan "
+                  << scan * 1e3 << " ms (" << scanned << "), first call incl. index build " << build * 1e3 << " ms, index "
+                  << (ss.roleIndexBytes >> 10) << " KiB for " << ss.roles << " roles\n";
+
+        start = Clock::now();
+        size_t demoted = db.ChangeRole("support", "user", admin);
+        double change = Seconds(start);
+        auto row = db.GetUser(MakeUsername(10), admin);
+        std::cout << "ChangeRole support -> user: " << demoted << " users in " << change * 1e3 << " ms (user10 is now "
+                  << (row ? row->role : "missing") << ")\n";
+    }
+
+    void BenchImport(size_t rows) {
+        const Session admin(Role::Admin);
+        std::string csv = "username,password,role\n";
+        for (size_t i = 0; i < rows; i++)
+            csv += MakeUsername(i) + ",Passw0rd-" + std::to_string(i * 7919) + (i % 100 ? ",user\n" : ",admin\n");
+
+        // baseline: the AddUser loop a migration script would write, on a slice
+        const size_t slice = std::min<size_t>(rows, 50000);
+        {
+            SecureDatabase db;
+            std::istringstream in(csv);
+            std::string line;
+            std::getline(in, line);
+            auto start = Clock::now();
+            for (size_t i = 0; i < slice && std::getline(in, line); i++) {
+                size_t a = line.find(',');
+                size_t b = line.find(',', a + 1);
+                db.AddUser(User{ line.substr(0, a), line.substr(a + 1, b - a - 1), line.substr(b + 1) }, admin);
+            }
+            std::cout << "AddUser loop: " << slice / Seconds(start) << " rows/s (" << slice << " rows)\n";
+        }
+
+        std::string exported;
+        std::vector<size_t> threads = { 1 };
+        for (size_t t = 2; t <= std::max(1u, std::thread::hardware_concurrency()); t *= 2)
+            threads.push_back(t);
+        for (size_t t : threads) {
+            SecureDatabase db;
+            BulkOptions options;
+            options.hashThreads = t;
+            std::istringstream in(csv);
+            BulkStats st = db.ImportUsers(in, admin, options);
+            std::cout << "ImportUsers, " << t << " hash threads: " << st.RowsPerSecond() << " rows/s (" << st.added
+                      << " added, " << st.duplicates << " duplicates, " << st.malformed << " malformed, "
+                      << st.bytes * 1e3 / st.nanos << " MB/s)\n";
+            if (exported.empty()) {
+                std::ostringstream out;
+                BulkStats ex = db.ExportUsers(out, admin);
+                exported = out.str();
+                std::cout << "ExportUsers: " << ex.RowsPerSecond() << " rows/s (" << ex.rows << " rows, "
+                          << (ex.bytes >> 20) << " MiB)\n";
+            }
+        }
+
+        // the export restores into an equal table without rehashing
+        SecureDatabase restored;
+        BulkOptions options;
+        options.passwordsHashed = true;
+        std::istringstream in(exported);
+        BulkStats st = restored.ImportUsers(in, admin, options);
+        auto row = restored.GetUser(MakeUsername(rows / 2), admin);
+        std::ostringstream again;
+        restored.ExportUsers(again, admin);
+        std::cout << "re-import of export: " << st.RowsPerSecond() << " rows/s, " << st.added << " added, round trip "
+                  << (again.str() == exported ? "identical" : "DIFFERS") << " (" << (row ? row->role : "missing") << ")\n";
+    }
+
+    // One caller thread: the blocking API waits out every group commit, the
+    // event loop keeps many requests parked on the I/O executor instead
+    void BenchAsync(size_t maxInFlight) {
+        const size_t rows = 1000;
+        const char* path = "bench_async.log";
+        const Session admin(Role::Admin);
+        std::remove(path);
+        SecureDatabaseOptions options;
+        options.poolSize = maxInFlight;
+        options.walPath = path;
+        options.walGroupWindow = std::chrono::microseconds(1000);
+        SecureDatabase db(options);
+        std::vector<User> users;
+        for (size_t i = 0; i < rows; i++)
+            users.push_back(User{ MakeUsername(i), "pw", "user" });
+        db.AddUsers(users, admin);
+
+        const size_t blockingOps = 500;
+        auto start = Clock::now();
+        for (size_t i = 0; i < blockingOps; i++)
+            db.UpdatePassword(MakeUsername(i % rows), "secret", admin);
+        std::cout << "blocking UpdatePassword: " << blockingOps / Seconds(start) << " ops/s (1 in flight)\n";
+
+        for (size_t inFlight = 1; inFlight <= maxInFlight; inFlight *= 4) {
+            IoExecutor io(inFlight);
+            AsyncSecureDatabase async(db, io);
+            EventLoop loop;
+            const size_t perClient = std::max<size_t>(4, 2000 / inFlight);
+            size_t active = 0;
+            size_t peak = 0;
+            size_t failed = 0;
+            for (size_t c = 0; c < inFlight; c++) {
+                loop.Spawn([](AsyncSecureDatabase& async, Session admin, size_t c, size_t perClient, size_t rows,
+                              size_t& active, size_t& peak, size_t& failed) -> Task<void> {
+                    for (size_t i = 0; i < perClient; i++) {
+                        peak = std::max(peak, ++active);
+                        if (!co_await async.UpdatePassword(MakeUsername((c * perClient + i) % rows), "secret", admin))
+                            failed++;
+                        --active;
+                    }
+                }(async, admin, c, perClient, rows, active, peak, failed));
+            }
+            start = Clock::now();
+            loop.Run();
+            std::cout << "event loop, " << inFlight << " clients: " << inFlight * perClient / Seconds(start)
+                      << " ops/s (" << peak << " in flight, " << failed << " failed)\n";
+        }
+
+        // reads complete without a commit wait, so the loop itself becomes the limit
+        IoExecutor io(4);
+        AsyncSecureDatabase async(db, io);
+        EventLoop loop;
+        const size_t reads = 100000;
+        size_t found = 0;
+        for (size_t c = 0; c < 64; c++) {
+            loop.Spawn([](AsyncSecureDatabase& async, Session admin, size_t c, size_t n, size_t rows,
+                          size_t& found) -> Task<void> {
+                for (size_t i = 0; i < n; i++)
+                    found += co_await async.GetUser(MakeUsername((c * 7919 + i) % rows), admin) != nullptr;
+            }(async, admin, c, reads / 64, rows, found));
+        }
+        start = Clock::now();
+        loop.Run();
+        std::cout << "event loop GetUser, 64 clients: " << (reads / 64 * 64) / Seconds(start) << " ops/s (" << found
+                  << " found)\n";
+        std::remove(path);
+    }
+
+    // Instrumentation overhead on the lookup path: best of several rounds,
+    // databases interleaved so drift hits all three alike
+    void BenchStats(size_t ops) {
+        const size_t rows = 100000;
+        const Session admin(Role::Admin);
+        const Session guest(Role::Guest);
+        std::vector<User> users;
+        for (size_t i = 0; i < rows; i++)
+            users.push_back(User{ MakeUsername(i), "pw", "user" });
+        std::vector<std::string> keys;
+        for (size_t i = 0; i < ops; i++)
+            keys.push_back(MakeUsername(i * 7919 % rows));
+
+        const uint32_t modes[] = { 0, SecureDatabaseOptions{}.metricsSampleEvery, 1 };
+        const char* labels[] = { "metrics off", "sampled", "every call" };
+        std::vector<std::unique_ptr<SecureDatabase>> dbs;
+        for (uint32_t sampleEvery : modes) {
+            SecureDatabaseOptions options;
+            options.metricsSampleEvery = sampleEvery;
+            options.auditLogPath = "/dev/null";
+            dbs.push_back(std::make_unique<SecureDatabase>(options));
+            dbs.back()->AddUsers(users, admin);
+        }
+        // many short rounds, each compared with the uninstrumented run next
+        // to it, so machine noise mostly cancels; report the median ratio
+        const size_t rounds = 50;
+        const size_t perRound = std::max<size_t>(1, ops / rounds);
+        std::vector<double> nanos[3];
+        std::vector<double> ratios[3];
+        User out;
+        for (size_t round = 0; round < rounds; round++) {
+            for (size_t d = 0; d < dbs.size(); d++) {
+                size_t begin = round * perRound % keys.size();
+                auto start = Clock::now();
+                for (size_t i = 0; i < perRound; i++)
+                    dbs[d]->GetUserInto(keys[(begin + i) % keys.size()], admin, out);
+                nanos[d].push_back(Seconds(start) * 1e9 / double(perRound));
+                ratios[d].push_back(nanos[d].back() / nanos[0].back());
+            }
+        }
+        auto median = [](std::vector<double> v) {
+            std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+            return v[v.size() / 2];
+        };
+        for (size_t d = 0; d < dbs.size(); d++) {
+            std::cout << labels[d] << ": " << median(nanos[d]) << " ns/GetUserInto";
+            if (d)
+                std::cout << " (" << (median(ratios[d]) - 1) * 100 << "% overhead)";
+            std::cout << "\n";
+        }
+
+        // a few writes and denials so the table has more than one row
+        SecureDatabase& db = *dbs[1];
+        for (size_t i = 0; i < 1000; i++) {
+            db.UpdatePassword(MakeUsername(i), "secret", admin);
+            db.DeleteUser(MakeUsername(i), guest);
+        }
+        std::cout << db.Stats().ToText();
+    }
+
+    // Login throughput: the old caller-side check, one blocking caller and
+    // a burst of callbacks that the pool spreads over every core
+    void BenchVerify(size_t logins) {
+        const size_t rows = 100000;
+        const Session admin(Role::Admin);
+        SecureDatabaseOptions options;
+        options.auditLogPath = "/dev/null";
+        SecureDatabase db(options);
+        std::vector<User> users;
+        for (size_t i = 0; i < rows; i++)
+            users.push_back(User{ MakeUsername(i), "pw" + std::to_string(i), "user" });
+        db.AddUsers(users, admin);
+        // every fourth attempt uses a wrong password, every eighth an unknown user
+        auto attempt = [&](size_t i, std::string& name, std::string& password) {
+            size_t row = i * 7919 % rows;
+            name = i % 8 == 7 ? "nobody" + std::to_string(i) : MakeUsername(row);
+            password = i % 4 == 3 ? "wrong" : "pw" + std::to_string(row);
+        };
+
+        std::string name;
+        std::string password;
+        size_t accepted = 0;
+        User out;
+        auto start = Clock::now();
+        for (size_t i = 0; i < logins; i++) {
+            attempt(i, name, password);
+            unsigned char digest[SHA256_DIGEST_LENGTH];
+            SHA256(reinterpret_cast<const unsigned char*>(password.data()), password.size(), digest);
+            char hex[SecureDatabase::kEncryptedLength];
+            sha256mb::HexEncode(digest, SHA256_DIGEST_LENGTH, hex);
+            accepted += db.GetUserInto(name, admin, out)
+                && out.password == std::string_view(hex, SecureDatabase::kEncryptedLength);
+        }
+        std::cout << "caller thread, GetUser + compare: " << logins / Seconds(start) << " logins/s (" << accepted
+                  << " accepted)\n";
+
+        accepted = 0;
+        start = Clock::now();
+        for (size_t i = 0; i < logins; i++) {
+            attempt(i, name, password);
+            accepted += db.VerifyPassword(name, password, admin);
+        }
+        std::cout << "blocking VerifyPassword: " << logins / Seconds(start) << " logins/s (" << accepted
+                  << " accepted)\n";
+
+        std::atomic<size_t> done{ 0 };
+        std::atomic<size_t> ok{ 0 };
+        start = Clock::now();
+        for (size_t i = 0; i < logins; i++) {
+            attempt(i, name, password);
+            db.VerifyPasswordAsync(name, password, admin, [&](bool verified) {
+                ok.fetch_add(verified, std::memory_order_relaxed);
+                done.fetch_add(1, std::memory_order_release);
+            });
+        }
+        while (done.load(std::memory_order_acquire) < logins)
+            std::this_thread::yield();
+        WorkPoolStats st = db.VerifyStats();
+        std::cout << "VerifyPasswordAsync burst, " << st.threads << " workers: " << logins / Seconds(start)
+                  << " logins/s (" << ok.load() << " accepted, peak queue " << st.peakQueueDepth << ", "
+                  << st.steals << " steals, " << st.MeanWaitMicros() << " us mean queue wait)\n";
+    }
+
+    // The pre-batch Encrypt: one OpenSSL SHA256 call and a sprintf per digest byte
+    std::string LegacyEncrypt(const std::string& plainText) {
+        unsigned char hash[SHA256_DIGEST_LENGTH];
+        SHA256(reinterpret_cast<const unsigned char*>(plainText.c_str()), plainText.size(), hash);
+        std::string encrypted;
+        for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+            char buf[3];
+            snprintf(buf, sizeof(buf), "%02x", hash[i]);
+            encrypted += buf;
+        }
+        return encrypted;
+    }
+
+    void BenchAes(size_t megabytes) {
+#if defined(__x86_64__) && defined(__GNUC__)
+        std::cout << "AES-NI " << (__builtin_cpu_supports("aes") ? "yes" : "no") << ", VAES "
+                  << (__builtin_cpu_supports("vaes") ? "yes" : "no") << ", VPCLMULQDQ "
+                  << (__builtin_cpu_supports("vpclmulqdq") ? "yes" : "no") << "\n";
+#endif
+        FieldCipher cipher(FieldCipher::GenerateKey());
+        const size_t batch = 256;
+        for (size_t fieldBytes : { 16, 64, 256, 1024, 4096 }) {
+            // the same plaintext bytes for every run, sized to about 'megabytes'
+            const size_t records = std::max(batch, megabytes * 1000000 / fieldBytes / batch * batch);
+            std::string data(fieldBytes * batch, 'x');
+            std::vector<std::string_view> plain;
+            std::vector<std::string_view> aad;
+            std::vector<std::string> names;
+            for (size_t i = 0; i < batch; i++)
+                names.push_back(MakeUsername(i));
+            for (size_t i = 0; i < batch; i++) {
+                plain.push_back(std::string_view(data).substr(i * fieldBytes, fieldBytes));
+                aad.push_back(names[i]);
+            }
+            std::vector<char> sealed(FieldCipher::SealedBytes(plain));
+            std::vector<char> opened(data.size());
+            std::vector<size_t> offsets(batch + 1);
+            std::unique_ptr<bool[]> ok(new bool[batch]);
+            const double gigabytes = double(records) * double(fieldBytes) / 1e9;
+
+            auto start = Clock::now();
+            for (size_t r = 0; r < records; r += batch)
+                for (size_t i = 0; i < batch; i++)
+                    cipher.Seal(plain[i], aad[i], sealed.data() + i * FieldCipher::SealedSize(fieldBytes));
+            double single = gigabytes / Seconds(start);
+
+            start = Clock::now();
+            size_t sealedCount = 0;
+            for (size_t r = 0; r < records; r += batch)
+                sealedCount += cipher.SealBatch(plain, aad, sealed.data(), offsets);
+            double sealRate = gigabytes / Seconds(start);
+
+            std::vector<std::string_view> views;
+            for (size_t i = 0; i < batch; i++)
+                views.push_back(std::string_view(sealed.data() + offsets[i], offsets[i + 1] - offsets[i]));
+            start = Clock::now();
+            size_t openedCount = 0;
+            for (size_t r = 0; r < records; r += batch)
+                openedCount += cipher.OpenBatch(views, aad, opened.data(), offsets, ok.get());
+            double openRate = gigabytes / Seconds(start);
+            bool roundTrip = std::string_view(opened.data(), opened.size()) == data;
+
+            std::cout << fieldBytes << "-byte fields: Seal " << single << " GB/s, SealBatch " << sealRate
+                      << " GB/s, OpenBatch " << openRate << " GB/s (" << sealedCount << " sealed, " << openedCount
+                      << " opened" << (roundTrip ? "" : ", ROUND TRIP MISMATCH") << ")\n";
+        }
+    }
+
+    void BenchHash(size_t count) {
+        using sha256mb::Isa;
+        std::vector<Isa> isas = { Isa::Scalar };
+        for (Isa isa : { Isa::SSE41, Isa::AVX2, Isa::AVX512 })
+            if (sha256mb::Lanes(isa) <= sha256mb::Lanes(sha256mb::Detect()))
+                isas.push_back(isa);
+
+        // every ISA must agree with OpenSSL, including multi-block and empty inputs
+        std::mt19937_64 rng(7);
+        std::vector<std::string> samples;
+        for (size_t len = 0; len < 300; len++) {
+            std::string s(len, '\0');
+            for (auto& c : s)
+                c = static_cast<char>(rng());
+            samples.push_back(s);
+        }
+        std::vector<std::string_view> views(samples.begin(), samples.end());
+        std::vector<unsigned char> digests(views.size() * sha256mb::kDigestBytes);
+        std::vector<char> hex(views.size() * SecureDatabase::kEncryptedLength);
+        for (Isa isa : isas) {
+            sha256mb::Hash(views, digests.data(), isa);
+            sha256mb::HexEncode(digests.data(), digests.size(), hex.data());
+            for (size_t i = 0; i < samples.size(); i++) {
+                if (LegacyEncrypt(samples[i]) != std::string_view(hex.data() + 64 * i, 64)) {
+                    std::cout << sha256mb::Name(isa) << ": digest mismatch at length " << i << "\n";
+                    return;
+                }
+            }
+        }
+
+        for (size_t len : { 8, 16, 32, 64, 128 }) {
+            std::vector<std::string> passwords;
+            for (size_t i = 0; i < count; i++)
+                passwords.push_back(std::string(len, 'p') + std::to_string(i));
+            std::vector<std::string_view> input(passwords.begin(), passwords.end());
+            digests.resize(count * sha256mb::kDigestBytes);
+            hex.resize(count * SecureDatabase::kEncryptedLength);
+
+            auto start = Clock::now();
+            volatile size_t sink = 0;
+            for (const auto& p : passwords)
+                sink = sink + LegacyEncrypt(p).size();
+            std::cout << "len=" << len << " legacy Encrypt: " << Seconds(start) * 1e9 / count << " ns/hash\n";
+
+            for (Isa isa : isas) {
+                start = Clock::now();
+                sha256mb::Hash(input, digests.data(), isa);
+                sha256mb::HexEncode(digests.data(), digests.size(), hex.data());
+                std::cout << "len=" << len << " " << sha256mb::Name(isa) << ": "
+                          << Seconds(start) * 1e9 / count << " ns/hash\n";
+            }
+            start = Clock::now();
+            SecureDatabase::EncryptBatch(input, hex.data());
+            std::cout << "len=" << len << " EncryptBatch: " << Seconds(start) * 1e9 / count << " ns/hash\n";
+        }
+    }
+
+    void BenchCache(size_t ops) {
+        const size_t rows = 200000;
+        std::vector<User> users;
+        for (size_t i = 0; i < rows; i++)
+            users.push_back(User{ MakeUsername(i), "pw", "user" });
+        std::vector<std::string> keys;
+        std::mt19937_64 rng(3);
+        for (size_t i = 0; i < ops; i++) {
+            // 90% of requests go to the hottest 10% of accounts
+            size_t k = rng() % 10 ? rng() % (rows / 10) : rng() % rows;
+            keys.push_back(MakeUsername(k));
+        }
+
+        const Session admin(Role::Admin), reader(Role::User);
+        for (size_t capacity : { size_t(0), size_t(4) << 20, size_t(64) << 20 }) {
+            SecureDatabaseOptions options;
+            options.userCacheBytes = capacity;
+            SecureDatabase db(options);
+            db.AddUsers(users, admin);
+
+            auto start = Clock::now();
+            for (size_t i = 0; i < ops; i++) {
+                if (i % 20 == 0)
+                    db.UpdatePassword(keys[i], "rotated", admin);
+                else
+                    db.GetUser(keys[i], reader);
+            }
+            double secs = Seconds(start);
+            UserCacheStats cs = db.CacheStats();
+            std::cout << "cache=" << (capacity >> 20) << "MiB: " << secs * 1e9 / ops << " ns/op, hit rate "
+                      << cs.HitRate() * 100 << "%, evictions " << cs.evictions << ", invalidations "
+                      << cs.invalidations << ", " << cs.entries << " entries / " << (cs.bytes >> 10) << " KiB\n";
+        }
+    }
+
+    void BenchFilter(size_t rows) {
+        // measured false-positive rate against the configured target
+        for (double fpr : { 0.01, 0.001, 0.0001 }) {
+            CuckooFilter filter(rows, fpr);
+            for (size_t i = 0; i < rows; i++)
+                filter.Insert(MakeUsername(i));
+            size_t falsePositives = 0;
+            for (size_t i = 0; i < rows; i++)
+                falsePositives += filter.MayContain(MakeUsername(rows + i));
+            std::cout << "target fpr " << fpr << ": measured " << double(falsePositives) / rows << ", "
+                      << filter.FingerprintBits() << "-bit fingerprints, " << filter.Bytes() / double(rows)
+                      << " bytes/key\n";
+        }
+
+        std::vector<User> users;
+        std::vector<std::string> absent;
+        for (size_t i = 0; i < rows; i++) {
+            users.push_back(User{ MakeUsername(i), "pw", "user" });
+            absent.push_back("attacker" + std::to_string(i));
+        }
+        const Session reader(Role::User);
+        for (double fpr : { 0.0, 0.001 }) {
+            SecureDatabaseOptions options;
+            options.usernameFilterFpr = fpr;
+            options.usernameFilterCapacity = 1024;   // exercise rebuilds
+            SecureDatabase db(options);
+            db.AddUsers(users, Session(Role::Admin));
+
+            size_t missing = 0;
+            for (const auto& u : users)
+                missing += db.GetUser(u.username, reader) == nullptr;
+            auto start = Clock::now();
+            for (const auto& name : absent)
+                db.GetUser(name, reader);
+            double secs = Seconds(start);
+            FilterStats fs = db.UsernameFilterStats();
+            std::cout << (fpr > 0 ? "filter on : " : "filter off: ") << secs * 1e9 / rows << " ns/unknown lookup, "
+                      << fs.rejected << " rejected, " << (fs.bytes >> 10) << " KiB, " << fs.rebuilds
+                      << " rebuilds, false negatives " << missing << "\n";
+        }
+    }
+
+    int BenchAllocations(size_t ops) {
+        const size_t rows = 10000;
+        std::vector<User> users;
+        std::vector<std::string> keys;
+        for (size_t i = 0; i < rows; i++) {
+            users.push_back(User{ MakeUsername(i), "pw", "user" });
+            keys.push_back(MakeUsername(i));
+        }
+        SecureDatabase db;
+        db.AddUsers(users, Session(Role::Admin));
+
+        const Session reader(Role::User);
+        User out;
+        out.username.reserve(64);
+        out.password.reserve(SecureDatabase::kEncryptedLength);
+        out.role.reserve(16);
+        db.GetUserInto(keys[0], reader, out);      // warm up pool, filter and statement handles
+
+        uint64_t before = g_allocations.load();
+        size_t found = 0;
+        for (size_t i = 0; i < ops; i++) {
+            found += db.GetUserInto(keys[i % rows], reader, out);
+            found += db.GetUserInto("nobody", reader, out);
+        }
+        uint64_t lookupAllocs = g_allocations.load() - before;
+
+        before = g_allocations.load();
+        for (size_t i = 0; i < ops; i++)
+            db.GetUser(keys[i % rows], reader);
+        uint64_t legacyAllocs = g_allocations.load() - before;
+
+        std::cout << "GetUserInto: " << lookupAllocs << " allocations over " << 2 * ops << " lookups ("
+                  << found << " found); GetUser: " << double(legacyAllocs) / ops << " allocations/call\n";
+        if (lookupAllocs != 0) {
+            std::cout << "FAIL: steady-state lookup path allocated\n";
+            return 1;
+        }
+        return 0;
+    }
+}
+
+int main(int argc, char** argv) {
+    std::string mode = argc > 1 ? argv[1] : "lookup";
+    std::vector<size_t> sizes;
+    for (int i = 2; i < argc; i++)
+        sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+
+    if (mode == "lookup") {
+        if (sizes.empty())
+            sizes = { 1000000, 10000000 };
+        for (size_t rows : sizes)
+            BenchLookups(rows);
+    }
+    else if (mode == "batch") {
+        BenchBatch(sizes.empty() ? 100000 : sizes[0]);
+    }
+    else if (mode == "threads") {
+        BenchThreads(sizes.empty() ? std::thread::hardware_concurrency() : sizes[0]);
+    }
+    else if (mode == "audit") {
+        BenchAudit(sizes.empty() ? 4 : sizes[0]);
+    }
+    else if (mode == "wal") {
+        BenchWal(sizes.empty() ? 16 : sizes[0]);
+    }
+    else if (mode == "snapshot") {
+        if (sizes.empty())
+            sizes = { 100000, 1000000 };
+        BenchSnapshot(sizes);
+    }
+    else if (mode == "shards") {
+        BenchShards(sizes.empty() ? 64 : sizes[0], sizes.size() > 1 ? sizes[1] : 16);
+    }
+    else if (mode == "mvcc") {
+        BenchMvcc(sizes.empty() ? 4 : sizes[0]);
+    }
+    else if (mode == "list") {
+        BenchList(sizes.empty() ? 1000000 : sizes[0]);
+    }
+    else if (mode == "roles") {
+        BenchRoles(sizes.empty() ? 1000000 : sizes[0]);
+    }
+    else if (mode == "import") {
+        BenchImport(sizes.empty() ? 1000000 : sizes[0]);
+    }
+    else if (mode == "async") {
+        BenchAsync(sizes.empty() ? 256 : sizes[0]);
+    }
+    else if (mode == "stats") {
+        BenchStats(sizes.empty() ? 1000000 : sizes[0]);
+    }
+    else if (mode == "verify") {
+        BenchVerify(sizes.empty() ? 200000 : sizes[0]);
+    }
+    else if (mode == "aes") {
+        BenchAes(sizes.empty() ? 256 : sizes[0]);
+    }
+    else if (mode == "hash") {
+        BenchHash(sizes.empty() ? 200000 : sizes[0]);
+    }
+    else if (mode == "cache") {
+        BenchCache(sizes.empty() ? 1000000 : sizes[0]);
+    }
+    else if (mode == "filter") {
+        BenchFilter(sizes.empty() ? 1000000 : sizes[0]);
+    }
+    else if (mode == "alloc") {
+        return BenchAllocations(sizes.empty() ? 100000 : sizes[0]);
+    }
+    else if (mode == "statements") {
+        BenchStatements(sizes.empty() ? 1000000 : sizes[0]);
+    }
+    else {
+        std::cout << "Unknown benchmark: " << mode << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include "SecureDatabase.h"
+#include <fstream>
+#include <cstdlib>
+
+// Bulk user import/export against a persistent database.
+// Usage: CS499mod5_bulk import <users.csv|-> <wal> [snapshot] [hash threads|--hashed]
+//        CS499mod5_bulk export <users.csv> <wal> [snapshot]
+// Passwords are hashed on import unless --hashed says the file came from
+// export and holds digests already; a plaintext password is never taken
+// for one because it happens to look like hex. Export needs a file:
+// connection messages go to stdout.
+
+namespace {
+    int Usage() {
+        std::cerr << "usage: CS499mod5_bulk import <users.csv|-> <wal> [snapshot] [hash threads|--hashed]\n"
+                  << "       CS499mod5_bulk export <users.csv> <wal> [snapshot]\n";
+        return 2;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 4)
+        return Usage();
+    std::string mode = argv[1];
+    std::string file = argv[2];
+
+    SecureDatabaseOptions options;
+    options.walPath = argv[3];
+    if (argc > 4)
+        options.snapshotPath = argv[4];
+    options.poolSize = 2;
+    SecureDatabase db(options);
+    const Session admin(Role::Admin);
+
+    BulkOptions bulk;
+    if (mode == "import") {
+        std::ifstream fileIn;
+        if (file != "-") {
+            fileIn.open(file, std::ios::binary);
+            if (!fileIn) {
+                std::cerr << "cannot open " << file << "\n";
+                return 1;
+            }
+        }
+        std::istream& in = file == "-" ? std::cin : fileIn;
+        if (argc > 5 && std::string(argv[5]) == "--hashed")
+            bulk.passwordsHashed = true;
+        else if (argc > 5)
+            bulk.hashThreads = std::strtoull(argv[5], nullptr, 10);
+
+        BulkStats st = db.ImportUsers(in, admin, bulk);
+        std::cerr << "imported " << st.added << " of " << st.rows << " rows (" << st.duplicates << " duplicates, "
+                  << st.malformed << " malformed) in " << st.nanos / 1e9 << " s, " << st.RowsPerSecond() << " rows/s\n";
+        // fold the import into the snapshot so the next start does not replay it
+        if (!options.snapshotPath.empty() && !db.Compact())
+            std::cerr << "compaction failed; the import stays in the write-ahead log\n";
+        return st.malformed ? 1 : 0;
+    }
+    if (mode == "export") {
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "cannot create " << file << "\n";
+            return 1;
+        }
+        BulkStats st = db.ExportUsers(out, admin, bulk);
+        std::cerr << "exported " << st.rows << " rows (" << st.bytes << " bytes) in " << st.nanos / 1e9 << " s\n";
+        return out ? 0 : 1;
+    }
+    return Usage();
+}
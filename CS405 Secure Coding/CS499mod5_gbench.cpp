@@ -0,0 +1,386 @@
+#include "SecureDatabase.h"
+#include <benchmark/benchmark.h>
+#include <openssl/sha.h>
+#include <random>
+#include <map>
+#include <cstdlib>
+
+// Google Benchmark suite for the secure database layer (link with
+// -lbenchmark -lpthread -lcrypto -lsqlite3).
+// Usage: CS499mod5_gbench [--mix=95,50,5] [benchmark flags...]
+//   --mix        read percentages for the mixed GetUser/UpdatePassword
+//                workload (default 95,50)
+// Results are also written as JSON to CS499mod5_gbench.json unless
+// --benchmark_out is given; compare two runs with Google Benchmark's
+// tools/compare.py benchmarks old.json new.json.
+
+namespace {
+    const Session kAdmin(Role::Admin);
+    const Session kGuest(Role::Guest);
+
+    std::string MakeUsername(size_t i) {
+        return "user" + std::to_string(i);
+    }
+
+    std::vector<User> MakeUsers(size_t first, size_t count) {
+        std::vector<User> users;
+        users.reserve(count);
+        for (size_t i = first; i < first + count; i++)
+            users.push_back(User{ MakeUsername(i), "Passw0rd-" + std::to_string(i), "user" });
+        return users;
+    }
+
+    std::vector<std::string> Usernames(const std::vector<User>& users) {
+        std::vector<std::string> names;
+        names.reserve(users.size());
+        for (const User& u : users)
+            names.push_back(u.username);
+        return names;
+    }
+
+    SecureDatabaseOptions QuietOptions(size_t poolSize = 1) {
+        SecureDatabaseOptions options;
+        options.poolSize = poolSize;
+        options.auditLogPath = "/dev/null";     // denials would otherwise flood stdout
+        return options;
+    }
+
+    // Read-only benchmarks share one preloaded database per row count, so
+    // the repeated runs Google Benchmark makes do not reload it
+    SecureDatabase& Preloaded(size_t rows) {
+        static std::map<size_t, std::unique_ptr<SecureDatabase>> loaded;
+        auto& db = loaded[rows];
+        if (!db) {
+            db = std::make_unique<SecureDatabase>(QuietOptions(64));
+            db->AddUsers(MakeUsers(0, rows), kAdmin, 4096);
+        }
+        return *db;
+    }
+}
+
+// --------------------- Single-row CRUD ---------------------
+static void BM_AddUser(benchmark::State& state) {
+    const size_t chunk = 4096;
+    SecureDatabase db(QuietOptions());
+    std::vector<User> users;
+    size_t next = 0;
+    for (auto _ : state) {
+        if (next % chunk == 0) {
+            state.PauseTiming();
+            users = MakeUsers(next, chunk);
+            state.ResumeTiming();
+        }
+        benchmark::DoNotOptimize(db.AddUser(users[next++ % chunk], kAdmin));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_AddUser);
+
+static void BM_GetUser(benchmark::State& state) {
+    const size_t rows = static_cast<size_t>(state.range(0));
+    SecureDatabase& db = Preloaded(rows);
+    std::vector<std::string> keys;
+    std::mt19937_64 rng(42);
+    for (size_t i = 0; i < 4096; i++)
+        keys.push_back(MakeUsername(rng() % rows));
+    User out;
+    size_t i = 0;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(db.GetUserInto(keys[i++ & 4095], kAdmin, out));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetUser)->Arg(100000)->Arg(1000000);
+
+static void BM_GetUserMiss(benchmark::State& state) {
+    const size_t rows = static_cast<size_t>(state.range(0));
+    SecureDatabase& db = Preloaded(rows);
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < 4096; i++)
+        keys.push_back(MakeUsername(rows + i));
+    User out;
+    size_t i = 0;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(db.GetUserInto(keys[i++ & 4095], kAdmin, out));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetUserMiss)->Arg(100000);
+
+static void BM_UpdatePassword(benchmark::State& state) {
+    const size_t rows = 100000;
+    SecureDatabase db(QuietOptions());
+    db.AddUsers(MakeUsers(0, rows), kAdmin, 4096);
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < 4096; i++)
+        keys.push_back(MakeUsername(i * 7919 % rows));
+    size_t i = 0;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(db.UpdatePassword(keys[i++ & 4095], "N3w-Passw0rd", kAdmin));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_UpdatePassword);
+
+static void BM_DeleteUser(benchmark::State& state) {
+    const size_t refill = 4096;
+    SecureDatabase db(QuietOptions());
+    std::vector<User> users = MakeUsers(0, refill);
+    std::vector<std::string> names = Usernames(users);
+    size_t left = 0;
+    for (auto _ : state) {
+        if (!left) {
+            state.PauseTiming();
+            db.AddUsers(users, kAdmin, refill);
+            left = refill;
+            state.ResumeTiming();
+        }
+        benchmark::DoNotOptimize(db.DeleteUser(names[--left], kAdmin));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DeleteUser);
+
+// --------------------- Batched CRUD ---------------------
+static void BM_AddUsers(benchmark::State& state) {
+    const size_t batch = static_cast<size_t>(state.range(0));
+    SecureDatabase db(QuietOptions());
+    std::vector<User> users = MakeUsers(0, batch);
+    std::vector<std::string> names = Usernames(users);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(db.AddUsers(users, kAdmin));
+        state.PauseTiming();
+        db.DeleteUsers(names, kAdmin);
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(batch));
+}
+BENCHMARK(BM_AddUsers)->Arg(1)->Arg(64)->Arg(512)->Arg(4096);
+
+static void BM_DeleteUsers(benchmark::State& state) {
+    const size_t batch = static_cast<size_t>(state.range(0));
+    SecureDatabase db(QuietOptions());
+    std::vector<User> users = MakeUsers(0, batch);
+    std::vector<std::string> names = Usernames(users);
+    for (auto _ : state) {
+        state.PauseTiming();
+        db.AddUsers(users, kAdmin);
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(db.DeleteUsers(names, kAdmin));
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(batch));
+}
+BENCHMARK(BM_DeleteUsers)->Arg(1)->Arg(64)->Arg(512)->Arg(4096);
+
+// --------------------- Encrypt ---------------------
+// Encrypt is private; these time the same work through public entry
+// points: OpenSSL SHA-256 plus hex encoding for one password, and the
+// multi-buffer EncryptBatch used by AddUsers and ImportUsers
+static void BM_Encrypt(benchmark::State& state) {
+    const std::string password(static_cast<size_t>(state.range(0)), 'p');
+    char hex[SecureDatabase::kEncryptedLength];
+    for (auto _ : state) {
+        unsigned char digest[SHA256_DIGEST_LENGTH];
+        SHA256(reinterpret_cast<const unsigned char*>(password.data()), password.size(), digest);
+        sha256mb::HexEncode(digest, SHA256_DIGEST_LENGTH, hex);
+        benchmark::DoNotOptimize(hex);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_Encrypt)->RangeMultiplier(4)->Range(8, 4096);
+
+static void BM_EncryptBatch(benchmark::State& state) {
+    const size_t count = 64;
+    const std::string password(static_cast<size_t>(state.range(0)), 'p');
+    std::vector<std::string_view> inputs(count, password);
+    std::vector<char> hex(count * SecureDatabase::kEncryptedLength);
+    for (auto _ : state) {
+        SecureDatabase::EncryptBatch(inputs, hex.data());
+        benchmark::DoNotOptimize(hex.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count));
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(count) * state.range(0));
+}
+BENCHMARK(BM_EncryptBatch)->RangeMultiplier(4)->Range(8, 4096);
+
+// Reversible AES-GCM fields, 64 per batch with the username as associated data
+static void BM_FieldSealBatch(benchmark::State& state) {
+    const size_t count = 64;
+    FieldCipher cipher(FieldCipher::GenerateKey());
+    const std::string field(static_cast<size_t>(state.range(0)), 'f');
+    const std::string name = "user42";
+    std::vector<std::string_view> plain(count, field);
+    std::vector<std::string_view> aad(count, name);
+    std::vector<char> out(FieldCipher::SealedBytes(plain));
+    std::vector<size_t> offsets(count + 1);
+    for (auto _ : state) {
+        cipher.SealBatch(plain, aad, out.data(), offsets);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count));
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(count) * state.range(0));
+}
+BENCHMARK(BM_FieldSealBatch)->RangeMultiplier(4)->Range(16, 4096);
+
+static void BM_FieldOpenBatch(benchmark::State& state) {
+    const size_t count = 64;
+    FieldCipher cipher(FieldCipher::GenerateKey());
+    const std::string field(static_cast<size_t>(state.range(0)), 'f');
+    const std::string name = "user42";
+    std::vector<std::string_view> plain(count, field);
+    std::vector<std::string_view> aad(count, name);
+    std::vector<char> sealed(FieldCipher::SealedBytes(plain));
+    std::vector<size_t> offsets(count + 1);
+    cipher.SealBatch(plain, aad, sealed.data(), offsets);
+    std::vector<std::string_view> in;
+    for (size_t i = 0; i < count; i++)
+        in.push_back(std::string_view(sealed.data() + offsets[i], offsets[i + 1] - offsets[i]));
+    std::vector<char> out(FieldCipher::OpenedBytes(in));
+    std::unique_ptr<bool[]> opened(new bool[count]);
+    for (auto _ : state) {
+        cipher.OpenBatch(in, aad, out.data(), offsets, opened.get());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count));
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(count) * state.range(0));
+}
+BENCHMARK(BM_FieldOpenBatch)->RangeMultiplier(4)->Range(16, 4096);
+
+// --------------------- Authorization ---------------------
+// The check itself is Session::Can; the string shims also parse a role
+static void BM_AuthorizedCheck(benchmark::State& state) {
+    const Session sessions[] = { kAdmin, Session(Role::User), kGuest };
+    size_t i = 0;
+    for (auto _ : state) {
+        const Session& s = sessions[i++ % 3];
+        benchmark::DoNotOptimize(s.Can(Operation::Select) + s.Can(Operation::Insert));
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+}
+BENCHMARK(BM_AuthorizedCheck);
+
+static void BM_SessionFromRole(benchmark::State& state) {
+    const std::string roles[] = { "admin", "user", "guest", "unknown" };
+    size_t i = 0;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(Session(roles[i++ & 3]).Can(Operation::Select));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SessionFromRole);
+
+// A refused call: the check fails and the attempt is written to the audit log
+static void BM_DeniedGetUser(benchmark::State& state) {
+    SecureDatabase& db = Preloaded(100000);
+    User out;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(db.GetUserInto("user42", kGuest, out));
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DeniedGetUser);
+
+// --------------------- Audit log ---------------------
+// Producers racing on one ring; range(0) picks the overflow policy
+static void BM_LogContended(benchmark::State& state) {
+    static std::unique_ptr<AuditLog> log;
+    if (state.thread_index() == 0)
+        log = std::make_unique<AuditLog>("/dev/null", AuditLog::kDefaultCapacity,
+                                         state.range(0) ? AuditOverflow::Block : AuditOverflow::Drop);
+    const std::string message = "Unauthorized attempt to delete user by role: guest";
+    for (auto _ : state)
+        benchmark::DoNotOptimize(log->Push(message));
+    state.SetItemsProcessed(state.iterations());
+    if (state.thread_index() == 0) {
+        log->Flush();
+        AuditLogStats stats = log->Stats();
+        state.counters["dropped"] = benchmark::Counter(double(stats.dropped));
+        state.counters["batches"] = benchmark::Counter(double(stats.batches));
+        log.reset();
+    }
+}
+BENCHMARK(BM_LogContended)->ArgName("block")->Arg(0)->Arg(1)->ThreadRange(1, 8)->UseRealTime();
+
+// --------------------- Mixed workload ---------------------
+// range(0)% GetUser, the rest UpdatePassword, on one shared database
+// with a connection per thread
+static void BM_Mixed(benchmark::State& state) {
+    const size_t rows = 100000;
+    static std::unique_ptr<SecureDatabase> db;
+    if (state.thread_index() == 0) {
+        db = std::make_unique<SecureDatabase>(QuietOptions(static_cast<size_t>(state.threads())));
+        db->AddUsers(MakeUsers(0, rows), kAdmin, 4096);
+    }
+    const uint64_t readPercent = static_cast<uint64_t>(state.range(0));
+    std::mt19937_64 rng(static_cast<uint64_t>(state.thread_index()) + 1);
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < 4096; i++)
+        keys.push_back(MakeUsername(rng() % rows));
+    User out;
+    size_t i = 0;
+    uint64_t reads = 0;
+    for (auto _ : state) {
+        const std::string& key = keys[i++ & 4095];
+        if (rng() % 100 < readPercent) {
+            benchmark::DoNotOptimize(db->GetUserInto(key, kAdmin, out));
+            reads++;
+        }
+        else {
+            benchmark::DoNotOptimize(db->UpdatePassword(key, "N3w-Passw0rd", kAdmin));
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["reads"] = benchmark::Counter(double(reads), benchmark::Counter::kIsRate);
+    if (state.thread_index() == 0)
+        db.reset();
+}
+
+namespace {
+    std::vector<int64_t> ParseMix(const std::string& list) {
+        std::vector<int64_t> percents;
+        size_t pos = 0;
+        while (pos <= list.size()) {
+            size_t comma = std::min(list.find(',', pos), list.size());
+            long v = std::strtol(list.substr(pos, comma - pos).c_str(), nullptr, 10);
+            if (v >= 0 && v <= 100)
+                percents.push_back(v);
+            pos = comma + 1;
+        }
+        return percents;
+    }
+}
+
+int main(int argc, char** argv) {
+    // strip our flag, and default the JSON report if none was asked for
+    std::vector<char*> args;
+    std::vector<int64_t> mix = { 95, 50 };
+    bool hasOut = false;
+    for (int i = 0; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--mix=", 0) == 0) {
+            mix = ParseMix(arg.substr(6));
+            if (mix.empty()) {
+                std::cerr << "--mix takes read percentages from 0 to 100, e.g. --mix=95,50\n";
+                return 2;
+            }
+            continue;
+        }
+        hasOut |= arg.rfind("--benchmark_out=", 0) == 0;
+        args.push_back(argv[i]);
+    }
+    std::string out = "--benchmark_out=CS499mod5_gbench.json";
+    std::string format = "--benchmark_out_format=json";
+    if (!hasOut) {
+        args.push_back(out.data());
+        args.push_back(format.data());
+    }
+    int count = static_cast<int>(args.size());
+
+    auto* mixed = benchmark::RegisterBenchmark("BM_Mixed", BM_Mixed);
+    mixed->ArgName("read%")->ThreadRange(1, 8)->UseRealTime();
+    for (int64_t percent : mix)
+        mixed->Arg(percent);
+
+    benchmark::Initialize(&count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(count, args.data()))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}